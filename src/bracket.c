@@ -0,0 +1,591 @@
+/**
+ * bracket.c - Bracket pair index
+ *
+ * Every row is reduced to the brackets it contains outside strings and
+ * comments, counting an opening bracket as +1 and a closing one as -1:
+ * the net count, the lowest running count from the start of the row and
+ * the highest running count from its end. These combine associatively, so
+ * the rows are kept in an implicit treap (a balanced tree ordered by row
+ * number) whose nodes also hold the combined counts of their subtree.
+ * Finding the bracket that closes an open one is then a descent to the
+ * first row where the running count drops below zero, and rows inserted,
+ * deleted or re-lexed update O(log n) nodes.
+ *
+ * The counts come from the lexer's highlighting. A row's counts are only
+ * trusted once it is highlighted up to date, so a search highlights the
+ * rows its answer depends on before accepting it. The tree is built the
+ * first time it is needed.
+ */
+
+#include <stdlib.h>
+
+#include "pleditor.h"
+#include "bracket.h"
+
+/* The search ran past the last row it may look at */
+#define SEARCH_BEYOND -2
+/* No row pairs with the bracket */
+#define SEARCH_UNMATCHED -1
+
+/* Bracket counts of a run of rows */
+typedef struct bracket_summary {
+    int net;            /* Opening minus closing brackets */
+    int low;            /* Lowest running count from the start, at most 0 */
+    int high;           /* Highest running count from the end, at least 0 */
+} bracket_summary;
+
+/* Tree node for one row. Node 0 is the empty tree */
+typedef struct bracket_node {
+    int left, right;        /* Children, 0 if none */
+    unsigned int priority;  /* Heap order that keeps the tree balanced */
+    int size;               /* Rows in the subtree */
+    bracket_summary row;    /* Counts of this row */
+    bracket_summary sum;    /* Counts of the subtree's rows in order */
+} bracket_node;
+
+struct pleditor_bracket_index {
+    bracket_node *nodes;    /* Node pool */
+    int used;               /* Nodes handed out, including node 0 */
+    int cap;                /* Nodes allocated */
+    int free_list;          /* Released nodes, linked through left */
+    int root;               /* Tree of all rows */
+    unsigned int seed;      /* Priority generator state */
+};
+
+/* Pseudo-random priority (xorshift) */
+static unsigned int next_priority(pleditor_bracket_index *index) {
+    unsigned int x = index->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    index->seed = x;
+    return x;
+}
+
+/* +1 for an opening bracket at rx, -1 for a closing one, 0 otherwise.
+ * Brackets in strings and comments don't count */
+static int bracket_value(const pleditor_state *state, const pleditor_row *row, int rx) {
+    int value;
+    switch (row->render[rx]) {
+        case '(': case '[': case '{': value = 1; break;
+        case ')': case ']': case '}': value = -1; break;
+        default: return 0;
+    }
+
+    if (!state->syntax) return value;
+    if (!row->hl.valid) return 0;
+    switch (row->hl.hl[rx]) {
+        case HL_STRING:
+        case HL_COMMENT:
+        case HL_MULTILINE_COMMENT:
+            return 0;
+    }
+    return value;
+}
+
+/* Do an opening and a closing bracket form a pair of the same kind */
+static bool brackets_pair(char open, char close) {
+    return (open == '(' && close == ')') ||
+           (open == '[' && close == ']') ||
+           (open == '{' && close == '}');
+}
+
+/* Counts of the rows of a followed by those of b */
+static bracket_summary summary_join(bracket_summary a, bracket_summary b) {
+    bracket_summary s;
+    s.net = a.net + b.net;
+    s.low = (a.net + b.low < a.low) ? a.net + b.low : a.low;
+    s.high = (b.net + a.high > b.high) ? b.net + a.high : b.high;
+    return s;
+}
+
+/* Counts of one row as currently highlighted */
+static bracket_summary row_summary(const pleditor_state *state, const pleditor_row *row) {
+    bracket_summary s = {0, 0, 0};
+    if (state->syntax && !row->hl.valid) return s;
+
+    for (int rx = 0; rx < row->render_size; rx++) {
+        int value = bracket_value(state, row, rx);
+        if (!value) continue;
+
+        s.net += value;
+        if (s.net < s.low) s.low = s.net;
+        s.high = (s.high + value > 0) ? s.high + value : 0;
+    }
+    return s;
+}
+
+/* Recompute a node's size and subtree counts from its children */
+static void node_pull(pleditor_bracket_index *index, int t) {
+    bracket_node *n = &index->nodes[t];
+    bracket_node *l = &index->nodes[n->left];
+    bracket_node *r = &index->nodes[n->right];
+
+    n->size = l->size + 1 + r->size;
+    n->sum = summary_join(summary_join(l->sum, n->row), r->sum);
+}
+
+/* Take a node from the pool; 0 if out of memory */
+static int node_alloc(pleditor_bracket_index *index) {
+    if (index->free_list) {
+        int t = index->free_list;
+        index->free_list = index->nodes[t].left;
+        return t;
+    }
+
+    if (index->used == index->cap) {
+        int cap = index->cap * 2;
+        bracket_node *nodes = realloc(index->nodes, sizeof(bracket_node) * cap);
+        if (!nodes) return 0;
+        index->nodes = nodes;
+        index->cap = cap;
+    }
+    return index->used++;
+}
+
+/* Move the priority of node t down until both children have lower ones */
+static void sift_down(pleditor_bracket_index *index, int t) {
+    for (;;) {
+        bracket_node *n = &index->nodes[t];
+        int child = n->left;
+        if (n->right && (!child || index->nodes[n->right].priority > index->nodes[child].priority)) {
+            child = n->right;
+        }
+        if (!child || index->nodes[child].priority <= n->priority) return;
+
+        unsigned int priority = n->priority;
+        n->priority = index->nodes[child].priority;
+        index->nodes[child].priority = priority;
+        t = child;
+    }
+}
+
+/* Link nodes lo..hi, which hold consecutive rows, into a balanced tree */
+static int build(pleditor_bracket_index *index, int lo, int hi) {
+    if (lo > hi) return 0;
+
+    int t = lo + (hi - lo) / 2;
+    bracket_node *n = &index->nodes[t];
+    n->left = build(index, lo, t - 1);
+    n->right = build(index, t + 1, hi);
+    sift_down(index, t);
+    node_pull(index, t);
+    return t;
+}
+
+/* Split tree t into its first k rows and the rest */
+static void split(pleditor_bracket_index *index, int t, int k, int *first, int *rest) {
+    if (!t) {
+        *first = *rest = 0;
+        return;
+    }
+
+    bracket_node *n = &index->nodes[t];
+    int left_size = index->nodes[n->left].size;
+    if (k <= left_size) {
+        split(index, n->left, k, first, &n->left);
+        *rest = t;
+    } else {
+        split(index, n->right, k - left_size - 1, &n->right, rest);
+        *first = t;
+    }
+    node_pull(index, t);
+}
+
+/* Join two trees, the rows of a before those of b */
+static int merge(pleditor_bracket_index *index, int a, int b) {
+    if (!a) return b;
+    if (!b) return a;
+
+    if (index->nodes[a].priority > index->nodes[b].priority) {
+        index->nodes[a].right = merge(index, index->nodes[a].right, b);
+        node_pull(index, a);
+        return a;
+    }
+    index->nodes[b].left = merge(index, a, index->nodes[b].left);
+    node_pull(index, b);
+    return b;
+}
+
+/* Store new counts for row k of tree t. Returns whether they changed */
+static bool set_row(pleditor_bracket_index *index, int t, int k, bracket_summary s) {
+    if (!t) return false;
+
+    bracket_node *n = &index->nodes[t];
+    int left_size = index->nodes[n->left].size;
+    bool changed;
+    if (k < left_size) {
+        changed = set_row(index, n->left, k, s);
+    } else if (k > left_size) {
+        changed = set_row(index, n->right, k - left_size - 1, s);
+    } else {
+        changed = n->row.net != s.net || n->row.low != s.low || n->row.high != s.high;
+        n->row = s;
+    }
+
+    if (changed) node_pull(index, t);
+    return changed;
+}
+
+/**
+ * Find the first row at or after from in tree t, whose first row is number
+ * base, at which the running count drops to target. *level is the count
+ * before the first row searched and is advanced past the rows skipped.
+ * Whole subtrees that can't reach the target are skipped in one step.
+ */
+static int find_forward(pleditor_bracket_index *index, int t, int base, int from,
+                        int *level, int target) {
+    if (!t) return -1;
+
+    bracket_node *n = &index->nodes[t];
+    if (base + n->size <= from) return -1;
+    if (base >= from && *level + n->sum.low > target) {
+        *level += n->sum.net;
+        return -1;
+    }
+
+    int found = find_forward(index, n->left, base, from, level, target);
+    if (found >= 0) return found;
+
+    int row = base + index->nodes[n->left].size;
+    if (row >= from) {
+        if (*level + n->row.low <= target) return row;
+        *level += n->row.net;
+    }
+    return find_forward(index, n->right, row + 1, from, level, target);
+}
+
+/* Like find_forward, walking back from row to: the last row at which the
+ * count taken from the end rises to target */
+static int find_backward(pleditor_bracket_index *index, int t, int base, int to,
+                         int *level, int target) {
+    if (!t) return -1;
+
+    bracket_node *n = &index->nodes[t];
+    if (base > to) return -1;
+    if (base + n->size - 1 <= to && *level + n->sum.high < target) {
+        *level += n->sum.net;
+        return -1;
+    }
+
+    int row = base + index->nodes[n->left].size;
+    int found = find_backward(index, n->right, row + 1, to, level, target);
+    if (found >= 0) return found;
+
+    if (row <= to) {
+        if (*level + n->row.high >= target) return row;
+        *level += n->row.net;
+    }
+    return find_backward(index, n->left, base, to, level, target);
+}
+
+/* Build the index if there is none yet */
+static bool index_ready(pleditor_state *state) {
+    if (state->brackets) return true;
+
+    pleditor_bracket_index *index = calloc(1, sizeof(pleditor_bracket_index));
+    if (!index) return false;
+
+    index->cap = state->num_rows + 1;
+    index->used = index->cap;
+    index->seed = 2463534242u;
+    index->nodes = calloc(index->cap, sizeof(bracket_node));
+    if (!index->nodes) {
+        free(index);
+        return false;
+    }
+
+    /* Node i + 1 holds row i */
+    for (int i = 0; i < state->num_rows; i++) {
+        index->nodes[i + 1].priority = next_priority(index);
+        index->nodes[i + 1].row = row_summary(state, &state->rows[i]);
+    }
+    index->root = build(index, 1, state->num_rows);
+    state->brackets = index;
+    return true;
+}
+
+/* Scan a row from rx towards its end for the bracket at which the count
+ * reaches target. Returns its column, or -1 with *level at the row's end */
+static int scan_forward(const pleditor_state *state, const pleditor_row *row, int rx,
+                        int *level, int target) {
+    for (; rx < row->render_size; rx++) {
+        *level += bracket_value(state, row, rx);
+        if (*level == target) return rx;
+    }
+    return -1;
+}
+
+/* Scan a row from rx back to its start; see scan_forward */
+static int scan_backward(const pleditor_state *state, const pleditor_row *row, int rx,
+                         int *level, int target) {
+    for (; rx >= 0; rx--) {
+        *level += bracket_value(state, row, rx);
+        if (*level == target) return rx;
+    }
+    return -1;
+}
+
+/**
+ * The first row from..last_row at which the count, starting from *level,
+ * drops to target. Rows up to the answer are highlighted first, since their
+ * counts are only exact once they are. On success *level is the count
+ * before the row. Returns SEARCH_BEYOND if the answer lies past last_row
+ * or can't be known without highlighting past it.
+ */
+static int search_forward(pleditor_state *state, int from, int last_row, int *level, int target) {
+    if (last_row >= state->num_rows) last_row = state->num_rows - 1;
+    if (from > last_row) return SEARCH_BEYOND;
+
+    for (;;) {
+        pleditor_bracket_index *index = state->brackets;
+        int entry = *level;
+        int row = find_forward(index, index->root, 0, from, &entry, target);
+
+        int needed = (row < 0 || row > last_row) ? last_row : row;
+        if (state->syntax && needed >= state->hl_frontier) {
+            pleditor_syntax_ensure(state, needed);
+            continue;
+        }
+
+        if (row >= 0 && row <= last_row) {
+            *level = entry;
+            return row;
+        }
+        if (row < 0 && (!state->syntax || state->hl_frontier >= state->num_rows)) {
+            return SEARCH_UNMATCHED;
+        }
+        return SEARCH_BEYOND;
+    }
+}
+
+/* The last row from to back to the first at which the count, taken from
+ * the end, rises to target. Rows up to to must be highlighted already */
+static int search_backward(pleditor_state *state, int to, int *level, int target) {
+    if (to < 0) return SEARCH_UNMATCHED;
+
+    pleditor_bracket_index *index = state->brackets;
+    int row = find_backward(index, index->root, 0, to, level, target);
+    return (row >= 0) ? row : SEARCH_UNMATCHED;
+}
+
+/* Free the index; it is built again when next needed */
+void pleditor_bracket_free(pleditor_state *state) {
+    if (!state->brackets) return;
+    free(state->brackets->nodes);
+    free(state->brackets);
+    state->brackets = NULL;
+}
+
+/* A row was inserted at row_idx */
+void pleditor_bracket_row_inserted(pleditor_state *state, int row_idx) {
+    pleditor_bracket_index *index = state->brackets;
+    if (!index) return;
+
+    int t = node_alloc(index);
+    if (!t) {
+        pleditor_bracket_free(state);
+        return;
+    }
+
+    bracket_node *n = &index->nodes[t];
+    n->left = n->right = 0;
+    n->priority = next_priority(index);
+    n->row = row_summary(state, &state->rows[row_idx]);
+    node_pull(index, t);
+
+    int first, rest;
+    split(index, index->root, row_idx, &first, &rest);
+    index->root = merge(index, merge(index, first, t), rest);
+}
+
+/* The row at row_idx was deleted */
+void pleditor_bracket_row_deleted(pleditor_state *state, int row_idx) {
+    pleditor_bracket_index *index = state->brackets;
+    if (!index) return;
+
+    int first, row, rest;
+    split(index, index->root, row_idx, &first, &rest);
+    split(index, rest, 1, &row, &rest);
+    if (row) {
+        index->nodes[row].left = index->free_list;
+        index->free_list = row;
+    }
+    index->root = merge(index, first, rest);
+}
+
+/* The text or highlighting of a row changed */
+void pleditor_bracket_row_changed(pleditor_state *state, int row_idx) {
+    pleditor_bracket_index *index = state->brackets;
+    if (!index || row_idx < 0 || row_idx >= state->num_rows) return;
+
+    set_row(index, index->root, row_idx, row_summary(state, &state->rows[row_idx]));
+}
+
+/**
+ * Find the bracket pairing with the one at row, rx. Opening brackets are
+ * followed forward no further than last_row; closing ones are followed
+ * back to the start of the file.
+ */
+enum pleditor_bracket_status pleditor_bracket_match(pleditor_state *state, int row, int rx,
+                                                    int last_row, int *match_row, int *match_rx) {
+    if (row < 0 || row >= state->num_rows) return BRACKET_NONE;
+
+    pleditor_syntax_ensure(state, row);
+    if (!index_ready(state)) return BRACKET_NONE;
+
+    pleditor_row *r = &state->rows[row];
+    if (rx < 0 || rx >= r->render_size) return BRACKET_NONE;
+    int value = bracket_value(state, r, rx);
+    if (!value) return BRACKET_NONE;
+
+    int level = 0;
+    int at_row = row;
+    int at_rx;
+    if (value > 0) {
+        at_rx = scan_forward(state, r, rx + 1, &level, -1);
+        if (at_rx < 0) {
+            at_row = search_forward(state, row + 1, last_row, &level, -1);
+            if (at_row == SEARCH_BEYOND) return BRACKET_NONE;
+            if (at_row == SEARCH_UNMATCHED) return BRACKET_UNMATCHED;
+            at_rx = scan_forward(state, &state->rows[at_row], 0, &level, -1);
+        }
+    } else {
+        at_rx = scan_backward(state, r, rx - 1, &level, 1);
+        if (at_rx < 0) {
+            at_row = search_backward(state, row - 1, &level, 1);
+            if (at_row == SEARCH_UNMATCHED) return BRACKET_UNMATCHED;
+            pleditor_row *found = &state->rows[at_row];
+            at_rx = scan_backward(state, found, found->render_size - 1, &level, 1);
+        }
+    }
+    if (at_rx < 0) return BRACKET_NONE;
+
+    *match_row = at_row;
+    *match_rx = at_rx;
+    char c = r->render[rx];
+    char other = state->rows[at_row].render[at_rx];
+    bool same_kind = (value > 0) ? brackets_pair(c, other) : brackets_pair(other, c);
+    return same_kind ? BRACKET_MATCHED : BRACKET_MISMATCHED;
+}
+
+/* Find the first closing bracket with no opening one, or else the last
+ * opening bracket with no closing one. Returns false if they balance */
+bool pleditor_bracket_unbalanced(pleditor_state *state, int *row, int *rx) {
+    if (state->num_rows == 0) return false;
+
+    pleditor_syntax_ensure(state, state->num_rows - 1);
+    if (!index_ready(state)) return false;
+
+    pleditor_bracket_index *index = state->brackets;
+    bracket_summary all = index->nodes[index->root].sum;
+    int level = 0;
+    int at_row, at_rx;
+    if (all.low < 0) {
+        at_row = search_forward(state, 0, state->num_rows - 1, &level, -1);
+        if (at_row < 0) return false;
+        at_rx = scan_forward(state, &state->rows[at_row], 0, &level, -1);
+    } else if (all.high > 0) {
+        at_row = search_backward(state, state->num_rows - 1, &level, 1);
+        if (at_row < 0) return false;
+        pleditor_row *found = &state->rows[at_row];
+        at_rx = scan_backward(state, found, found->render_size - 1, &level, 1);
+    } else {
+        return false;
+    }
+    if (at_rx < 0) return false;
+
+    *row = at_row;
+    *rx = at_rx;
+    return true;
+}
+
+/* Column of the bracket at or just before rx, or -1 */
+static int bracket_near(const pleditor_state *state, const pleditor_row *row, int rx) {
+    if (rx < row->render_size && bracket_value(state, row, rx)) return rx;
+    if (rx > 0 && rx <= row->render_size && bracket_value(state, row, rx - 1)) return rx - 1;
+    return -1;
+}
+
+/**
+ * Brackets to mark when drawing: the one at the cursor and its pair, or
+ * else the pair enclosing the cursor. Searches stop at last_row, which is
+ * expected to be highlighted already. Returns how many marks were filled,
+ * in file order.
+ */
+int pleditor_bracket_marks(pleditor_state *state, int last_row, pleditor_bracket_mark marks[2]) {
+    int row = state->cy;
+    if (row >= state->num_rows) return 0;
+
+    pleditor_syntax_ensure(state, row);
+    if (!index_ready(state)) return 0;
+
+    pleditor_row *r = &state->rows[row];
+    int rx = bracket_near(state, r, state->rx);
+    if (rx < 0) {
+        /* The nearest unclosed bracket before the cursor */
+        int level = 0;
+        rx = scan_backward(state, r, state->rx - 1, &level, 1);
+        if (rx < 0) {
+            row = search_backward(state, row - 1, &level, 1);
+            if (row < 0) return 0;
+            r = &state->rows[row];
+            rx = scan_backward(state, r, r->render_size - 1, &level, 1);
+            if (rx < 0) return 0;
+        }
+    }
+
+    int match_row, match_rx;
+    enum pleditor_bracket_status status =
+        pleditor_bracket_match(state, row, rx, last_row, &match_row, &match_rx);
+
+    bool error = status == BRACKET_MISMATCHED || status == BRACKET_UNMATCHED;
+    marks[0] = (pleditor_bracket_mark){row, rx, error};
+    if (status != BRACKET_MATCHED && status != BRACKET_MISMATCHED) return 1;
+
+    marks[1] = (pleditor_bracket_mark){match_row, match_rx, error};
+    if (match_row < row || (match_row == row && match_rx < rx)) {
+        pleditor_bracket_mark first = marks[1];
+        marks[1] = marks[0];
+        marks[0] = first;
+    }
+    return 2;
+}
+
+/* Move the cursor to the bracket pairing with the one under it. Away from
+ * a bracket, move to the first one that is unbalanced */
+void pleditor_bracket_jump(pleditor_state *state) {
+    int row = state->cy;
+    int rx = -1;
+    if (row < state->num_rows) {
+        pleditor_syntax_ensure(state, row);
+        pleditor_row *r = &state->rows[row];
+        rx = bracket_near(state, r, pleditor_cx_to_rx(r, state->cx));
+    }
+
+    if (rx < 0) {
+        int bad_row, bad_rx;
+        if (!pleditor_bracket_unbalanced(state, &bad_row, &bad_rx)) {
+            pleditor_set_status_message(state, "Brackets are balanced");
+            return;
+        }
+        state->cy = bad_row;
+        state->cx = pleditor_rx_to_cx(&state->rows[bad_row], bad_rx);
+        pleditor_set_status_message(state, "Unbalanced bracket");
+        return;
+    }
+
+    int match_row, match_rx;
+    enum pleditor_bracket_status status =
+        pleditor_bracket_match(state, row, rx, state->num_rows - 1, &match_row, &match_rx);
+    if (status != BRACKET_MATCHED && status != BRACKET_MISMATCHED) {
+        pleditor_set_status_message(state, "No matching bracket");
+        return;
+    }
+
+    state->cy = match_row;
+    state->cx = pleditor_rx_to_cx(&state->rows[match_row], match_rx);
+    if (status == BRACKET_MISMATCHED) {
+        pleditor_set_status_message(state, "Mismatched bracket");
+    }
+}
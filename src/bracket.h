@@ -0,0 +1,42 @@
+/**
+ * bracket.h - Bracket pair index for pleditor
+ */
+#ifndef BRACKET_H
+#define BRACKET_H
+
+#include <stdbool.h>
+
+/* Bracket counts of every row, kept as a balanced tree (see bracket.c) */
+typedef struct pleditor_bracket_index pleditor_bracket_index;
+
+/* Outcome of looking for the bracket that pairs with another */
+enum pleditor_bracket_status {
+    BRACKET_NONE,        /* Not a bracket, or the search gave up */
+    BRACKET_MATCHED,     /* Paired with a bracket of the same kind */
+    BRACKET_MISMATCHED,  /* Paired with a bracket of another kind */
+    BRACKET_UNMATCHED    /* Nothing pairs with it */
+};
+
+/* A bracket to be marked on screen */
+typedef struct pleditor_bracket_mark {
+    int row;            /* File row */
+    int rx;             /* Render column */
+    bool error;         /* Unmatched or mismatched */
+} pleditor_bracket_mark;
+
+/* Forward declaration for the struct defined in pleditor.h */
+struct pleditor_state;
+
+/* Function prototypes */
+void pleditor_bracket_free(struct pleditor_state *state);
+void pleditor_bracket_row_inserted(struct pleditor_state *state, int row_idx);
+void pleditor_bracket_row_deleted(struct pleditor_state *state, int row_idx);
+void pleditor_bracket_row_changed(struct pleditor_state *state, int row_idx);
+
+enum pleditor_bracket_status pleditor_bracket_match(struct pleditor_state *state, int row, int rx,
+                                                    int last_row, int *match_row, int *match_rx);
+bool pleditor_bracket_unbalanced(struct pleditor_state *state, int *row, int *rx);
+int pleditor_bracket_marks(struct pleditor_state *state, int last_row, pleditor_bracket_mark marks[2]);
+void pleditor_bracket_jump(struct pleditor_state *state);
+
+#endif /* BRACKET_H */
@@ -0,0 +1,218 @@
+/**
+ * macro.c - Keyboard macro recording and replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pleditor.h"
+#include "macro.h"
+#include "platform.h"
+
+/* Initialize an empty macro */
+void pleditor_macro_init(pleditor_macro *macro) {
+    memset(macro, 0, sizeof(*macro));
+}
+
+/* Free macro resources */
+void pleditor_macro_free(pleditor_macro *macro) {
+    free(macro->keys);
+    memset(macro, 0, sizeof(*macro));
+}
+
+/* Is the key one of the macro commands (never recorded) */
+bool pleditor_macro_is_command(int key) {
+    return key == PLEDITOR_KEY_MACRO_RECORD || key == PLEDITOR_KEY_MACRO_RUN ||
+           key == PLEDITOR_KEY_MACRO_REPEAT || key == PLEDITOR_KEY_MACRO_LINES;
+}
+
+/* Append a key to the macro being recorded */
+void pleditor_macro_record_key(pleditor_state *state, int key) {
+    pleditor_macro *macro = &state->macro;
+    if (!macro->recording || macro->replaying) return;
+    if (key == PLEDITOR_KEY_REFRESH || pleditor_macro_is_command(key)) return;
+
+    if (macro->len == macro->cap) {
+        int newcap = macro->cap ? macro->cap * 2 : 64;
+        int *keys = realloc(macro->keys, sizeof(int) * newcap);
+        if (!keys) return;
+        macro->keys = keys;
+        macro->cap = newcap;
+    }
+    macro->keys[macro->len++] = key;
+}
+
+/* Next key of the macro being replayed. A prompt that would read past the
+ * end of the recording is cancelled */
+int pleditor_macro_next_key(pleditor_state *state) {
+    pleditor_macro *macro = &state->macro;
+    if (macro->replay_pos >= macro->len) return PLEDITOR_KEY_ESC;
+    return macro->keys[macro->replay_pos++];
+}
+
+/* Start recording, or stop and keep what was recorded */
+void pleditor_macro_toggle_recording(pleditor_state *state) {
+    pleditor_macro *macro = &state->macro;
+
+    if (macro->recording) {
+        macro->recording = false;
+        pleditor_set_status_message(state, "Macro recorded (%d keys)", macro->len);
+    } else {
+        macro->recording = true;
+        macro->len = 0;
+        pleditor_set_status_message(state, "Recording macro... press F3 to stop");
+    }
+}
+
+/* How often a long replay checks for Esc */
+#define MACRO_POLL_MS 50
+
+/* Whether the user pressed Esc to stop the replay. Checked at most every
+ * MACRO_POLL_MS; other events are handled and other keys are dropped */
+static bool macro_interrupted(pleditor_state *state, long long *next_poll) {
+    long long now = pleditor_platform_time_ms();
+    if (now < *next_poll) return false;
+    *next_poll = now + MACRO_POLL_MS;
+
+    pleditor_event event;
+    while (1) {
+        if (!pleditor_platform_wait_event(&event, 0)) {
+            /* The terminal went away */
+            state->should_quit = true;
+            return true;
+        }
+        if (event.type == PLEDITOR_EVENT_NONE) return false;
+        if (event.type != PLEDITOR_EVENT_KEY) {
+            pleditor_handle_event(state, &event);
+        } else if (event.key == PLEDITOR_KEY_ESC) {
+            return true;
+        }
+    }
+}
+
+/* Feed the recorded keys through the keypress handler once */
+static void macro_replay(pleditor_state *state) {
+    pleditor_macro *macro = &state->macro;
+
+    macro->replay_pos = 0;
+    while (macro->replay_pos < macro->len && !state->should_quit) {
+        pleditor_handle_keypress(state, macro->keys[macro->replay_pos++]);
+    }
+}
+
+/* Check that there is a macro that may be replayed now */
+static bool macro_can_run(pleditor_state *state) {
+    if (state->macro.recording) {
+        pleditor_set_status_message(state, "Can't run a macro while recording one");
+        return false;
+    }
+    if (state->macro.len == 0) {
+        pleditor_set_status_message(state, "No macro recorded (F3 to record)");
+        return false;
+    }
+    return true;
+}
+
+/* Replay the macro the given number of times as a single undo step */
+void pleditor_macro_run(pleditor_state *state, int times) {
+    if (!macro_can_run(state)) return;
+
+    /* The screen is drawn once, after the last replay */
+    state->macro.replaying = true;
+    pleditor_begin_undo_group(state);
+
+    int done = 0;
+    bool stopped = false;
+    long long next_poll = pleditor_platform_time_ms() + MACRO_POLL_MS;
+    while (done < times && !state->should_quit) {
+        if (macro_interrupted(state, &next_poll)) {
+            stopped = true;
+            break;
+        }
+        macro_replay(state);
+        done++;
+    }
+
+    pleditor_end_undo_group(state);
+    state->macro.replaying = false;
+
+    if (stopped) {
+        pleditor_set_status_message(state, "Macro stopped after %d of %d runs", done, times);
+    } else if (times > 1) {
+        pleditor_set_status_message(state, "Macro ran %d times", done);
+    }
+}
+
+/* Replay the macro at the start of each line from first to last (0-based) */
+void pleditor_macro_run_lines(pleditor_state *state, int first, int last) {
+    if (!macro_can_run(state)) return;
+
+    if (first < 0) first = 0;
+    if (last >= state->num_rows) last = state->num_rows - 1;
+    if (first > last) {
+        pleditor_set_status_message(state, "No lines in range");
+        return;
+    }
+
+    state->macro.replaying = true;
+    pleditor_begin_undo_group(state);
+
+    int done = 0;
+    bool stopped = false;
+    long long next_poll = pleditor_platform_time_ms() + MACRO_POLL_MS;
+    for (int line = first; line <= last && line < state->num_rows && !state->should_quit; line++) {
+        if (macro_interrupted(state, &next_poll)) {
+            stopped = true;
+            break;
+        }
+        int rows_before = state->num_rows;
+
+        state->cy = line;
+        state->cx = 0;
+        macro_replay(state);
+        done++;
+
+        /* Lines the macro inserted or deleted shift the rest of the range */
+        int delta = state->num_rows - rows_before;
+        line += delta;
+        last += delta;
+    }
+
+    pleditor_end_undo_group(state);
+    state->macro.replaying = false;
+
+    if (stopped) {
+        pleditor_set_status_message(state, "Macro stopped after %d lines", done);
+    } else {
+        pleditor_set_status_message(state, "Macro applied to %d lines", done);
+    }
+}
+
+/* Ask how many times to replay the macro */
+void pleditor_macro_prompt_run(pleditor_state *state) {
+    if (!macro_can_run(state)) return;
+
+    char *input = pleditor_prompt(state, "Run macro how many times", NULL);
+    if (input == NULL) return;
+
+    char *end;
+    long times = strtol(input, &end, 10);
+    bool valid = *end == '\0' && times >= 1 && times <= 1000000000L;
+    free(input);
+    if (!valid) {
+        pleditor_set_status_message(state, "Invalid count");
+        return;
+    }
+
+    pleditor_macro_run(state, (int)times);
+}
+
+/* Ask for a line range ("from-to" or a single line) and apply the macro to it */
+void pleditor_macro_prompt_lines(pleditor_state *state) {
+    if (!macro_can_run(state)) return;
+
+    int first, last;
+    if (!pleditor_prompt_range(state, "Apply macro to lines (from-to)", &first, &last)) return;
+    pleditor_macro_run_lines(state, first, last);
+}
@@ -0,0 +1,40 @@
+/**
+ * macro.h - Keyboard macros for pleditor
+ */
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdbool.h>
+
+/**
+ * A macro is the list of keys typed while recording, including keys typed
+ * into prompts. Replaying feeds them back through the keypress handler with
+ * screen updates suppressed; prompts opened by the macro read their input
+ * from the recording as well.
+ */
+typedef struct pleditor_macro {
+    int *keys;          /* Recorded key codes */
+    int len;            /* Number of recorded keys */
+    int cap;            /* Keys allocated */
+    bool recording;     /* Keys are being recorded */
+    bool replaying;     /* Recorded keys are being replayed */
+    int replay_pos;     /* Next key to replay */
+} pleditor_macro;
+
+/* Forward declaration for the struct defined in pleditor.h */
+struct pleditor_state;
+
+/* Function prototypes */
+void pleditor_macro_init(pleditor_macro *macro);
+void pleditor_macro_free(pleditor_macro *macro);
+bool pleditor_macro_is_command(int key);
+void pleditor_macro_record_key(struct pleditor_state *state, int key);
+int pleditor_macro_next_key(struct pleditor_state *state);
+
+void pleditor_macro_toggle_recording(struct pleditor_state *state);
+void pleditor_macro_run(struct pleditor_state *state, int times);
+void pleditor_macro_run_lines(struct pleditor_state *state, int first, int last);
+void pleditor_macro_prompt_run(struct pleditor_state *state);
+void pleditor_macro_prompt_lines(struct pleditor_state *state);
+
+#endif /* MACRO_H */
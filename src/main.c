@@ -3,6 +3,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "pleditor.h"
 #include "platform.h"
@@ -15,11 +16,27 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    /* Honor the ncurses ESCDELAY convention for the escape timeout */
+    const char *escdelay = getenv("ESCDELAY");
+    if (escdelay) {
+        pleditor_platform_set_escape_timeout(atoi(escdelay));
+    }
+
     /* Initialize editor state */
     pleditor_state state;
     pleditor_init(&state);
     pleditor_syntax_init(&state);
 
+    /* Extra syntax definitions, loaded before the file so they apply to it */
+    const char *syntax_file = getenv("PLEDITOR_SYNTAX");
+    int syntax_error_line = 0;
+    bool syntax_loaded = !syntax_file ||
+                         pleditor_syntax_load_file(syntax_file, &syntax_error_line);
+
+    /* PLEDITOR_TRIGRAMS=0 leaves large files unindexed, searching every row */
+    const char *trigrams = getenv("PLEDITOR_TRIGRAMS");
+    if (trigrams && atoi(trigrams) == 0) state.use_trigrams = false;
+
     /* Open file if specified */
     if (argc >= 2 && !pleditor_open(&state, argv[1])) {
         pleditor_platform_cleanup();
@@ -29,12 +46,26 @@ int main(int argc, char *argv[]) {
     /* Set initial status message */
     pleditor_set_status_message(&state,
         "HELP: Ctrl-S = save/save as | Ctrl-Q = quit | Ctrl-R = toggle line numbers");
+    if (!syntax_loaded && syntax_error_line > 0) {
+        pleditor_set_status_message(&state, "%s:%d: invalid syntax definition",
+                                    syntax_file, syntax_error_line);
+    } else if (!syntax_loaded) {
+        pleditor_set_status_message(&state, "Can't read syntax definitions from %s", syntax_file);
+    }
 
     /* Main editor loop */
     while (!state.should_quit) {
         pleditor_refresh_screen(&state);
-        int c = pleditor_platform_read_key();
-        pleditor_handle_keypress(&state, c);
+
+        /* Wait for something to happen, then handle everything already
+         * pending so that a burst of events is drawn only once */
+        pleditor_event event;
+        if (!pleditor_platform_wait_event(&event, -1)) break;
+        do {
+            pleditor_handle_event(&state, &event);
+        } while (!state.should_quit &&
+                 pleditor_platform_wait_event(&event, 0) &&
+                 event.type != PLEDITOR_EVENT_NONE);
     }
 
     /* Cleanup resources and restore terminal status */
@@ -0,0 +1,357 @@
+/**
+ * match.c - Index of search matches
+ *
+ * The start of every match of the query, overlapping ones included, is
+ * kept in one array sorted by row and column, so counting the matches,
+ * finding the one before or after a position and finding those on a row
+ * are binary searches. The array is filled by searching the whole file
+ * once per query. A literal query that extends the indexed one can only
+ * match where that one does, so typing more of it filters the array instead.
+ * Rows that are edited are searched again and their entries spliced in.
+ * A large file is searched in chunks of rows, one per thread, whose
+ * matches are joined in order. The search goes from the top a slice of
+ * time at a time, between which the editor handles events; the rows
+ * indexed so far can be used meanwhile, and are kept current as they are
+ * edited. Rows that the trigram index (trigram.c) rules out are passed over.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pleditor.h"
+#include "platform.h"
+#include "match.h"
+
+/* Fewest rows worth giving a thread of their own */
+#define MATCH_PARALLEL_MIN_ROWS 4096
+
+/* Make room for at least count matches */
+static bool reserve(pleditor_match_index *index, int count) {
+    if (count <= index->capacity) return true;
+
+    int capacity = index->capacity ? index->capacity : 256;
+    while (capacity < count) capacity *= 2;
+    pleditor_match *matches = realloc(index->matches, sizeof(pleditor_match) * capacity);
+    if (!matches) return false;
+    index->matches = matches;
+    index->capacity = capacity;
+    return true;
+}
+
+/* Where search_each callbacks put the matches of a row */
+typedef struct match_row {
+    pleditor_match_index *index;
+    int row;            /* Row being searched */
+    int at;             /* Next position to write in the index, or count */
+    bool ok;            /* There was memory for every match */
+} match_row;
+
+static void count_match(int col, void *arg) {
+    (void)col;
+    ((match_row *)arg)->at++;
+}
+
+static void fill_match(int col, void *arg) {
+    match_row *dst = arg;
+    dst->index->matches[dst->at].row = dst->row;
+    dst->index->matches[dst->at].col = col;
+    dst->at++;
+}
+
+static void append_match(int col, void *arg) {
+    match_row *dst = arg;
+    pleditor_match_index *index = dst->index;
+    if (!dst->ok || !reserve(index, index->num_matches + 1)) {
+        dst->ok = false;
+        return;
+    }
+    index->matches[index->num_matches].row = dst->row;
+    index->matches[index->num_matches].col = col;
+    index->num_matches++;
+}
+
+/* Number of matches in a row, or -1 if out of memory */
+static int count_row(pleditor_match_index *index, const pleditor_row *row) {
+    match_row dst = {.index = index};
+    if (!pleditor_search_each(&index->pattern, row->chars, row->size, count_match, &dst)) return -1;
+    return dst.at;
+}
+
+/* Write the matches of a row, which has room for, from index position at */
+static void fill_row(pleditor_match_index *index, const pleditor_row *row, int row_idx, int at) {
+    match_row dst = {.index = index, .row = row_idx, .at = at};
+    pleditor_search_each(&index->pattern, row->chars, row->size, fill_match, &dst);
+}
+
+/* Append the matches of pattern in rows from begin to end. Returns false
+ * if out of memory */
+static bool search_rows(pleditor_match_index *index, const pleditor_search_pattern *pattern,
+                        const pleditor_row *rows, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        match_row dst = {.index = index, .row = i, .ok = true};
+        if (!pleditor_search_each(pattern, rows[i].chars, rows[i].size, append_match, &dst) ||
+            !dst.ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Rows split into equal chunks, each collecting its matches apart */
+typedef struct match_parallel_job {
+    const pleditor_row *rows;
+    int begin, end;                 /* Rows to search */
+    int chunks;
+    pleditor_search_pattern *patterns; /* Copy of the pattern for each chunk */
+    pleditor_match_index *parts;    /* Matches of each chunk */
+    bool *ok;                       /* Chunks that had memory for theirs */
+} match_parallel_job;
+
+/* Collect the matches of one chunk */
+static void search_chunk(int index, void *arg) {
+    match_parallel_job *job = arg;
+    long long total = job->end - job->begin;
+    int from = job->begin + (int)(total * index / job->chunks);
+    int to = job->begin + (int)(total * (index + 1) / job->chunks);
+    job->ok[index] = search_rows(&job->parts[index], &job->patterns[index], job->rows, from, to);
+}
+
+/* Append the matches of the rows from begin to end */
+static bool build(pleditor_state *state, int begin, int end) {
+    pleditor_match_index *index = &state->matches;
+
+    int chunks = pleditor_platform_cpu_count();
+    if (chunks > (end - begin) / MATCH_PARALLEL_MIN_ROWS) {
+        chunks = (end - begin) / MATCH_PARALLEL_MIN_ROWS;
+    }
+
+    pleditor_match_index *parts = (chunks > 1) ? calloc(chunks, sizeof(pleditor_match_index)) : NULL;
+    bool *ok = (chunks > 1) ? calloc(chunks, sizeof(bool)) : NULL;
+    if (!parts || !ok) {
+        free(parts);
+        free(ok);
+        return search_rows(index, &index->pattern, state->rows, begin, end);
+    }
+
+    /* Each chunk has its own arrays, and a copy of the pattern since a
+     * regular expression's automaton is built as it is used; the copies
+     * are kept for the rest of the query's rows */
+    bool result = pleditor_search_clones_reserve(&index->clones, &index->pattern, chunks);
+
+    match_parallel_job job = {
+        .rows = state->rows,
+        .begin = begin,
+        .end = end,
+        .chunks = chunks,
+        .patterns = index->clones.patterns,
+        .parts = parts,
+        .ok = ok,
+    };
+    if (result) pleditor_platform_parallel_for(chunks, search_chunk, &job);
+
+    int total = 0;
+    for (int i = 0; i < chunks; i++) {
+        if (!ok[i]) result = false;
+        total += parts[i].num_matches;
+    }
+    if (result && reserve(index, index->num_matches + total)) {
+        for (int i = 0; i < chunks; i++) {
+            if (parts[i].num_matches == 0) continue;
+            memcpy(&index->matches[index->num_matches], parts[i].matches,
+                   sizeof(pleditor_match) * parts[i].num_matches);
+            index->num_matches += parts[i].num_matches;
+        }
+    } else {
+        result = false;
+    }
+
+    for (int i = 0; i < chunks; i++) {
+        pleditor_match_free(&parts[i]);
+    }
+    free(parts);
+    free(ok);
+    return result;
+}
+
+/* Keep the matches that the (longer) literal pattern also matches at */
+static void narrow(pleditor_state *state) {
+    pleditor_match_index *index = &state->matches;
+
+    int kept = 0;
+    for (int i = 0; i < index->num_matches; i++) {
+        pleditor_match match = index->matches[i];
+        const pleditor_row *row = &state->rows[match.row];
+        if (pleditor_search_matches_at(&index->pattern, row->chars, row->size, match.col)) {
+            index->matches[kept++] = match;
+        }
+    }
+    index->num_matches = kept;
+}
+
+/* Free the index */
+void pleditor_match_free(pleditor_match_index *index) {
+    pleditor_search_free_pattern(&index->pattern);
+    pleditor_search_clones_free(&index->clones);
+    free(index->matches);
+    index->matches = NULL;
+    index->num_matches = 0;
+    index->capacity = 0;
+    index->rows_indexed = 0;
+    index->building = false;
+    index->valid = false;
+}
+
+/**
+ * Index the matches of the first len bytes of query, searched for with
+ * PLEDITOR_SEARCH_* flags, unless they already are or are being. Rows are
+ * searched for up to one slice of time; pleditor_match_continue() does the
+ * rest. Returns false if out of memory
+ */
+bool pleditor_match_query(pleditor_state *state, const char *query, int len, int flags) {
+    pleditor_match_index *index = &state->matches;
+    pleditor_search_pattern *pattern = &index->pattern;
+
+    if ((index->valid || index->building) && pattern->flags == flags && pattern->len == len &&
+        memcmp(pattern->bytes, query, len) == 0) {
+        return true;
+    }
+
+    /* Matches of a longer literal query are among those of the indexed one,
+     * unless only whole words match */
+    bool extends = index->valid && pattern->flags == flags &&
+                   !(flags & (PLEDITOR_SEARCH_REGEX | PLEDITOR_SEARCH_WHOLE_WORD)) &&
+                   pattern->len > 0 && pattern->len < len &&
+                   memcmp(pattern->bytes, query, pattern->len) == 0;
+
+    index->valid = false;
+    index->building = false;
+    pleditor_search_clones_free(&index->clones);
+    if (!pleditor_search_compile(pattern, query, len, flags)) return false;
+
+    if (len == 0 || pattern->error) {
+        index->num_matches = 0;
+    } else if (extends) {
+        narrow(state);
+    } else {
+        index->num_matches = 0;
+        index->rows_indexed = 0;
+        index->building = true;
+        return pleditor_match_continue(state);
+    }
+    index->valid = true;
+    return true;
+}
+
+/* Index more rows for the query being indexed, for up to one slice of
+ * time. Returns false if out of memory */
+bool pleditor_match_continue(pleditor_state *state) {
+    pleditor_match_index *index = &state->matches;
+    if (!index->building) return true;
+
+    long long until = pleditor_platform_time_ms() + PLEDITOR_SEARCH_SLICE_MS;
+    int rows = MATCH_PARALLEL_MIN_ROWS * pleditor_platform_cpu_count();
+    while (index->rows_indexed < state->num_rows) {
+        /* Rows the trigram index rules out have no matches to add */
+        int end;
+        index->rows_indexed = pleditor_trigram_next(state, &index->pattern, index->rows_indexed, &end);
+        if (index->rows_indexed == state->num_rows) break;
+        if (end > index->rows_indexed + rows) end = index->rows_indexed + rows;
+        if (!build(state, index->rows_indexed, end)) {
+            /* Started over when next needed */
+            index->building = false;
+            return false;
+        }
+        index->rows_indexed = end;
+        if (pleditor_platform_time_ms() >= until) return true;
+    }
+
+    index->building = false;
+    index->valid = true;
+    return true;
+}
+
+/* Percentage of the file indexed so far */
+int pleditor_match_progress(const pleditor_state *state) {
+    if (state->matches.valid || state->num_rows == 0) return 100;
+    return (int)((long long)state->matches.rows_indexed * 100 / state->num_rows);
+}
+
+/* Position in the index of the first match at or after row, col */
+int pleditor_match_find(const pleditor_match_index *index, int row, int col) {
+    int lo = 0, hi = index->num_matches;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const pleditor_match *match = &index->matches[mid];
+        if (match->row < row || (match->row == row && match->col < col)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Whether the matches of the row at row_idx are in the index */
+static bool indexed(const pleditor_match_index *index, int row_idx) {
+    return index->valid || (index->building && row_idx < index->rows_indexed);
+}
+
+/* A row was inserted at row_idx; the rows after it moved down by one */
+void pleditor_match_row_inserted(pleditor_state *state, int row_idx) {
+    pleditor_match_index *index = &state->matches;
+    if (!indexed(index, row_idx)) return;
+    if (index->building) index->rows_indexed++;
+
+    for (int i = pleditor_match_find(index, row_idx, 0); i < index->num_matches; i++) {
+        index->matches[i].row++;
+    }
+    pleditor_match_row_changed(state, row_idx);
+}
+
+/* The row at row_idx was deleted; the rows after it moved up by one */
+void pleditor_match_row_deleted(pleditor_state *state, int row_idx) {
+    pleditor_match_index *index = &state->matches;
+    if (!indexed(index, row_idx)) return;
+    if (index->building) index->rows_indexed--;
+
+    int first = pleditor_match_find(index, row_idx, 0);
+    int last = pleditor_match_find(index, row_idx + 1, 0);
+    memmove(&index->matches[first], &index->matches[last],
+            sizeof(pleditor_match) * (index->num_matches - last));
+    index->num_matches -= last - first;
+
+    for (int i = first; i < index->num_matches; i++) {
+        index->matches[i].row--;
+    }
+}
+
+/* The text of the row at row_idx changed */
+void pleditor_match_row_changed(pleditor_state *state, int row_idx) {
+    pleditor_match_index *index = &state->matches;
+    if (!indexed(index, row_idx) || index->pattern.len == 0) return;
+    if (row_idx < 0 || row_idx >= state->num_rows) return;
+
+    const pleditor_row *row = &state->rows[row_idx];
+    int first = pleditor_match_find(index, row_idx, 0);
+    int last = pleditor_match_find(index, row_idx + 1, 0);
+    int count = count_row(index, row);
+
+    int num_matches = index->num_matches - (last - first) + count;
+    if (count < 0 || !reserve(index, num_matches)) {
+        /* Rebuilt when next needed */
+        index->valid = false;
+        index->building = false;
+        return;
+    }
+
+    memmove(&index->matches[first + count], &index->matches[last],
+            sizeof(pleditor_match) * (index->num_matches - last));
+    fill_row(index, row, row_idx, first);
+    index->num_matches = num_matches;
+}
+
+/* Rows changed too many to follow one by one: rebuilt when next needed */
+void pleditor_match_invalidate(pleditor_state *state) {
+    state->matches.valid = false;
+    state->matches.building = false;
+}
@@ -0,0 +1,44 @@
+/**
+ * match.h - Index of search matches for pleditor
+ */
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdbool.h>
+
+#include "search.h"
+
+/* Where a match starts */
+typedef struct pleditor_match {
+    int row;
+    int col;
+} pleditor_match;
+
+/* Every match of one query in the file, sorted by position */
+typedef struct pleditor_match_index {
+    pleditor_search_pattern pattern; /* Query the matches are of */
+    pleditor_search_clones clones;   /* Copies of pattern for parallel chunks */
+    pleditor_match *matches;
+    int num_matches;
+    int capacity;
+    int rows_indexed;   /* Rows searched so far while building */
+    bool building;      /* Matches are current for pattern up to rows_indexed */
+    bool valid;         /* Matches are current for pattern */
+} pleditor_match_index;
+
+/* Forward declaration for the struct defined in pleditor.h */
+struct pleditor_state;
+
+/* Function prototypes */
+void pleditor_match_free(pleditor_match_index *index);
+bool pleditor_match_query(struct pleditor_state *state, const char *query, int len, int flags);
+bool pleditor_match_continue(struct pleditor_state *state);
+int pleditor_match_progress(const struct pleditor_state *state);
+int pleditor_match_find(const pleditor_match_index *index, int row, int col);
+
+void pleditor_match_row_inserted(struct pleditor_state *state, int row_idx);
+void pleditor_match_row_deleted(struct pleditor_state *state, int row_idx);
+void pleditor_match_row_changed(struct pleditor_state *state, int row_idx);
+void pleditor_match_invalidate(struct pleditor_state *state);
+
+#endif /* MATCH_H */
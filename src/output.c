@@ -0,0 +1,319 @@
+/**
+ * output.c - Frame output optimizer implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "terminal.h"
+
+/* Grow a byte buffer so it can hold at least need bytes */
+static void output_reserve(char **buf, int *cap, int need) {
+    if (need <= *cap) return;
+
+    int newcap = *cap ? *cap : 256;
+    while (newcap < need) newcap *= 2;
+
+    char *newbuf = realloc(*buf, newcap);
+    if (!newbuf) {
+        /* Keep the old buffer; the frame will be dropped */
+        return;
+    }
+    *buf = newbuf;
+    *cap = newcap;
+}
+
+/* Append bytes to the frame */
+static void output_append(pleditor_output *out, const char *s, int len) {
+    output_reserve(&out->buf, &out->cap, out->len + len);
+    if (out->len + len > out->cap) return;
+    memcpy(out->buf + out->len, s, len);
+    out->len += len;
+}
+
+/* Append bytes to the row being drawn */
+static void line_append(pleditor_output *out, const char *s, int len) {
+    output_reserve(&out->line, &out->line_cap, out->line_len + len);
+    if (out->line_len + len > out->line_cap) return;
+    memcpy(out->line + out->line_len, s, len);
+    out->line_len += len;
+}
+
+/* Is this SGR parameter a plain foreground color */
+static bool sgr_is_foreground(int sgr) {
+    return (sgr >= 30 && sgr <= 39) || (sgr >= 90 && sgr <= 97);
+}
+
+/* Format the shortest sequence switching the terminal from one SGR to another */
+static int sgr_sequence(char *dst, int from, int to) {
+    if (to == PLEDITOR_SGR_RESET) {
+        return sprintf(dst, "\x1b[m");
+    }
+
+    /* Foreground colors replace each other; anything else needs a reset */
+    if (from == PLEDITOR_SGR_RESET || (sgr_is_foreground(from) && sgr_is_foreground(to))) {
+        return sprintf(dst, "\x1b[%dm", to);
+    }
+    return sprintf(dst, "\x1b[0;%dm", to);
+}
+
+/* Format a CSI sequence with an optional count; a count of 1 is implied */
+static int csi_count(char *dst, int n, char final) {
+    if (n == 1) return sprintf(dst, "\x1b[%c", final);
+    return sprintf(dst, "\x1b[%d%c", n, final);
+}
+
+/* Append the cheapest sequence that moves the cursor to row, col */
+static void output_move_cursor(pleditor_output *out, int row, int col) {
+    if (out->cursor_row == row && out->cursor_col == col) return;
+
+    /* Absolute position; omitted parameters default to 1 */
+    char abs[32];
+    int abs_len;
+    if (row == 0 && col == 0) {
+        abs_len = sprintf(abs, VT100_CURSOR_HOME);
+    } else if (col == 0) {
+        abs_len = sprintf(abs, "\x1b[%dH", row + 1);
+    } else {
+        abs_len = sprintf(abs, "\x1b[%d;%dH", row + 1, col + 1);
+    }
+
+    if (out->cursor_row < 0) {
+        output_append(out, abs, abs_len);
+        out->cursor_row = row;
+        out->cursor_col = col;
+        return;
+    }
+
+    /* Relative motion: CR/LF when landing on column 0, CUU/CUD/CUF/CUB otherwise */
+    char rel[64];
+    int rel_len = 0;
+    int from_col = out->cursor_col;
+    int down = row - out->cursor_row;
+
+    if (col == 0) {
+        if (from_col != 0) rel[rel_len++] = '\r';
+        if (down > 0) {
+            if (down <= 4) {
+                while (down--) rel[rel_len++] = '\n';
+            } else {
+                rel_len += csi_count(rel + rel_len, down, 'B');
+            }
+        } else if (down < 0) {
+            rel_len += csi_count(rel + rel_len, -down, 'A');
+        }
+    } else {
+        if (down > 0) rel_len += csi_count(rel + rel_len, down, 'B');
+        if (down < 0) rel_len += csi_count(rel + rel_len, -down, 'A');
+
+        if (from_col < 0) {
+            /* Column unknown (pending wrap): return to the left edge first */
+            rel[rel_len++] = '\r';
+            rel_len += csi_count(rel + rel_len, col, 'C');
+        } else if (col > from_col) {
+            rel_len += csi_count(rel + rel_len, col - from_col, 'C');
+        } else if (col < from_col) {
+            char back[16], cr[16];
+            int back_len = csi_count(back, from_col - col, 'D');
+            int cr_len = 1 + csi_count(cr + 1, col, 'C');
+            cr[0] = '\r';
+            if (back_len <= cr_len) {
+                memcpy(rel + rel_len, back, back_len);
+                rel_len += back_len;
+            } else {
+                memcpy(rel + rel_len, cr, cr_len);
+                rel_len += cr_len;
+            }
+        }
+    }
+
+    if (rel_len <= abs_len) {
+        output_append(out, rel, rel_len);
+    } else {
+        output_append(out, abs, abs_len);
+    }
+    out->cursor_row = row;
+    out->cursor_col = col;
+}
+
+/* 64-bit FNV-1a hash of a row's bytes */
+static uint64_t line_hash(const char *s, int len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Initialize an output optimizer */
+void pleditor_output_init(pleditor_output *out, bool sync_update) {
+    memset(out, 0, sizeof(*out));
+    out->sync_update = sync_update;
+    pleditor_output_invalidate(out);
+}
+
+/* Free output optimizer resources */
+void pleditor_output_free(pleditor_output *out) {
+    free(out->buf);
+    free(out->line);
+    free(out->shown);
+    free(out->shown_valid);
+    memset(out, 0, sizeof(*out));
+}
+
+/* Forget what the terminal shows; the next frame redraws everything */
+void pleditor_output_invalidate(pleditor_output *out) {
+    for (int i = 0; i < out->rows; i++) {
+        out->shown_valid[i] = false;
+    }
+    out->cursor_row = -1;
+    out->cursor_col = -1;
+    out->shown_cursor_row = -1;
+    out->shown_cursor_col = -1;
+    out->sgr = -1;
+}
+
+/* Start a new frame for a terminal of the given size */
+void pleditor_output_begin_frame(pleditor_output *out, int rows, int cols) {
+    if (rows != out->rows || cols != out->cols) {
+        uint64_t *shown = realloc(out->shown, sizeof(uint64_t) * rows);
+        bool *shown_valid = realloc(out->shown_valid, sizeof(bool) * rows);
+        if (shown) out->shown = shown;
+        if (shown_valid) out->shown_valid = shown_valid;
+        out->rows = (shown && shown_valid) ? rows : 0;
+        out->cols = cols;
+        pleditor_output_invalidate(out);
+    }
+
+    out->len = 0;
+    out->committed = 0;
+
+    /* Hold the terminal's redraw until the frame is complete, then hide the
+     * cursor so it does not jump around while rows are written */
+    if (out->sync_update) {
+        output_append(out, VT100_SYNC_BEGIN, sizeof(VT100_SYNC_BEGIN) - 1);
+    }
+    output_append(out, VT100_CURSOR_HIDE, sizeof(VT100_CURSOR_HIDE) - 1);
+}
+
+/* Start drawing a screen row */
+void pleditor_output_begin_line(pleditor_output *out) {
+    out->line_len = 0;
+    out->line_prefix = 0;
+    out->line_first_sgr = -1;
+    out->line_sgr = PLEDITOR_SGR_RESET;
+    out->line_pending_sgr = PLEDITOR_SGR_RESET;
+    out->line_cols = 0;
+    out->line_multibyte = false;
+}
+
+/* Select the SGR attribute for the text that follows */
+void pleditor_output_color(pleditor_output *out, int sgr) {
+    out->line_pending_sgr = sgr;
+}
+
+/* Emit a pending attribute change before more text is written */
+static void line_flush_sgr(pleditor_output *out) {
+    bool first = out->line_first_sgr == -1;
+
+    if (out->line_pending_sgr != out->line_sgr) {
+        char seq[16];
+        int seq_len = sgr_sequence(seq, out->line_sgr, out->line_pending_sgr);
+        line_append(out, seq, seq_len);
+        if (first) out->line_prefix = seq_len;
+        out->line_sgr = out->line_pending_sgr;
+    }
+
+    if (first) out->line_first_sgr = out->line_sgr;
+}
+
+/* Write visible text to the row */
+void pleditor_output_text(pleditor_output *out, const char *s, int len) {
+    if (len <= 0) return;
+    line_flush_sgr(out);
+    line_append(out, s, len);
+    out->line_cols += len;
+    for (int i = 0; i < len && !out->line_multibyte; i++) {
+        if ((unsigned char)s[i] >= 0x80) out->line_multibyte = true;
+    }
+}
+
+/* Write a character repeated count times to the row */
+void pleditor_output_fill(pleditor_output *out, char c, int count) {
+    if (count <= 0) return;
+    line_flush_sgr(out);
+    output_reserve(&out->line, &out->line_cap, out->line_len + count);
+    if (out->line_len + count > out->line_cap) return;
+    memset(out->line + out->line_len, c, count);
+    out->line_len += count;
+    out->line_cols += count;
+    if ((unsigned char)c >= 0x80) out->line_multibyte = true;
+}
+
+/* Finish a row and add it to the frame unless the terminal already shows it */
+void pleditor_output_end_line(pleditor_output *out, int row) {
+    /* Erasing with inverse video active would paint the rest of the row */
+    if (out->line_sgr != PLEDITOR_SGR_RESET && !sgr_is_foreground(out->line_sgr)) {
+        out->line_pending_sgr = PLEDITOR_SGR_RESET;
+        line_flush_sgr(out);
+    }
+    /* A row with multibyte characters may take fewer columns than bytes,
+     * so it is always cleared to the end and its width is not trusted */
+    if (out->line_multibyte || out->line_cols < out->cols) {
+        line_append(out, VT100_CLEAR_LINE, sizeof(VT100_CLEAR_LINE) - 1);
+    }
+
+    if (row < 0 || row >= out->rows) return;
+
+    uint64_t hash = line_hash(out->line, out->line_len);
+    if (out->shown_valid[row] && out->shown[row] == hash) return;
+
+    output_move_cursor(out, row, 0);
+
+    /* The row was drawn assuming default attributes; skip its leading color
+     * change when the terminal already has that color active */
+    const char *bytes = out->line;
+    int len = out->line_len;
+    int first_sgr = out->line_first_sgr;
+    bool compatible = out->sgr == PLEDITOR_SGR_RESET ||
+                      (sgr_is_foreground(out->sgr) &&
+                       (first_sgr == -1 || sgr_is_foreground(first_sgr)));
+    if (first_sgr != -1 && first_sgr == out->sgr) {
+        bytes += out->line_prefix;
+        len -= out->line_prefix;
+    } else if (!compatible) {
+        output_append(out, "\x1b[m", 3);
+        out->sgr = PLEDITOR_SGR_RESET;
+    }
+    output_append(out, bytes, len);
+
+    if (first_sgr != -1) out->sgr = out->line_sgr;
+    /* An unknown column makes the next move start from the left edge */
+    out->cursor_col = (!out->line_multibyte && out->line_cols < out->cols) ? out->line_cols : -1;
+    out->shown[row] = hash;
+    out->shown_valid[row] = true;
+    out->committed++;
+}
+
+/* Finish the frame, leaving the cursor at the given position */
+void pleditor_output_end_frame(pleditor_output *out, int cursor_row, int cursor_col) {
+    if (out->committed == 0) {
+        /* Nothing changed: at most the cursor moves */
+        out->len = 0;
+        if (cursor_row != out->shown_cursor_row || cursor_col != out->shown_cursor_col) {
+            output_move_cursor(out, cursor_row, cursor_col);
+        }
+    } else {
+        output_move_cursor(out, cursor_row, cursor_col);
+        output_append(out, VT100_CURSOR_SHOW, sizeof(VT100_CURSOR_SHOW) - 1);
+        if (out->sync_update) {
+            output_append(out, VT100_SYNC_END, sizeof(VT100_SYNC_END) - 1);
+        }
+    }
+
+    out->shown_cursor_row = cursor_row;
+    out->shown_cursor_col = cursor_col;
+}
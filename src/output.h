@@ -0,0 +1,57 @@
+/**
+ * output.h - Frame output optimizer for pleditor
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* SGR parameter meaning "default attributes" */
+#define PLEDITOR_SGR_RESET 0
+
+/**
+ * A frame is built one screen row at a time. Each row is rendered into a
+ * scratch buffer and compared with what the terminal already shows, so rows
+ * that did not change cost nothing. Cursor motion and color changes are
+ * emitted lazily, picking the shortest escape sequence for each.
+ */
+typedef struct pleditor_output {
+    char *buf;              /* Frame being assembled */
+    int len;                /* Bytes used in buf */
+    int cap;                /* Bytes allocated for buf */
+    char *line;             /* Scratch buffer for the row being drawn */
+    int line_len;           /* Bytes used in line */
+    int line_cap;           /* Bytes allocated for line */
+    int line_prefix;        /* Length of the leading SGR sequence in line */
+    int line_first_sgr;     /* SGR the row starts with */
+    int line_sgr;           /* SGR active at the end of line */
+    int line_pending_sgr;   /* SGR requested for the next text in line */
+    int line_cols;          /* Visible columns written to line */
+    bool line_multibyte;    /* line has UTF-8 bytes, so line_cols overcounts */
+    int rows, cols;         /* Terminal size of the current frame */
+    int cursor_row;         /* Terminal cursor row (0-based), -1 if unknown */
+    int cursor_col;         /* Terminal cursor column (0-based), -1 if unknown */
+    int sgr;                /* SGR active on the terminal */
+    int shown_cursor_row;   /* Cursor position left visible by the last frame */
+    int shown_cursor_col;
+    uint64_t *shown;        /* Hash of each row currently on the terminal */
+    bool *shown_valid;      /* Whether shown[i] describes the terminal */
+    int committed;          /* Rows written in the current frame */
+    bool sync_update;       /* Wrap frames in synchronized-update mode */
+} pleditor_output;
+
+/* Function prototypes */
+void pleditor_output_init(pleditor_output *out, bool sync_update);
+void pleditor_output_free(pleditor_output *out);
+void pleditor_output_invalidate(pleditor_output *out);
+
+void pleditor_output_begin_frame(pleditor_output *out, int rows, int cols);
+void pleditor_output_begin_line(pleditor_output *out);
+void pleditor_output_color(pleditor_output *out, int sgr);
+void pleditor_output_text(pleditor_output *out, const char *s, int len);
+void pleditor_output_fill(pleditor_output *out, char c, int count);
+void pleditor_output_end_line(pleditor_output *out, int row);
+void pleditor_output_end_frame(pleditor_output *out, int cursor_row, int cursor_col);
+
+#endif /* OUTPUT_H */
@@ -18,15 +18,49 @@ bool pleditor_platform_init(void);
 /* Restore terminal settings before exit */
 void pleditor_platform_cleanup(void);
 
+/* Whether the terminal supports synchronized updates, probed at init */
+bool pleditor_platform_has_sync_update(void);
+
 /* Get terminal window size */
 bool pleditor_platform_get_size(int *rows, int *cols);
 
-/* Read a key from the terminal */
-int pleditor_platform_read_key(void);
+/* Wait up to timeout_ms (-1 = forever) for the next key, resize, timer,
+ * finished worker or output drain. PLEDITOR_EVENT_NONE is reported when
+ * the timeout passes. Returns false if the terminal has gone away */
+bool pleditor_platform_wait_event(pleditor_event *event, int timeout_ms);
+
+/* Milliseconds on a clock that only moves forward, for timing work */
+long long pleditor_platform_time_ms(void);
+
+/* Start a timer reported as PLEDITOR_EVENT_TIMER; returns its id or -1 */
+int pleditor_platform_add_timer(int interval_ms, bool repeat);
+void pleditor_platform_remove_timer(int id);
+
+/* Run work on a background thread; its return value is reported as a
+ * PLEDITOR_EVENT_WORKER with the given id */
+bool pleditor_platform_run_worker(int id, void *(*work)(void *arg), void *arg);
+
+/* Report a finished job to the event loop; callable from any thread */
+void pleditor_platform_post_worker_result(int id, void *data);
 
-/* Write string to terminal */
+/* Number of processors available for parallel work */
+int pleditor_platform_cpu_count(void);
+
+/* Call work(index, arg) for every index below count, spread over the
+ * calling thread and a pool of threads kept between calls, and return once
+ * all of them are done. Called from one thread at a time */
+void pleditor_platform_parallel_for(int count, void (*work)(int index, void *arg), void *arg);
+
+/* Set how many milliseconds to wait after ESC for the rest of a sequence */
+void pleditor_platform_set_escape_timeout(int ms);
+
+/* Write string to terminal; output may be queued until the terminal accepts it */
 void pleditor_platform_write(const char *s, size_t len);
 
+/* Whether earlier output is still being sent. A caller that skips a frame
+ * because of this receives PLEDITOR_EVENT_REDRAW once the output drains */
+bool pleditor_platform_output_busy(void);
+
 /* File operations */
 bool pleditor_platform_read_file(const char *filename, char **buffer, size_t *len);
 bool pleditor_platform_write_file(const char *filename, const char *buffer, size_t len);
@@ -2,10 +2,13 @@
  * linux.c - Linux implementation of the platform interface
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <unistd.h>
 #include <termios.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
@@ -13,13 +16,214 @@
 #include <sys/select.h>
 #include <time.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "../platform.h"
 #include "../pleditor.h"
+#include "../terminal.h"
 
 /* Original terminal settings */
 static struct termios orig_termios;
 
+/* Terminal answered the synchronized-update mode query */
+static bool sync_update_supported = false;
+
+/* Output queue, drained without blocking as the terminal accepts bytes */
+static int out_fd = STDOUT_FILENO;
+static char *out_queue = NULL;
+static size_t out_len = 0;      /* Bytes queued */
+static size_t out_sent = 0;     /* Bytes of the queue already written */
+static size_t out_cap = 0;
+static bool frame_deferred = false; /* A frame was skipped while output was busy */
+
+/* Write as much of the output queue as the terminal accepts right now */
+static void output_flush(void) {
+    while (out_sent < out_len) {
+        ssize_t nwritten = write(out_fd, out_queue + out_sent, out_len - out_sent);
+        if (nwritten > 0) {
+            out_sent += nwritten;
+        } else if (nwritten == -1 && errno == EINTR) {
+            continue;
+        } else if (nwritten == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            /* The terminal is gone; drop what cannot be delivered */
+            break;
+        }
+    }
+    out_len = out_sent = 0;
+}
+
+/* Self-pipe written by the SIGWINCH handler and by finished workers */
+static int wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t resize_pending = 0;
+static struct sigaction orig_sigwinch;
+
+/* Background work results waiting to be delivered, oldest first */
+typedef struct worker_result {
+    int id;
+    void *data;
+    struct worker_result *next;
+} worker_result;
+
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static worker_result *worker_done = NULL;
+static worker_result **worker_done_tail = &worker_done;
+
+/* Work handed to a background thread */
+typedef struct worker_job {
+    int id;
+    void *(*work)(void *arg);
+    void *arg;
+} worker_job;
+
+/* Timers, checked whenever the event loop wakes up */
+#define MAX_TIMERS 32
+typedef struct platform_timer {
+    int id;
+    int interval_ms;
+    long long deadline;     /* Monotonic time of the next expiry */
+    bool repeat;
+} platform_timer;
+
+static platform_timer timers[MAX_TIMERS];
+static int num_timers = 0;
+static int next_timer_id = 1;
+
+/* Monotonic clock in milliseconds */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Wake up the event loop; safe from signal handlers and other threads */
+static void wake_event_loop(void) {
+    char c = 0;
+    ssize_t nwritten = write(wake_pipe[1], &c, 1);
+    (void)nwritten; /* A full pipe already guarantees a wakeup */
+}
+
+/* SIGWINCH handler: only records the resize, the event loop does the rest */
+static void handle_sigwinch(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    resize_pending = 1;
+    wake_event_loop();
+    errno = saved_errno;
+}
+
+/* Block until the output queue is empty */
+static void output_drain(void) {
+    output_flush();
+    while (out_len > out_sent) {
+        struct pollfd pfd = { out_fd, POLLOUT, 0 };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) break;
+        output_flush();
+    }
+    out_len = out_sent = 0;
+}
+
+/* Input ring buffer, filled with bulk reads and decoded one key at a time */
+#define INPUT_BUFFER_SIZE 4096
+static unsigned char in_buf[INPUT_BUFFER_SIZE];
+static size_t in_head = 0;      /* Total bytes consumed */
+static size_t in_tail = 0;      /* Total bytes stored */
+
+/* Queue bytes read outside the input decoder, dropping what does not fit */
+static void input_push(const char *data, size_t len) {
+    for (size_t i = 0; i < len && in_tail - in_head < INPUT_BUFFER_SIZE; i++) {
+        in_buf[in_tail++ % INPUT_BUFFER_SIZE] = (unsigned char)data[i];
+    }
+}
+
+/* Time allowed for the whole synchronized update probe */
+#define SYNC_PROBE_TIMEOUT_MS 500
+
+/* Length of the terminal reply starting at reply[0] ("ESC [ ? ... final"),
+ * 0 if it is not one, or -1 if it is still incomplete */
+static int probe_reply_length(const char *reply, size_t len) {
+    if (len < 3) return (memcmp(reply, "\x1b[?", len) == 0) ? -1 : 0;
+    if (memcmp(reply, "\x1b[?", 3) != 0) return 0;
+    for (size_t i = 3; i < len; i++) {
+        char c = reply[i];
+        if ((c >= '0' && c <= '9') || c == ';' || c == '$') continue;
+        return (c == 'c' || c == 'y') ? (int)i + 1 : 0;
+    }
+    return -1;
+}
+
+/* Ask the terminal whether it supports synchronized updates (mode 2026).
+ * Keys typed while waiting for the answer are kept as input. */
+static bool probe_sync_update(void) {
+    /* The device attributes request is answered by every terminal, so its
+     * reply marks the end of the exchange even when DECRQM is ignored */
+    const char query[] = VT100_SYNC_QUERY VT100_DEVICE_ATTRIBUTES;
+    if (write(STDOUT_FILENO, query, sizeof(query) - 1) != (ssize_t)(sizeof(query) - 1)) {
+        return false;
+    }
+
+    bool supported = false;
+    bool answered = false;
+    char reply[128];
+    size_t len = 0;
+
+    /* Linux's select() leaves the time not slept in tv, so the timeout
+     * covers the whole exchange rather than each read */
+    struct timeval tv = { 0, SYNC_PROBE_TIMEOUT_MS * 1000 };
+    while (!answered) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0) break;
+
+        ssize_t nread = read(STDIN_FILENO, reply + len, sizeof(reply) - len);
+        if (nread <= 0) break;
+        len += nread;
+
+        /* Take replies out of the stream; everything else is typed input */
+        size_t pos = 0;
+        while (pos < len) {
+            char *esc = memchr(reply + pos, '\x1b', len - pos);
+            size_t skip = esc ? (size_t)(esc - (reply + pos)) : len - pos;
+            input_push(reply + pos, skip);
+            pos += skip;
+            if (pos == len) break;
+
+            int n = probe_reply_length(reply + pos, len - pos);
+            if (n < 0) break;   /* Wait for the rest of it */
+            if (n == 0) {
+                input_push(reply + pos, 1);
+                pos++;
+                continue;
+            }
+
+            /* Mode report: ESC [ ? 2026 ; Ps $ y, where Ps 1-3 means recognized */
+            if (reply[pos + n - 1] == 'y') {
+                if (n == 11 && memcmp(reply + pos, "\x1b[?2026;", 8) == 0) {
+                    char ps = reply[pos + 8];
+                    supported = ps >= '1' && ps <= '3' && reply[pos + 9] == '$';
+                }
+            } else {
+                answered = true;    /* Device attributes: ESC [ ? ... c */
+            }
+            pos += n;
+        }
+        memmove(reply, reply + pos, len - pos);
+        len -= pos;
+
+        /* An incomplete reply that fills the buffer is not one */
+        if (len == sizeof(reply)) {
+            input_push(reply, len);
+            len = 0;
+        }
+    }
+    input_push(reply, len);
+    return supported;
+}
+
 /* Initialize the terminal for raw mode */
 bool pleditor_platform_init(void) {
     if (tcgetattr(STDIN_FILENO, &orig_termios) == -1) {
@@ -45,19 +249,70 @@ bool pleditor_platform_init(void) {
      * disable extended functions, disable signal chars */
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 
-    /* Control chars: set return condition to return as soon as any input is available */
+    /* Control chars: reads return whatever is available; waiting is done
+     * with poll so escape sequences are not held up by VTIME */
     raw.c_cc[VMIN] = 0;  /* No minimum num of bytes required */
-    raw.c_cc[VTIME] = 1; /* 100ms timeout between bytes */
+    raw.c_cc[VTIME] = 0; /* No timeout between bytes */
 
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
         return false;
     }
 
+    sync_update_supported = probe_sync_update();
+
+    /* Open a separate non-blocking handle on the terminal for output, so a
+     * slow link never stalls the editor and stdin keeps its own flags */
+    char *tty = ttyname(STDOUT_FILENO);
+    int fd = tty ? open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK) : -1;
+    out_fd = (fd != -1) ? fd : STDOUT_FILENO;
+
+    /* Self-pipe for signals and background work, both ends non-blocking */
+    if (pipe(wake_pipe) == -1) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigwinch;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &sa, &orig_sigwinch);
+
     return true;
 }
 
+/* Whether frames can be wrapped in synchronized-update mode */
+bool pleditor_platform_has_sync_update(void) {
+    return sync_update_supported;
+}
+
+static void pool_shutdown(void);
+
 /* Restore terminal settings */
 void pleditor_platform_cleanup(void) {
+    pool_shutdown();
+
+    /* Deliver whatever is still queued */
+    output_drain();
+    if (out_fd != STDOUT_FILENO) {
+        close(out_fd);
+        out_fd = STDOUT_FILENO;
+    }
+    free(out_queue);
+    out_queue = NULL;
+    out_cap = 0;
+
+    /* Stop listening for resizes */
+    sigaction(SIGWINCH, &orig_sigwinch, NULL);
+    for (int i = 0; i < 2; i++) {
+        if (wake_pipe[i] != -1) close(wake_pipe[i]);
+        wake_pipe[i] = -1;
+    }
+
     /* Return to normal screen buffer */
     write(STDOUT_FILENO, "\033[?1049l", 8);
 
@@ -78,75 +333,567 @@ bool pleditor_platform_get_size(int *rows, int *cols) {
     }
 }
 
-/* Read a key from the terminal */
-int pleditor_platform_read_key(void) {
-    int nread;
-    char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) {
-            return PLEDITOR_KEY_ERR;
+/* How long to wait for the rest of an escape sequence after ESC */
+static int escape_timeout = PLEDITOR_ESCAPE_TIMEOUT_MS;
+static long long escape_deadline = -1;  /* When a partial sequence is given up */
+
+/* Longest escape sequence the decoder looks at */
+#define INPUT_SEQUENCE_MAX 32
+
+/* Decoded a sequence that maps to no key */
+#define INPUT_KEY_IGNORED (-2)
+
+/* Number of bytes waiting in the input buffer */
+static size_t input_count(void) {
+    return in_tail - in_head;
+}
+
+/* Map an xterm modifier parameter (1 + bitmask) to editor modifier bits */
+static int decode_modifier(int param) {
+    int mods = 0;
+    if (param < 2) return 0;
+    param--;
+    if (param & 1) mods |= PLEDITOR_MOD_SHIFT;
+    if (param & 2) mods |= PLEDITOR_MOD_ALT;
+    if (param & 4) mods |= PLEDITOR_MOD_CTRL;
+    return mods;
+}
+
+/* Keys selected by the final byte of CSI and SS3 sequences */
+static int decode_final(char final) {
+    switch (final) {
+        case 'A': return PLEDITOR_ARROW_UP;
+        case 'B': return PLEDITOR_ARROW_DOWN;
+        case 'C': return PLEDITOR_ARROW_RIGHT;
+        case 'D': return PLEDITOR_ARROW_LEFT;
+        case 'H': return PLEDITOR_HOME_KEY;
+        case 'F': return PLEDITOR_END_KEY;
+        case 'P': return PLEDITOR_F1;
+        case 'Q': return PLEDITOR_F2;
+        case 'R': return PLEDITOR_F3;
+        case 'S': return PLEDITOR_F4;
+    }
+    return INPUT_KEY_IGNORED;
+}
+
+/* Keys selected by the number of "CSI number ~" sequences */
+static int decode_tilde(int number) {
+    switch (number) {
+        case 1: case 7: return PLEDITOR_HOME_KEY;
+        case 3: return PLEDITOR_DEL_KEY;
+        case 4: case 8: return PLEDITOR_END_KEY;
+        case 5: return PLEDITOR_PAGE_UP;
+        case 6: return PLEDITOR_PAGE_DOWN;
+        case 11: return PLEDITOR_F1;
+        case 12: return PLEDITOR_F2;
+        case 13: return PLEDITOR_F3;
+        case 14: return PLEDITOR_F4;
+        case 15: return PLEDITOR_F5;
+        case 17: return PLEDITOR_F6;
+        case 18: return PLEDITOR_F7;
+        case 19: return PLEDITOR_F8;
+        case 20: return PLEDITOR_F9;
+        case 21: return PLEDITOR_F10;
+        case 23: return PLEDITOR_F11;
+        case 24: return PLEDITOR_F12;
+    }
+    return INPUT_KEY_IGNORED;
+}
+
+/* Decode a CSI sequence (seq[0] == '[') of len bytes. Returns the bytes
+ * used, or 0 when the sequence is not complete yet */
+static int decode_csi(const unsigned char *seq, int len, int *key) {
+    int i = 1;
+
+    /* Linux console function keys: ESC [ [ A .. ESC [ [ E */
+    if (i < len && seq[i] == '[') {
+        if (i + 1 >= len) return 0;
+        *key = (seq[i + 1] >= 'A' && seq[i + 1] <= 'E') ?
+               PLEDITOR_F1 + (seq[i + 1] - 'A') : INPUT_KEY_IGNORED;
+        return i + 2;
+    }
+
+    /* Parameters and intermediates, then a final byte in 0x40-0x7e */
+    int params[4] = { 0, 0, 0, 0 };
+    int nparams = 0;
+    bool private_marker = false;
+    for (; i < len; i++) {
+        unsigned char c = seq[i];
+        if (c >= '0' && c <= '9') {
+            if (nparams == 0) nparams = 1;
+            if (nparams <= 4) params[nparams - 1] = params[nparams - 1] * 10 + (c - '0');
+        } else if (c == ';') {
+            if (nparams == 0) nparams = 1;
+            nparams++;
+        } else if (c >= 0x3c && c <= 0x3f) {
+            private_marker = true;
+        } else if (c >= 0x20 && c <= 0x2f) {
+            /* Intermediate byte */
+        } else if (c >= 0x40 && c <= 0x7e) {
+            break;
+        } else {
+            /* Not a valid sequence: drop what was seen so far */
+            *key = INPUT_KEY_IGNORED;
+            return i;
         }
     }
+    if (i >= len) return 0;
+
+    char final = seq[i];
+    int used = i + 1;
+    if (private_marker) {
+        /* Replies and reports (mouse, focus, device status) are not keys */
+        *key = INPUT_KEY_IGNORED;
+        return used;
+    }
+
+    if (final == '~') {
+        *key = decode_tilde(params[0]);
+        if (*key != INPUT_KEY_IGNORED) *key |= decode_modifier(params[1]);
+    } else {
+        *key = decode_final(final);
+        if (*key != INPUT_KEY_IGNORED) *key |= decode_modifier(params[1]);
+    }
+    return used;
+}
+
+/* Decode one key from the front of the input buffer. Returns the bytes
+ * used, or 0 when more input is needed. With force set, an incomplete
+ * escape sequence is given up on and decoded as a bare ESC */
+static int input_decode(int *key, bool force) {
+    size_t count = input_count();
+    if (count == 0) return 0;
+
+    unsigned char seq[INPUT_SEQUENCE_MAX];
+    int len = (count < INPUT_SEQUENCE_MAX) ? (int)count : INPUT_SEQUENCE_MAX;
+    for (int i = 0; i < len; i++) {
+        seq[i] = in_buf[(in_head + i) % INPUT_BUFFER_SIZE];
+    }
 
     /* For non-escape characters, return immediately */
-    if (c != PLEDITOR_KEY_ESC) {
-        return c;
-    }
-    
-    /* Handle escape sequences */
-    char seq[3];
-
-    /* Early returns for incomplete sequences */
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) return PLEDITOR_KEY_ESC;
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) return PLEDITOR_KEY_ESC;
-
-    /* Handle '[' sequence type (e.g., cursor keys) */
-    if (seq[0] == '[') {
-        /* Handle numeric escape codes (like ESC[1~) */
-        if (seq[1] >= '0' && seq[1] <= '9') {
-            if (read(STDIN_FILENO, &seq[2], 1) != 1) return PLEDITOR_KEY_ESC;
-            if (seq[2] == '~') {
-                switch (seq[1]) {
-                    case '1': return PLEDITOR_HOME_KEY;
-                    case '3': return PLEDITOR_DEL_KEY;
-                    case '4': return PLEDITOR_END_KEY;
-                    case '5': return PLEDITOR_PAGE_UP;
-                    case '6': return PLEDITOR_PAGE_DOWN;
-                    case '7': return PLEDITOR_HOME_KEY;
-                    case '8': return PLEDITOR_END_KEY;
-                }
+    if (seq[0] != PLEDITOR_KEY_ESC) {
+        *key = seq[0];
+        return 1;
+    }
+
+    int used = 0;
+    if (len >= 2) {
+        if (seq[1] == '[') {
+            used = decode_csi(seq + 1, len - 1, key);
+            if (used) used++;
+        } else if (seq[1] == 'O') {
+            /* SS3: ESC O [modifier] final */
+            int i = 2;
+            int modifier = 0;
+            while (i < len && seq[i] >= '0' && seq[i] <= '9') {
+                modifier = modifier * 10 + (seq[i] - '0');
+                i++;
+            }
+            if (i < len) {
+                *key = decode_final(seq[i]);
+                if (*key != INPUT_KEY_IGNORED) *key |= decode_modifier(modifier);
+                used = i + 1;
             }
-            return PLEDITOR_KEY_ESC;
+        } else if (seq[1] != PLEDITOR_KEY_ESC) {
+            /* ESC followed by a character is how terminals send Alt */
+            *key = PLEDITOR_MOD_ALT | seq[1];
+            used = 2;
+        } else {
+            *key = PLEDITOR_KEY_ESC;
+            used = 1;
         }
-        
-        /* Handle arrow keys and others (like ESC[A) */
-        switch (seq[1]) {
-            case 'A': return PLEDITOR_ARROW_UP;
-            case 'B': return PLEDITOR_ARROW_DOWN;
-            case 'C': return PLEDITOR_ARROW_RIGHT;
-            case 'D': return PLEDITOR_ARROW_LEFT;
-            case 'H': return PLEDITOR_HOME_KEY;
-            case 'F': return PLEDITOR_END_KEY;
+    }
+
+    /* A sequence longer than anything we decode is garbage */
+    if (!used && len == INPUT_SEQUENCE_MAX) {
+        *key = INPUT_KEY_IGNORED;
+        return len;
+    }
+
+    if (!used && force) {
+        /* Nothing followed in time: a bare ESC, or a truncated sequence */
+        *key = PLEDITOR_KEY_ESC;
+        return len;
+    }
+
+    return used;
+}
+
+/* Read everything available on stdin into the ring buffer. Returns false
+ * on a read error; with VMIN 0 an empty read only means no input, so a
+ * hangup is left to the POLLHUP check in the event loop */
+static bool input_read(void) {
+    while (input_count() < INPUT_BUFFER_SIZE) {
+        size_t free_space = INPUT_BUFFER_SIZE - input_count();
+        size_t offset = in_tail % INPUT_BUFFER_SIZE;
+        size_t contiguous = INPUT_BUFFER_SIZE - offset;
+        if (contiguous > free_space) contiguous = free_space;
+
+        ssize_t nread = read(STDIN_FILENO, in_buf + offset, contiguous);
+        if (nread > 0) {
+            in_tail += nread;
+            if ((size_t)nread < contiguous) break;
+        } else if (nread == 0) {
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
         }
-        return PLEDITOR_KEY_ESC;
     }
-    
-    /* Handle 'O' sequence type */
-    if (seq[0] == 'O') {
-        switch (seq[1]) {
-            case 'H': return PLEDITOR_HOME_KEY;
-            case 'F': return PLEDITOR_END_KEY;
+    return true;
+}
+
+/* Take the next complete key from the input buffer, if any */
+static bool input_next_key(int *key) {
+    while (input_count() > 0) {
+        int used = input_decode(key, false);
+
+        if (!used) {
+            /* Partial sequence: give up on it once the escape timeout passes */
+            if (escape_deadline < 0) {
+                escape_deadline = now_ms() + escape_timeout;
+                return false;
+            }
+            if (now_ms() < escape_deadline) return false;
+            used = input_decode(key, true);
         }
+
+        escape_deadline = -1;
+        in_head += used;
+        if (*key != INPUT_KEY_IGNORED) return true;
+    }
+    return false;
+}
+
+/* Take the oldest finished background job, if any */
+static bool next_worker_result(int *id, void **data) {
+    pthread_mutex_lock(&worker_lock);
+    worker_result *result = worker_done;
+    if (result) {
+        worker_done = result->next;
+        if (!worker_done) worker_done_tail = &worker_done;
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    if (!result) return false;
+    *id = result->id;
+    *data = result->data;
+    free(result);
+    return true;
+}
+
+/* Take the first expired timer, rescheduling it if it repeats */
+static bool next_expired_timer(long long now, int *id) {
+    for (int i = 0; i < num_timers; i++) {
+        if (timers[i].deadline > now) continue;
+
+        *id = timers[i].id;
+        if (timers[i].repeat) {
+            timers[i].deadline = now + timers[i].interval_ms;
+        } else {
+            timers[i] = timers[--num_timers];
+        }
+        return true;
+    }
+    return false;
+}
+
+/* Wait for the next event */
+bool pleditor_platform_wait_event(pleditor_event *event, int timeout_ms) {
+    long long deadline = (timeout_ms < 0) ? -1 : now_ms() + timeout_ms;
+    bool input_checked = false;
+
+    event->key = 0;
+    event->id = 0;
+    event->data = NULL;
+
+    while (1) {
+        /* Terminal resized */
+        if (resize_pending) {
+            resize_pending = 0;
+            event->type = PLEDITOR_EVENT_RESIZE;
+            return true;
+        }
+
+        /* Keys come before background events so typing stays responsive */
+        if (input_next_key(&event->key)) {
+            event->type = PLEDITOR_EVENT_KEY;
+            return true;
+        }
+
+        if (next_worker_result(&event->id, &event->data)) {
+            event->type = PLEDITOR_EVENT_WORKER;
+            return true;
+        }
+
+        /* Work that keeps a timer due must not hold up typing: read what
+         * has arrived before reporting one */
+        if (!input_checked) {
+            input_checked = true;
+            if (!input_read()) return false;
+            if (input_count() > 0) continue;
+        }
+
+        long long now = now_ms();
+        if (next_expired_timer(now, &event->id)) {
+            event->type = PLEDITOR_EVENT_TIMER;
+            return true;
+        }
+
+        /* Output caught up: let the editor draw its freshest frame */
+        if (frame_deferred && out_len == 0) {
+            frame_deferred = false;
+            event->type = PLEDITOR_EVENT_REDRAW;
+            return true;
+        }
+
+        /* Sleep until input, a wakeup, the next timer or the caller's timeout */
+        long long wake_at = deadline;
+        if (escape_deadline >= 0 && (wake_at < 0 || escape_deadline < wake_at)) {
+            wake_at = escape_deadline;
+        }
+        for (int i = 0; i < num_timers; i++) {
+            if (wake_at < 0 || timers[i].deadline < wake_at) wake_at = timers[i].deadline;
+        }
+
+        int wait_ms = -1;
+        if (wake_at >= 0) {
+            wait_ms = (wake_at > now) ? (int)(wake_at - now) : 0;
+        }
+        if (deadline >= 0 && now >= deadline) {
+            event->type = PLEDITOR_EVENT_NONE;
+            return true;
+        }
+
+        struct pollfd fds[3] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { wake_pipe[0], POLLIN, 0 },
+            { out_fd, POLLOUT, 0 }
+        };
+        int nfds = (out_len > out_sent) ? 3 : 2;
+        if (poll(fds, nfds, wait_ms) == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        /* A hangup comes with POLLIN; keys read before it are handled first */
+        if ((fds[0].revents & POLLIN) && !input_read()) return false;
+        if ((fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) && input_count() == 0) {
+            return false;
+        }
+
+        if (fds[1].revents) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0);
+        }
+
+        if (nfds == 3 && fds[2].revents) {
+            output_flush();
+        }
+    }
+}
+
+/* Milliseconds on the monotonic clock */
+long long pleditor_platform_time_ms(void) {
+    return now_ms();
+}
+
+/* Start a timer; returns its id or -1 */
+int pleditor_platform_add_timer(int interval_ms, bool repeat) {
+    if (num_timers == MAX_TIMERS) return -1;
+    if (interval_ms < 0) interval_ms = 0;
+
+    platform_timer *timer = &timers[num_timers++];
+    timer->id = next_timer_id++;
+    timer->interval_ms = interval_ms;
+    timer->deadline = now_ms() + interval_ms;
+    timer->repeat = repeat;
+    return timer->id;
+}
+
+/* Stop a timer */
+void pleditor_platform_remove_timer(int id) {
+    for (int i = 0; i < num_timers; i++) {
+        if (timers[i].id == id) {
+            timers[i] = timers[--num_timers];
+            return;
+        }
+    }
+}
+
+/* Hand a finished job's result to the event loop; callable from any thread */
+void pleditor_platform_post_worker_result(int id, void *data) {
+    worker_result *result = malloc(sizeof(worker_result));
+    if (!result) return;
+    result->id = id;
+    result->data = data;
+    result->next = NULL;
+
+    pthread_mutex_lock(&worker_lock);
+    *worker_done_tail = result;
+    worker_done_tail = &result->next;
+    pthread_mutex_unlock(&worker_lock);
+
+    wake_event_loop();
+}
+
+/* Thread entry point for background work */
+static void *worker_main(void *arg) {
+    worker_job *job = arg;
+    void *result = job->work(job->arg);
+    pleditor_platform_post_worker_result(job->id, result);
+    free(job);
+    return NULL;
+}
+
+/* Run work on a background thread */
+bool pleditor_platform_run_worker(int id, void *(*work)(void *arg), void *arg) {
+    worker_job *job = malloc(sizeof(worker_job));
+    if (!job) return false;
+    job->id = id;
+    job->work = work;
+    job->arg = arg;
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, worker_main, job);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0) {
+        free(job);
+        return false;
     }
+    return true;
+}
 
-    return PLEDITOR_KEY_ESC;
+/* Number of online processors */
+int pleditor_platform_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
 
-    return c;
+/* Threads that run the indices of parallel loops. They are started the
+ * first time a loop needs them and then wait for the next one, so a loop
+ * costs a wakeup rather than a thread start */
+#define POOL_MAX_THREADS 64
+static pthread_t pool_threads[POOL_MAX_THREADS];
+static int pool_size = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;   /* Indices to run, or stop */
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;   /* The loop's last index is done */
+static void (*pool_work)(int index, void *arg);
+static void *pool_arg;
+static int pool_count = 0;      /* Indices of the current loop */
+static int pool_next = 0;       /* Next index to hand out */
+static int pool_pending = 0;    /* Indices not finished yet */
+static bool pool_stop = false;
+
+/* Run indices of the current loop until none are left to hand out. Called
+ * with pool_lock held */
+static void pool_run(void) {
+    while (pool_next < pool_count) {
+        int index = pool_next++;
+        void (*work)(int index, void *arg) = pool_work;
+        void *arg = pool_arg;
+        pthread_mutex_unlock(&pool_lock);
+        work(index, arg);
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_pending == 0) pthread_cond_signal(&pool_idle);
+    }
+}
+
+static void *pool_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool_lock);
+    while (!pool_stop) {
+        pool_run();
+        if (!pool_stop) pthread_cond_wait(&pool_wake, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
 }
 
-/* Write to the terminal */
+/* Stop the pool's threads */
+static void pool_shutdown(void) {
+    pthread_mutex_lock(&pool_lock);
+    pool_stop = true;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < pool_size; i++) {
+        pthread_join(pool_threads[i], NULL);
+    }
+    pool_size = 0;
+    pool_stop = false;
+}
+
+/* Run work for every index, spread over the calling thread and the pool,
+ * and wait for all of them. Called from one thread at a time */
+void pleditor_platform_parallel_for(int count, void (*work)(int index, void *arg), void *arg) {
+    if (count <= 0) return;
+    if (count == 1) {
+        work(0, arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+
+    /* The calling thread takes indices too; if threads can't be started,
+     * it runs the ones they would have */
+    while (pool_size < count - 1 && pool_size < POOL_MAX_THREADS &&
+           pthread_create(&pool_threads[pool_size], NULL, pool_main, NULL) == 0) {
+        pool_size++;
+    }
+
+    pool_work = work;
+    pool_arg = arg;
+    pool_count = count;
+    pool_next = 0;
+    pool_pending = count;
+    pthread_cond_broadcast(&pool_wake);
+
+    pool_run();
+    while (pool_pending > 0) {
+        pthread_cond_wait(&pool_idle, &pool_lock);
+    }
+    pool_count = 0;
+    pool_next = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* Set how long to wait after ESC before treating it as a bare key */
+void pleditor_platform_set_escape_timeout(int ms) {
+    escape_timeout = (ms < 0) ? 0 : ms;
+}
+
+/* Queue output for the terminal and send what it accepts right away */
 void pleditor_platform_write(const char *s, size_t len) {
-    write(STDOUT_FILENO, s, len);
+    if (out_len + len > out_cap) {
+        size_t newcap = out_cap ? out_cap : 4096;
+        while (newcap < out_len + len) newcap *= 2;
+        char *newqueue = realloc(out_queue, newcap);
+        if (!newqueue) return;
+        out_queue = newqueue;
+        out_cap = newcap;
+    }
+
+    memcpy(out_queue + out_len, s, len);
+    out_len += len;
+    output_flush();
+}
+
+/* Whether an earlier frame is still on its way to the terminal */
+bool pleditor_platform_output_busy(void) {
+    output_flush();
+    if (out_len > out_sent) {
+        /* The caller skips its frame; ask for a redraw once output drains */
+        frame_deferred = true;
+        return true;
+    }
+    return false;
 }
 
 /* Read the contents of a file */
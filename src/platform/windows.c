@@ -4,7 +4,9 @@
 
 #include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include <io.h>
 #include <fcntl.h>
 #include "../platform.h"
@@ -14,6 +16,37 @@ static HANDLE hStdout;
 static DWORD fdwOrigInputMode;
 static DWORD fdwOrigOutputMode;
 
+// Background work results, announced through an auto-reset event
+typedef struct worker_result {
+    int id;
+    void *data;
+    struct worker_result *next;
+} worker_result;
+
+typedef struct worker_job {
+    int id;
+    void *(*work)(void *arg);
+    void *arg;
+} worker_job;
+
+static HANDLE hWorkerEvent;
+static CRITICAL_SECTION workerLock;
+static worker_result *workerDone = NULL;
+static worker_result **workerDoneTail = &workerDone;
+
+// Timers, checked whenever the event loop wakes up
+#define MAX_TIMERS 32
+typedef struct platform_timer {
+    int id;
+    int interval_ms;
+    ULONGLONG deadline;
+    bool repeat;
+} platform_timer;
+
+static platform_timer timers[MAX_TIMERS];
+static int numTimers = 0;
+static int nextTimerId = 1;
+
 bool pleditor_platform_init(void) {
     hStdin = GetStdHandle(STD_INPUT_HANDLE);
     hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -24,9 +57,10 @@ bool pleditor_platform_init(void) {
     if (!GetConsoleMode(hStdout, &fdwOrigOutputMode)) 
         return false;
 
-    // Configure input mode
+    // Configure input mode (window size changes are reported as input events)
     DWORD inputMode = fdwOrigInputMode;
     inputMode &= ~(ENABLE_ECHO_INPUT | ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+    inputMode |= ENABLE_WINDOW_INPUT;
     
     // Configure output mode (preserve original flags, add VT support)
     DWORD outputMode = fdwOrigOutputMode;
@@ -54,14 +88,34 @@ bool pleditor_platform_init(void) {
     // Set binary I/O mode
     _setmode(_fileno(stdin), _O_BINARY);
     _setmode(_fileno(stdout), _O_BINARY);
+
+    // Event loop wakeup for finished background work
+    hWorkerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!hWorkerEvent)
+        return false;
+    InitializeCriticalSection(&workerLock);
     
     return true;
 }
 
+bool pleditor_platform_has_sync_update(void) {
+    // Console hosts are not probed; frames are written unsynchronized
+    return false;
+}
+
+static void pool_shutdown(void);
+
 void pleditor_platform_cleanup(void) {
+    pool_shutdown();
+
     // Restore original console modes
     SetConsoleMode(hStdin, fdwOrigInputMode);
     SetConsoleMode(hStdout, fdwOrigOutputMode);
+
+    if (hWorkerEvent) {
+        CloseHandle(hWorkerEvent);
+        hWorkerEvent = NULL;
+    }
 }
 
 bool pleditor_platform_get_size(int *rows, int *cols) {
@@ -75,50 +129,304 @@ bool pleditor_platform_get_size(int *rows, int *cols) {
     return true;
 }
 
-int pleditor_platform_read_key(void) {
-    INPUT_RECORD ir[128];
-    DWORD count;
-    
+// Translate a key press into an editor key code, or PLEDITOR_KEY_ERR if it has none
+static int translate_key(const KEY_EVENT_RECORD *key) {
+    WORD vk = key->wVirtualKeyCode;
+    CHAR ch = key->uChar.AsciiChar;
+    DWORD state = key->dwControlKeyState;
+
+    // Modifiers applied to special keys
+    int mods = 0;
+    if (state & SHIFT_PRESSED) mods |= PLEDITOR_MOD_SHIFT;
+    if (state & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) mods |= PLEDITOR_MOD_ALT;
+    if (state & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) mods |= PLEDITOR_MOD_CTRL;
+
+    // Process special keys
+    switch (vk) {
+        case VK_UP:     return PLEDITOR_ARROW_UP | mods;
+        case VK_DOWN:   return PLEDITOR_ARROW_DOWN | mods;
+        case VK_LEFT:   return PLEDITOR_ARROW_LEFT | mods;
+        case VK_RIGHT:  return PLEDITOR_ARROW_RIGHT | mods;
+        case VK_HOME:   return PLEDITOR_HOME_KEY | mods;
+        case VK_END:    return PLEDITOR_END_KEY | mods;
+        case VK_PRIOR:  return PLEDITOR_PAGE_UP | mods;
+        case VK_NEXT:   return PLEDITOR_PAGE_DOWN | mods;
+        case VK_DELETE: return PLEDITOR_DEL_KEY | mods;
+        case VK_ESCAPE: return PLEDITOR_KEY_ESC;
+    }
+
+    // Function keys
+    if (vk >= VK_F1 && vk <= VK_F12)
+        return (PLEDITOR_F1 + (vk - VK_F1)) | mods;
+
+    // Process printable characters; Alt without Ctrl (AltGr reports both)
+    // makes an editor command such as the search option toggles
+    if ((unsigned char)ch > 0 && (unsigned char)ch != 0xE0) {
+        if ((mods & PLEDITOR_MOD_ALT) && !(mods & PLEDITOR_MOD_CTRL))
+            return PLEDITOR_MOD_ALT | tolower((unsigned char)ch);
+        return (unsigned char)ch;
+    }
+
+    return PLEDITOR_KEY_ERR;
+}
+
+// Take the oldest finished background job, if any
+static bool next_worker_result(int *id, void **data) {
+    EnterCriticalSection(&workerLock);
+    worker_result *result = workerDone;
+    if (result) {
+        workerDone = result->next;
+        if (!workerDone) workerDoneTail = &workerDone;
+    }
+    LeaveCriticalSection(&workerLock);
+
+    if (!result) return false;
+    *id = result->id;
+    *data = result->data;
+    free(result);
+    return true;
+}
+
+bool pleditor_platform_wait_event(pleditor_event *event, int timeout_ms) {
+    ULONGLONG deadline = GetTickCount64() + (timeout_ms < 0 ? 0 : timeout_ms);
+
+    event->key = 0;
+    event->id = 0;
+    event->data = NULL;
+
     while (1) {
-        // Read console input events
-        if (!ReadConsoleInput(hStdin, ir, 128, &count)) 
-            return PLEDITOR_KEY_ERR;
-        
-        for (DWORD i = 0; i < count; i++) {
-            // Filter key press events only
-            if (ir[i].EventType != KEY_EVENT || !ir[i].Event.KeyEvent.bKeyDown) 
-                continue;
-            
-            WORD vk = ir[i].Event.KeyEvent.wVirtualKeyCode;
-            CHAR ch = ir[i].Event.KeyEvent.uChar.AsciiChar;
-            
-            // Process special keys
-            switch (vk) {
-                case VK_UP:     return PLEDITOR_ARROW_UP;
-                case VK_DOWN:   return PLEDITOR_ARROW_DOWN;
-                case VK_LEFT:   return PLEDITOR_ARROW_LEFT;
-                case VK_RIGHT:  return PLEDITOR_ARROW_RIGHT;
-                case VK_HOME:   return PLEDITOR_HOME_KEY;
-                case VK_END:    return PLEDITOR_END_KEY;
-                case VK_PRIOR:  return PLEDITOR_PAGE_UP;
-                case VK_NEXT:   return PLEDITOR_PAGE_DOWN;
-                case VK_DELETE: return PLEDITOR_DEL_KEY;
-                case VK_ESCAPE: return PLEDITOR_KEY_ESC;
+        // Console input: key presses and window size changes, one record at a time
+        DWORD pending = 0;
+        if (GetNumberOfConsoleInputEvents(hStdin, &pending) && pending > 0) {
+            INPUT_RECORD ir;
+            DWORD count;
+            if (!ReadConsoleInput(hStdin, &ir, 1, &count))
+                return false;
+            if (count == 1 && ir.EventType == WINDOW_BUFFER_SIZE_EVENT) {
+                event->type = PLEDITOR_EVENT_RESIZE;
+                return true;
+            }
+            if (count == 1 && ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown) {
+                int key = translate_key(&ir.Event.KeyEvent);
+                if (key != PLEDITOR_KEY_ERR) {
+                    event->type = PLEDITOR_EVENT_KEY;
+                    event->key = key;
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        if (next_worker_result(&event->id, &event->data)) {
+            event->type = PLEDITOR_EVENT_WORKER;
+            return true;
+        }
+
+        // Expired timers
+        ULONGLONG now = GetTickCount64();
+        for (int i = 0; i < numTimers; i++) {
+            if (timers[i].deadline > now) continue;
+            event->type = PLEDITOR_EVENT_TIMER;
+            event->id = timers[i].id;
+            if (timers[i].repeat) {
+                timers[i].deadline = now + timers[i].interval_ms;
+            } else {
+                timers[i] = timers[--numTimers];
             }
-            
-            // Process printable characters
-            if ((unsigned char)ch > 0 && (unsigned char)ch != 0xE0) 
-                return ch;
+            return true;
+        }
+
+        // Sleep until input, finished work, the next timer or the caller's timeout
+        if (timeout_ms >= 0 && now >= deadline) {
+            event->type = PLEDITOR_EVENT_NONE;
+            return true;
+        }
+        ULONGLONG wakeAt = (timeout_ms >= 0) ? deadline : 0;
+        for (int i = 0; i < numTimers; i++) {
+            if (wakeAt == 0 || timers[i].deadline < wakeAt) wakeAt = timers[i].deadline;
+        }
+        DWORD wait = INFINITE;
+        if (wakeAt != 0)
+            wait = (wakeAt > now) ? (DWORD)(wakeAt - now) : 0;
+
+        HANDLE handles[2] = { hStdin, hWorkerEvent };
+        if (WaitForMultipleObjects(2, handles, FALSE, wait) == WAIT_FAILED)
+            return false;
+    }
+}
+
+long long pleditor_platform_time_ms(void) {
+    return (long long)GetTickCount64();
+}
+
+int pleditor_platform_add_timer(int interval_ms, bool repeat) {
+    if (numTimers == MAX_TIMERS) return -1;
+    if (interval_ms < 0) interval_ms = 0;
+
+    platform_timer *timer = &timers[numTimers++];
+    timer->id = nextTimerId++;
+    timer->interval_ms = interval_ms;
+    timer->deadline = GetTickCount64() + interval_ms;
+    timer->repeat = repeat;
+    return timer->id;
+}
+
+void pleditor_platform_remove_timer(int id) {
+    for (int i = 0; i < numTimers; i++) {
+        if (timers[i].id == id) {
+            timers[i] = timers[--numTimers];
+            return;
         }
     }
 }
 
+void pleditor_platform_post_worker_result(int id, void *data) {
+    worker_result *result = malloc(sizeof(worker_result));
+    if (!result) return;
+    result->id = id;
+    result->data = data;
+    result->next = NULL;
+
+    EnterCriticalSection(&workerLock);
+    *workerDoneTail = result;
+    workerDoneTail = &result->next;
+    LeaveCriticalSection(&workerLock);
+
+    SetEvent(hWorkerEvent);
+}
+
+static DWORD WINAPI worker_main(LPVOID arg) {
+    worker_job *job = arg;
+    void *result = job->work(job->arg);
+    pleditor_platform_post_worker_result(job->id, result);
+    free(job);
+    return 0;
+}
+
+bool pleditor_platform_run_worker(int id, void *(*work)(void *arg), void *arg) {
+    worker_job *job = malloc(sizeof(worker_job));
+    if (!job) return false;
+    job->id = id;
+    job->work = work;
+    job->arg = arg;
+
+    HANDLE thread = CreateThread(NULL, 0, worker_main, job, 0, NULL);
+    if (!thread) {
+        free(job);
+        return false;
+    }
+    CloseHandle(thread);
+    return true;
+}
+
+int pleditor_platform_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+// Threads that run the indices of parallel loops, started the first time
+// a loop needs them and then kept waiting for the next one
+#define POOL_MAX_THREADS 64
+static HANDLE poolThreads[POOL_MAX_THREADS];
+static int poolSize = 0;
+static SRWLOCK poolLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE poolWake = CONDITION_VARIABLE_INIT;
+static CONDITION_VARIABLE poolIdle = CONDITION_VARIABLE_INIT;
+static void (*poolWork)(int index, void *arg);
+static void *poolArg;
+static int poolCount = 0;
+static int poolNext = 0;
+static int poolPending = 0;
+static bool poolStop = false;
+
+// Run indices of the current loop until none are left; poolLock is held
+static void pool_run(void) {
+    while (poolNext < poolCount) {
+        int index = poolNext++;
+        void (*work)(int index, void *arg) = poolWork;
+        void *arg = poolArg;
+        ReleaseSRWLockExclusive(&poolLock);
+        work(index, arg);
+        AcquireSRWLockExclusive(&poolLock);
+        if (--poolPending == 0) WakeConditionVariable(&poolIdle);
+    }
+}
+
+static DWORD WINAPI pool_main(LPVOID arg) {
+    (void)arg;
+    AcquireSRWLockExclusive(&poolLock);
+    while (!poolStop) {
+        pool_run();
+        if (!poolStop) SleepConditionVariableSRW(&poolWake, &poolLock, INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&poolLock);
+    return 0;
+}
+
+static void pool_shutdown(void) {
+    AcquireSRWLockExclusive(&poolLock);
+    poolStop = true;
+    WakeAllConditionVariable(&poolWake);
+    ReleaseSRWLockExclusive(&poolLock);
+
+    for (int i = 0; i < poolSize; i++) {
+        WaitForSingleObject(poolThreads[i], INFINITE);
+        CloseHandle(poolThreads[i]);
+    }
+    poolSize = 0;
+    poolStop = false;
+}
+
+void pleditor_platform_parallel_for(int count, void (*work)(int index, void *arg), void *arg) {
+    if (count <= 0) return;
+    if (count == 1) {
+        work(0, arg);
+        return;
+    }
+
+    AcquireSRWLockExclusive(&poolLock);
+
+    // The calling thread takes indices too, including any a thread that
+    // couldn't be started would have run
+    while (poolSize < count - 1 && poolSize < POOL_MAX_THREADS) {
+        HANDLE thread = CreateThread(NULL, 0, pool_main, NULL, 0, NULL);
+        if (!thread) break;
+        poolThreads[poolSize++] = thread;
+    }
+
+    poolWork = work;
+    poolArg = arg;
+    poolCount = count;
+    poolNext = 0;
+    poolPending = count;
+    WakeAllConditionVariable(&poolWake);
+
+    pool_run();
+    while (poolPending > 0) {
+        SleepConditionVariableSRW(&poolIdle, &poolLock, INFINITE, 0);
+    }
+    poolCount = 0;
+    poolNext = 0;
+    ReleaseSRWLockExclusive(&poolLock);
+}
+
+void pleditor_platform_set_escape_timeout(int ms) {
+    // The console delivers ESC as its own key event, nothing to wait for
+    (void)ms;
+}
+
 void pleditor_platform_write(const char *s, size_t len) {
     DWORD written;
     // Output string to console
     WriteConsole(hStdout, s, (DWORD)len, &written, NULL);
 }
 
+bool pleditor_platform_output_busy(void) {
+    // WriteConsole completes synchronously, nothing is ever queued
+    return false;
+}
+
 bool pleditor_platform_read_file(const char *filename, char **buffer, size_t *len) {
     // Open file in binary read mode
     FILE *fp = fopen(filename, "rb");
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdatomic.h>
 
 #include "pleditor.h"
 #include "terminal.h"
@@ -24,6 +25,19 @@ int pleditor_cx_to_rx(pleditor_row *row, int cx) {
     return rx;
 }
 
+/* For calculating the chars index from a render index */
+int pleditor_rx_to_cx(pleditor_row *row, int rx) {
+    int cur_rx = 0;
+    int cx;
+    for (cx = 0; cx < row->size; cx++) {
+        if (row->chars[cx] == '\t')
+            cur_rx += (PLEDITOR_TAB_STOP - 1) - (cur_rx % PLEDITOR_TAB_STOP);
+        cur_rx++;
+        if (cur_rx > rx) return cx;
+    }
+    return cx;
+}
+
 /* Update the render string for a row (for handling tabs, etc.) */
 void pleditor_update_row(pleditor_state *state, pleditor_row *row) {
     int tabs = 0;
@@ -64,15 +78,13 @@ void pleditor_insert_row(pleditor_state *state, int at, char *s, size_t len) {
 
     state->rows[at].render_size = 0;
     state->rows[at].render = NULL;
-    state->rows[at].hl = NULL;
+    memset(&state->rows[at].hl, 0, sizeof(pleditor_highlight_row));
     pleditor_update_row(state, &state->rows[at]);
 
-    /* Update highlighting for the row if syntax highlighting is enabled */
-if (state->syntax) {
-    pleditor_syntax_update_multiline(state, at);
-}
-
     state->num_rows++;
+
+    /* Highlight the new row and whatever its exit state changes below it */
+    pleditor_syntax_row_inserted(state, at);
     state->dirty = true;
 }
 
@@ -80,11 +92,7 @@ if (state->syntax) {
 void pleditor_free_row(pleditor_row *row) {
     free(row->render);
     free(row->chars);
-    /* Free highlighting memory if allocated */
-    if (row->hl) {
-        free(row->hl->hl);
-        free(row->hl);
-    }
+    free(row->hl.hl);
 }
 
 /* Delete a row at the specified position */
@@ -93,6 +101,7 @@ void pleditor_delete_row(pleditor_state *state, int at) {
     pleditor_free_row(&state->rows[at]);
     memmove(&state->rows[at], &state->rows[at + 1], sizeof(pleditor_row) * (state->num_rows - at - 1));
     state->num_rows--;
+    pleditor_syntax_row_deleted(state, at);
     state->dirty = true;
 }
 
@@ -126,9 +135,7 @@ void pleditor_insert_char(pleditor_state *state, int c) {
     pleditor_update_row(state, row);
 
     /* Update syntax highlighting for affected rows */
-    if (state->syntax) {
-        pleditor_syntax_update_multiline(state, state->cy);
-    }
+    pleditor_syntax_invalidate(state, state->cy);
 
     state->cx++;
     state->dirty = true;
@@ -174,9 +181,7 @@ void pleditor_insert_newline(pleditor_state *state) {
         pleditor_update_row(state, row);
 
         /* Update syntax highlighting for the modified current row and all affected rows */
-        if (state->syntax) {
-            pleditor_syntax_update_multiline(state, state->cy);
-        }
+        pleditor_syntax_invalidate(state, state->cy);
     }
     state->cy++;
     state->cx = 0;
@@ -207,9 +212,7 @@ void pleditor_delete_char(pleditor_state *state) {
         pleditor_update_row(state, row);
 
         /* Update syntax highlighting for affected rows */
-        if (state->syntax) {
-            pleditor_syntax_update_multiline(state, state->cy);
-        }
+        pleditor_syntax_invalidate(state, state->cy);
 
         state->dirty = true;
     } else {
@@ -238,9 +241,7 @@ void pleditor_delete_char(pleditor_state *state) {
         pleditor_update_row(state, prev_row);
 
         /* Update syntax highlighting for affected rows */
-        if (state->syntax) {
-            pleditor_syntax_update_multiline(state, state->cy - 1);
-        }
+        pleditor_syntax_invalidate(state, state->cy - 1);
 
         pleditor_delete_row(state, state->cy);
         state->cy--;
@@ -313,14 +314,161 @@ void pleditor_scroll(pleditor_state *state) {
     }
 }
 
+/* Draw text, coloring it by its highlighting if there is any */
+static void pleditor_draw_text(pleditor_output *out, const char *c, const unsigned char *hl, int len) {
+    if (!hl) {
+        pleditor_output_color(out, PLEDITOR_SGR_RESET);
+        pleditor_output_text(out, c, len);
+        return;
+    }
+
+    /* Write runs of equally highlighted characters as one span */
+    int j = 0;
+    while (j < len) {
+        int run = j + 1;
+        while (run < len && hl[run] == hl[j]) run++;
+
+        pleditor_output_color(out, pleditor_syntax_color_to_ansi(hl[j]));
+        pleditor_output_text(out, &c[j], run - j);
+        j = run;
+    }
+}
+
+/* Part of a row drawn with its own attribute over the highlighting */
+typedef struct pleditor_overlay {
+    int start, end;    /* Render columns */
+    int sgr;           /* Attribute to draw them with */
+} pleditor_overlay;
+
+/* Draw the visible part of a row, from render column col_offset on, with
+ * the overlays on top. Overlays are drawn in order of their start; one
+ * that starts inside an earlier one is cut short */
+static void pleditor_draw_overlays(pleditor_output *out, const char *c, const unsigned char *hl, int len,
+                                   int col_offset, pleditor_overlay *overlays, int num_overlays) {
+    /* Sort by start column; there are only a few */
+    for (int i = 1; i < num_overlays; i++) {
+        pleditor_overlay overlay = overlays[i];
+        int j = i;
+        while (j > 0 && overlays[j - 1].start > overlay.start) {
+            overlays[j] = overlays[j - 1];
+            j--;
+        }
+        overlays[j] = overlay;
+    }
+
+    int drawn = 0;
+    for (int i = 0; i < num_overlays; i++) {
+        int start = overlays[i].start - col_offset;
+        int end = overlays[i].end - col_offset;
+        if (start < drawn) start = drawn;
+        if (end > len) end = len;
+        if (end <= start) continue;
+
+        pleditor_draw_text(out, &c[drawn], hl ? hl + drawn : NULL, start - drawn);
+        pleditor_output_color(out, overlays[i].sgr);
+        pleditor_output_text(out, &c[start], end - start);
+        drawn = end;
+    }
+    pleditor_draw_text(out, &c[drawn], hl ? hl + drawn : NULL, len - drawn);
+}
+
+static void pleditor_search_schedule(pleditor_state *state);
+
+/* Index every match of the search query, going on between events in a
+ * large file. Returns false if out of memory */
+static bool pleditor_search_index(pleditor_state *state) {
+    bool result = state->search_query &&
+                  pleditor_match_query(state, state->search_query, (int)strlen(state->search_query),
+                                       state->search_flags);
+    pleditor_search_schedule(state);
+    return result;
+}
+
+/* Render column of chars index to, counting on from chars index cx at
+ * render column rx */
+static int pleditor_advance_rx(const pleditor_row *row, int cx, int rx, int to) {
+    for (; cx < to; cx++) {
+        if (row->chars[cx] == '\t')
+            rx += (PLEDITOR_TAB_STOP - 1) - (rx % PLEDITOR_TAB_STOP);
+        rx++;
+    }
+    return rx;
+}
+
+/* Add overlays for the indexed matches on a row that show between render
+ * columns col_offset and col_offset + len, except the current one. Those
+ * starting before col_offset share one, so there are at most len + 1 */
+static int pleditor_match_overlays(pleditor_state *state, int filerow, int len, pleditor_overlay *overlays) {
+    const pleditor_match_index *index = &state->matches;
+    const pleditor_row *row = &state->rows[filerow];
+    int num_overlays = 0;
+    int left_end = -1;  /* Furthest end of the matches starting off screen */
+
+    /* Walk the render column along the matches, which are in order */
+    int cx = 0, rx = 0;
+    for (int i = pleditor_match_find(index, filerow, 0);
+         i < index->num_matches && index->matches[i].row == filerow; i++) {
+        int col = index->matches[i].col;
+        rx = pleditor_advance_rx(row, cx, rx, col);
+        cx = col;
+        if (rx >= state->col_offset + len) break;
+        if (filerow == state->last_match_row && col == state->last_match_col) continue;
+
+        int col_end = pleditor_search_match_end(&index->pattern, row->chars, row->size, col);
+        int end = pleditor_advance_rx(row, col, rx, col_end);
+        if (rx < state->col_offset) {
+            if (end > left_end) left_end = end;
+            continue;
+        }
+
+        overlays[num_overlays].start = rx;
+        overlays[num_overlays].end = end;
+        overlays[num_overlays].sgr = VT100_SGR_BG_BLUE;
+        num_overlays++;
+    }
+
+    if (left_end > state->col_offset) {
+        overlays[num_overlays].start = state->col_offset;
+        overlays[num_overlays].end = left_end;
+        overlays[num_overlays].sgr = VT100_SGR_BG_BLUE;
+        num_overlays++;
+    }
+    return num_overlays;
+}
+
 /* Draw a row of the editor */
-void pleditor_draw_rows(pleditor_state *state, char *buffer, int *len) {
+void pleditor_draw_rows(pleditor_state *state, pleditor_output *out) {
+    int line_number_width = pleditor_get_line_number_width(state);
+    int last_row = state->row_offset + state->screen_rows - 1;
+
+    /* Only the rows on screen (and those above them) need highlighting */
+    pleditor_syntax_ensure(state, last_row);
+
+    /* The bracket at the cursor and its pair, or the pair around the cursor */
+    pleditor_bracket_mark marks[2];
+    int num_marks = pleditor_bracket_marks(state, last_row, marks);
+
+    /* Calculate available width for text after accounting for line numbers */
+    int available_width = state->screen_cols - line_number_width;
+
+    /* While searching, every match on screen is highlighted. Room for the
+     * overlays of a row is set aside once per frame */
+    pleditor_overlay row_overlays[3];
+    pleditor_overlay *overlays = row_overlays;
+    bool show_matches = false;
+    if (state->is_searching && pleditor_search_index(state) && state->matches.num_matches > 0) {
+        int max_overlays = available_width + 4;
+        overlays = malloc(sizeof(pleditor_overlay) * max_overlays);
+        show_matches = overlays != NULL;
+        if (!overlays) overlays = row_overlays;
+    }
+
     for (int y = 0; y < state->screen_rows; y++) {
         int filerow = y + state->row_offset;
+        pleditor_output_begin_line(out);
 
         /* Draw line numbers if enabled */
         if (state->show_line_numbers) {
-            int line_number_width = pleditor_get_line_number_width(state);
             int digits = line_number_width - 1; /* Subtract space */
 
             /* Check if this is a valid file line */
@@ -330,29 +478,19 @@ void pleditor_draw_rows(pleditor_state *state, char *buffer, int *len) {
             /* Either it's an existing file line or it's the empty line right after
                the file that's currently being edited */
             if (is_file_line) {
-                if (is_current_line) {
-                    /* White text for current line */
-                    *len += sprintf(buffer + *len, VT100_COLOR_WHITE);
-                } else {
-                    /* Light gray text for other lines */
-                    *len += sprintf(buffer + *len, VT100_COLOR_DARK_GRAY);
-                }
+                /* White text for current line, gray for other lines */
+                pleditor_output_color(out, is_current_line ?
+                                      VT100_SGR_WHITE : VT100_SGR_DARK_GRAY);
 
                 /* Format line number with correct padding */
-                char format[20];
-                sprintf(format, "%%%dd ", digits);
-                *len += sprintf(buffer + *len, format, filerow + 1);
+                char number[20];
+                int number_len = snprintf(number, sizeof(number), "%*d ", digits, filerow + 1);
+                pleditor_output_text(out, number, number_len);
 
-                *len += sprintf(buffer + *len, VT100_COLOR_RESET);
+                pleditor_output_color(out, PLEDITOR_SGR_RESET);
             } else {
-                /* Create padding with correct width */
-                char padding[20] = "";
-                for (int i = 0; i < line_number_width; i++) {
-                    strcat(padding, " ");
-                }
-                *len += sprintf(buffer + *len, "%s", padding);
-
-                *len += sprintf(buffer + *len, VT100_COLOR_RESET);
+                /* Padding with correct width */
+                pleditor_output_fill(out, ' ', line_number_width);
             }
         }
 
@@ -365,29 +503,19 @@ void pleditor_draw_rows(pleditor_state *state, char *buffer, int *len) {
                 if (welcomelen > state->screen_cols) welcomelen = state->screen_cols;
 
                 /* Center the welcome message */
-                int available_width = state->screen_cols;
-                if (state->show_line_numbers) {
-                    available_width -= pleditor_get_line_number_width(state);
-                }
                 int padding = (available_width - welcomelen) / 2;
-                if (padding) {
-                    *len += sprintf(buffer + *len, "~");
+                if (padding > 0) {
+                    pleditor_output_text(out, "~", 1);
                     padding--;
                 }
-                while (padding--) *len += sprintf(buffer + *len, " ");
+                pleditor_output_fill(out, ' ', padding);
 
-                *len += sprintf(buffer + *len, "%s", welcome);
+                pleditor_output_text(out, welcome, welcomelen);
             } else {
-                *len += sprintf(buffer + *len, "~");
+                pleditor_output_text(out, "~", 1);
             }
         } else {
             /* Draw file content */
-            /* Calculate available width for text after accounting for line numbers */
-            int available_width = state->screen_cols;
-            if (state->show_line_numbers) {
-                available_width -= pleditor_get_line_number_width(state);
-            }
-
             int len_to_display = state->rows[filerow].render_size - state->col_offset;
             if (len_to_display < 0) len_to_display = 0;
             if (len_to_display > available_width) len_to_display = available_width;
@@ -395,34 +523,52 @@ void pleditor_draw_rows(pleditor_state *state, char *buffer, int *len) {
             if (len_to_display > 0) {
                 char *c = &state->rows[filerow].render[state->col_offset];
                 unsigned char *hl = NULL;
-                int current_color = -1;
 
                 /* If this row has highlighting data */
-                if (state->rows[filerow].hl) {
-                    hl = state->rows[filerow].hl->hl;
+                if (state->rows[filerow].hl.valid) {
+                    hl = state->rows[filerow].hl.hl + state->col_offset;
                 }
 
-                for (int j = 0; j < len_to_display; j++) {
-                    if (hl) {
-                        int color = pleditor_syntax_color_to_ansi(hl[j]);
-
-                        if (color != current_color) {
-                            current_color = color;
-                            *len += sprintf(buffer + *len, "\x1b[%dm", color);
-                        }
-                    }
-
-                    buffer[(*len)++] = c[j];
+                /* Search matches and marked brackets are drawn over the
+                 * highlighting */
+                int num_overlays = 0;
+                if (show_matches) {
+                    num_overlays = pleditor_match_overlays(state, filerow, len_to_display, overlays);
+                }
+                pleditor_row *row = &state->rows[filerow];
+                int match_end = -1;
+                if (state->is_searching && state->last_match_row == filerow &&
+                    state->last_match_col < row->size) {
+                    match_end = pleditor_search_match_end(&state->search_pattern, row->chars, row->size,
+                                                          state->last_match_col);
+                }
+                if (match_end > state->last_match_col && match_end <= row->size) {
+                    overlays[num_overlays].start = pleditor_cx_to_rx(row, state->last_match_col);
+                    overlays[num_overlays].end = pleditor_cx_to_rx(row, match_end);
+                    overlays[num_overlays].sgr = VT100_SGR_BG_YELLOW;
+                    num_overlays++;
+                }
+                for (int m = 0; m < num_marks; m++) {
+                    if (marks[m].row != filerow) continue;
+                    overlays[num_overlays].start = marks[m].rx;
+                    overlays[num_overlays].end = marks[m].rx + 1;
+                    overlays[num_overlays].sgr = marks[m].error ? VT100_SGR_BG_RED : VT100_SGR_INVERSE;
+                    num_overlays++;
                 }
 
+                pleditor_draw_overlays(out, c, hl, len_to_display, state->col_offset,
+                                       overlays, num_overlays);
+
                 /* Reset text color at end of line */
-                *len += sprintf(buffer + *len, VT100_COLOR_RESET);
+                pleditor_output_color(out, PLEDITOR_SGR_RESET);
             }
         }
 
-        /* Clear to end of line and add newline */
-        *len += sprintf(buffer + *len, VT100_CLEAR_LINE "\r\n");
+        /* Clear to end of line */
+        pleditor_output_end_line(out, y);
     }
+
+    if (overlays != row_overlays) free(overlays);
 }
 
 /* Truncate long file paths with ellipsis at the beginning */
@@ -444,19 +590,54 @@ char* pleditor_truncated_path(const char* path, size_t max_len) {
     return truncated;
 }
 
+/* Format a count with thousands separators */
+static void pleditor_format_count(char *buf, int count) {
+    char digits[16];
+    int len = snprintf(digits, sizeof(digits), "%d", count);
+
+    int j = 0;
+    for (int i = 0; i < len; i++) {
+        if (i > 0 && (len - i) % 3 == 0) buf[j++] = ',';
+        buf[j++] = digits[i];
+    }
+    buf[j] = '\0';
+}
+
+/* Describe where the current match is among all of them */
+static void pleditor_match_position(pleditor_state *state, char *buf, size_t size) {
+    const pleditor_match_index *index = &state->matches;
+    char total[24];
+    pleditor_format_count(total, index->num_matches);
+
+    int i = pleditor_match_find(index, state->last_match_row, state->last_match_col);
+    if (state->last_match_row != -1 && i < index->num_matches &&
+        index->matches[i].row == state->last_match_row &&
+        index->matches[i].col == state->last_match_col) {
+        char position[24];
+        pleditor_format_count(position, i + 1);
+        snprintf(buf, size, "match %s/%s | ", position, total);
+    } else {
+        snprintf(buf, size, "%s %s | ", total, index->num_matches == 1 ? "match" : "matches");
+    }
+}
+
 /* Draw the status bar at the bottom of the screen */
-void pleditor_draw_status_bar(pleditor_state *state, char *buffer, int *len) {
+void pleditor_draw_status_bar(pleditor_state *state, pleditor_output *out) {
+    pleditor_output_begin_line(out);
+
     /* Inverse video for status bar */
-    *len += sprintf(buffer + *len, VT100_INVERSE);
+    pleditor_output_color(out, VT100_SGR_INVERSE);
 
     char status[80], rstatus[80];
     char* display_filename = state->filename ?
                              pleditor_truncated_path(state->filename, 30) :
                              "[No Name]";
-    int status_len = snprintf(status, sizeof(status), "%s - %d lines %s",
+    int status_len = snprintf(status, sizeof(status), "%s - %d lines %s%s",
                              display_filename,
                              state->num_rows,
-                             state->dirty ? "(modified)" : "");
+                             state->dirty ? "(modified)" : "",
+                             state->macro.recording ? " [recording]" : "");
+    if (status_len >= (int)sizeof(status)) status_len = sizeof(status) - 1;
 
     /* Add filetype information if available */
     char filetype[20] = "no ft";
@@ -464,72 +645,96 @@ void pleditor_draw_status_bar(pleditor_state *state, char *buffer, int *len) {
         snprintf(filetype, sizeof(filetype), "%s", state->syntax->filetype);
     }
 
-    int rstatus_len = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d ",
-                              filetype, state->cy + 1, state->num_rows);
+    /* While searching, the number of matches and which one is current, or
+     * why the expression being typed is invalid */
+    char matches[64] = "";
+    if (state->search_task.running) {
+        int done = (int)((long long)state->search_task.step * 100 / (state->num_rows + 1));
+        snprintf(matches, sizeof(matches), "searching %d%% | ", done);
+    } else if (state->is_searching && state->search_pattern.error) {
+        snprintf(matches, sizeof(matches), "%s | ", state->search_pattern.error);
+    } else if (state->is_searching && state->matches.building) {
+        snprintf(matches, sizeof(matches), "counting %d%% | ", pleditor_match_progress(state));
+    } else if (state->is_searching && state->matches.valid && state->matches.pattern.len > 0) {
+        pleditor_match_position(state, matches, sizeof(matches));
+    }
+    char mode[32] = "";
+    if (state->is_searching && state->search_flags) {
+        int flags = state->search_flags;
+        snprintf(mode, sizeof(mode), "%s%s%s| ",
+                 (flags & PLEDITOR_SEARCH_REGEX) ? "regex " : "",
+                 (flags & PLEDITOR_SEARCH_IGNORE_CASE) ? "nocase " : "",
+                 (flags & PLEDITOR_SEARCH_WHOLE_WORD) ? "word " : "");
+    }
+
+    int rstatus_len = snprintf(rstatus, sizeof(rstatus), "%s%s%s | %d/%d ",
+                              mode, matches, filetype, state->cy + 1, state->num_rows);
+    if (rstatus_len >= (int)sizeof(rstatus)) rstatus_len = sizeof(rstatus) - 1;
 
     if (status_len > state->screen_cols) status_len = state->screen_cols;
-    *len += sprintf(buffer + *len, "%s", status);
+    pleditor_output_text(out, status, status_len);
 
-    while (status_len < state->screen_cols - rstatus_len) {
-        *len += sprintf(buffer + *len, " ");
-        status_len++;
+    /* Right-align the cursor position, dropping it if it does not fit */
+    int padding = state->screen_cols - status_len - rstatus_len;
+    if (padding >= 0) {
+        pleditor_output_fill(out, ' ', padding);
+        pleditor_output_text(out, rstatus, rstatus_len);
+    } else {
+        pleditor_output_fill(out, ' ', state->screen_cols - status_len);
     }
 
-    *len += sprintf(buffer + *len, "%s", rstatus);
-
     /* Reset text formatting */
-    *len += sprintf(buffer + *len, VT100_COLOR_RESET "\r\n");
+    pleditor_output_color(out, PLEDITOR_SGR_RESET);
+    pleditor_output_end_line(out, state->screen_rows);
 }
 
 /* Draw the message bar below the status bar */
-void pleditor_draw_message_bar(pleditor_state *state, char *buffer, int *len) {
-    /* Clear the message bar */
-    *len += sprintf(buffer + *len, VT100_CLEAR_LINE);
+void pleditor_draw_message_bar(pleditor_state *state, pleditor_output *out) {
+    pleditor_output_begin_line(out);
 
     /* Show status message if it exists */
     int msglen = strlen(state->status_msg);
     if (msglen > state->screen_cols) msglen = state->screen_cols;
-    if (msglen) {
-        *len += sprintf(buffer + *len, "%s", state->status_msg);
-    }
+    pleditor_output_text(out, state->status_msg, msglen);
+
+    /* Clear the rest of the message bar */
+    pleditor_output_end_line(out, state->screen_rows + 1);
 }
 
 /* Update the entire screen */
 void pleditor_refresh_screen(pleditor_state *state) {
+    /* A replayed macro is drawn once, when it has finished */
+    if (state->macro.replaying) return;
+
     pleditor_scroll(state);
 
-    /* Buffer to build screen update in (large enough for entire screen) */
-    char *buffer = malloc(state->screen_rows * state->screen_cols * 5);
-    int len = 0;
+    /* While the terminal is still receiving an earlier frame, skip this one;
+     * a fresher frame is drawn once the output drains */
+    if (pleditor_platform_output_busy()) return;
 
-    /* Hide cursor during screen update to avoid flicker */
-    len += sprintf(buffer, VT100_CURSOR_HIDE VT100_CURSOR_HOME);
+    /* Rows the terminal already shows are skipped by the output optimizer */
+    pleditor_output *out = &state->output;
+    pleditor_output_begin_frame(out, state->screen_rows + 2, state->screen_cols);
 
     /* Draw rows of text */
-    pleditor_draw_rows(state, buffer, &len);
+    pleditor_draw_rows(state, out);
 
     /* Draw status bar and message bar */
-    pleditor_draw_status_bar(state, buffer, &len);
-    pleditor_draw_message_bar(state, buffer, &len);
+    pleditor_draw_status_bar(state, out);
+    pleditor_draw_message_bar(state, out);
 
     /* Position cursor */
-    char cursor_pos[32];
-    int cursor_screen_x = state->rx - state->col_offset + 1;
+    int cursor_screen_x = state->rx - state->col_offset;
 
     /* Add offset for line numbers if enabled */
-    if (state->show_line_numbers) {
-        cursor_screen_x += pleditor_get_line_number_width(state);
-    }
+    cursor_screen_x += pleditor_get_line_number_width(state);
 
-    cursor_position(state->cy - state->row_offset + 1, cursor_screen_x, cursor_pos);
-    len += sprintf(buffer + len, "%s", cursor_pos);
+    pleditor_output_end_frame(out, state->cy - state->row_offset, cursor_screen_x);
 
-    /* Show cursor */
-    len += sprintf(buffer + len, VT100_CURSOR_SHOW);
-
-    /* Write buffer to terminal */
-    pleditor_platform_write(buffer, len);
-    free(buffer);
+    /* Write frame to terminal */
+    if (out->len > 0) {
+        pleditor_platform_write(out->buf, out->len);
+    }
 }
 
 /* Set a status message to display in the message bar */
@@ -540,8 +745,10 @@ void pleditor_set_status_message(pleditor_state *state, const char *fmt, ...) {
     va_end(ap);
 }
 
-/* Display a prompt in the status bar and get a input */
-char* pleditor_prompt(pleditor_state *state, const char *prompt) {
+/* Display a prompt in the status bar and get a input, which may be
+ * empty only if allow_empty is set */
+static char* pleditor_prompt_input(pleditor_state *state, const char *prompt,
+                                   pleditor_prompt_callback callback, bool allow_empty) {
     size_t bufsize = 128;
     char *buf = malloc(bufsize);
     if (!buf) return NULL;
@@ -554,7 +761,7 @@ char* pleditor_prompt(pleditor_state *state, const char *prompt) {
         pleditor_set_status_message(state, "%s: %s", prompt, buf);
         pleditor_refresh_screen(state);
 
-        int c = pleditor_platform_read_key();
+        int c = pleditor_read_key(state);
 
         if (c == PLEDITOR_DEL_KEY || c == PLEDITOR_KEY_BACKSPACE) {
             /* Handle backspace/delete */
@@ -564,7 +771,7 @@ char* pleditor_prompt(pleditor_state *state, const char *prompt) {
             }
         } else if (c == '\r' || c == '\n') {
             /* Handle Enter/Return */
-            if (buflen != 0) {
+            if (buflen != 0 || allow_empty) {
                 pleditor_set_status_message(state, "");
                 return buf;
             }
@@ -573,7 +780,7 @@ char* pleditor_prompt(pleditor_state *state, const char *prompt) {
             pleditor_set_status_message(state, "");
             free(buf);
             return NULL;
-        } else if (!iscntrl(c) && c < 128) {
+        } else if (c >= 0 && c < 128 && !iscntrl(c)) {
             /* Append character to buffer */
             if (buflen == bufsize - 1) {
                 bufsize *= 2;
@@ -587,9 +794,49 @@ char* pleditor_prompt(pleditor_state *state, const char *prompt) {
             buf[buflen++] = c;
             buf[buflen] = '\0';
         }
+
+        if (callback) callback(state, buf, c);
     }
 }
 
+/* Display a prompt in the status bar and get a non-empty input */
+char* pleditor_prompt(pleditor_state *state, const char *prompt, pleditor_prompt_callback callback) {
+    return pleditor_prompt_input(state, prompt, callback, false);
+}
+
+/* Display a prompt in the status bar and get an input, which may be empty */
+char* pleditor_prompt_allow_empty(pleditor_state *state, const char *prompt) {
+    return pleditor_prompt_input(state, prompt, NULL, true);
+}
+
+/**
+ * Prompt for a range of lines, as "from-to" or a single line number, and
+ * set first and last to the rows it covers, up to the last row. Returns
+ * false if cancelled or the range is invalid
+ */
+bool pleditor_prompt_range(pleditor_state *state, const char *prompt, int *first, int *last) {
+    char *input = pleditor_prompt(state, prompt, NULL);
+    if (input == NULL) return false;
+
+    char *end;
+    long from = strtol(input, &end, 10);
+    long to = from;
+    if (*end == '-' || *end == ',') {
+        to = strtol(end + 1, &end, 10);
+    }
+    bool valid = *end == '\0' && from >= 1 && to >= from;
+    free(input);
+    if (!valid) {
+        pleditor_set_status_message(state, "Invalid line range");
+        return false;
+    }
+
+    if (to > state->num_rows) to = state->num_rows;
+    *first = (int)from - 1;
+    *last = (int)to - 1;
+    return true;
+}
+
 /* Move the cursor based on key press */
 void pleditor_move_cursor(pleditor_state *state, int key) {
     pleditor_row *row = (state->cy >= state->num_rows) ? NULL : &state->rows[state->cy];
@@ -632,11 +879,39 @@ void pleditor_move_cursor(pleditor_state *state, int key) {
     }
 }
 
+/* Is the character part of a word for word-wise movement */
+static bool is_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Move the cursor to the previous word start or the next word end */
+void pleditor_move_word(pleditor_state *state, int key) {
+    pleditor_row *row = (state->cy >= state->num_rows) ? NULL : &state->rows[state->cy];
+
+    if (key == PLEDITOR_ARROW_LEFT) {
+        /* At the start of a line, wrap to the previous one */
+        if (!row || state->cx == 0) {
+            pleditor_move_cursor(state, key);
+            return;
+        }
+        while (state->cx > 0 && !is_word_char(row->chars[state->cx - 1])) state->cx--;
+        while (state->cx > 0 && is_word_char(row->chars[state->cx - 1])) state->cx--;
+    } else {
+        /* At the end of a line, wrap to the next one */
+        if (!row || state->cx >= row->size) {
+            pleditor_move_cursor(state, key);
+            return;
+        }
+        while (state->cx < row->size && !is_word_char(row->chars[state->cx])) state->cx++;
+        while (state->cx < row->size && is_word_char(row->chars[state->cx])) state->cx++;
+    }
+}
+
 /* Save the current file */
 void pleditor_save(pleditor_state *state) {
     /* If no filename set, prompt the user for one */
     if (state->filename == NULL) {
-        char *filename = pleditor_prompt(state, "Save as");
+        char *filename = pleditor_prompt(state, "Save as", NULL);
         if (filename == NULL) {
             pleditor_set_status_message(state, "Save aborted");
             return;
@@ -646,11 +921,6 @@ void pleditor_save(pleditor_state *state) {
 
         /* Select syntax highlighting based on new filename */
         pleditor_syntax_by_fileext(state, state->filename);
-
-        /* Apply highlighting if a syntax was selected */
-        if (state->syntax) {
-            pleditor_syntax_update_all(state);
-        }
     }
 
     /* Create a single string of entire file */
@@ -682,6 +952,19 @@ void pleditor_save(pleditor_state *state) {
 void pleditor_handle_keypress(pleditor_state *state, int c) {
     static int quit_times = PLEDITOR_QUIT_CONFIRM_TIMES;
 
+    /* Not a key: the caller only needs to redraw */
+    if (c == PLEDITOR_KEY_REFRESH) return;
+
+    /* Keys other than those moving between matches stop a search going
+     * on between events; Escape does nothing else */
+    if (state->search_task.running && c != PLEDITOR_CTRL_KEY('n') && c != PLEDITOR_CTRL_KEY('p')) {
+        pleditor_search_cancel(state);
+        if (c == PLEDITOR_KEY_ESC) {
+            pleditor_set_status_message(state, "Search cancelled");
+            return;
+        }
+    }
+
     /* If in search mode, handle search-specific keys */
     if (state->is_searching) {
         switch (c) {
@@ -734,6 +1017,10 @@ void pleditor_handle_keypress(pleditor_state *state, int c) {
                                      state->show_line_numbers ? "ON" : "OFF");
             break;
 
+        case PLEDITOR_CTRL_KEY(']'):
+            pleditor_bracket_jump(state);
+            break;
+
         case PLEDITOR_CTRL_KEY('z'):
             pleditor_apply_undo(state);
             break;
@@ -742,6 +1029,30 @@ void pleditor_handle_keypress(pleditor_state *state, int c) {
             pleditor_apply_redo(state);
             break;
 
+        case PLEDITOR_KEY_MACRO_RECORD:
+            pleditor_macro_toggle_recording(state);
+            break;
+
+        case PLEDITOR_KEY_MACRO_RUN:
+            pleditor_macro_run(state, 1);
+            break;
+
+        case PLEDITOR_KEY_MACRO_REPEAT:
+            pleditor_macro_prompt_run(state);
+            break;
+
+        case PLEDITOR_KEY_MACRO_LINES:
+            pleditor_macro_prompt_lines(state);
+            break;
+
+        case PLEDITOR_KEY_REPLACE_ALL:
+            pleditor_replace_prompt(state, false);
+            break;
+
+        case PLEDITOR_KEY_REPLACE_LINES:
+            pleditor_replace_prompt(state, true);
+            break;
+
         case PLEDITOR_KEY_BACKSPACE:
         case PLEDITOR_CTRL_KEY('h'):
             pleditor_delete_char(state);
@@ -815,13 +1126,177 @@ void pleditor_handle_keypress(pleditor_state *state, int c) {
             break;
 
         default:
-            pleditor_insert_char(state, c);
+            if (c & PLEDITOR_MOD_MASK) {
+                int base = PLEDITOR_KEY_BASE(c);
+                if ((c & PLEDITOR_MOD_CTRL) &&
+                    (base == PLEDITOR_ARROW_LEFT || base == PLEDITOR_ARROW_RIGHT)) {
+                    /* Ctrl-Left/Right move by word */
+                    pleditor_move_word(state, base);
+                } else if (base >= PLEDITOR_ARROW_LEFT && base <= PLEDITOR_DEL_KEY) {
+                    /* Other modified editing keys act like the plain key */
+                    pleditor_handle_keypress(state, base);
+                }
+                break;
+            }
+
+            /* Function keys and errors are not text */
+            if (c >= 0 && c < 256) {
+                pleditor_insert_char(state, c);
+            }
             break;
     }
 
     quit_times = PLEDITOR_QUIT_CONFIRM_TIMES;
 }
 
+/* Wait for a key, handling any other event that arrives first. Returns
+ * PLEDITOR_KEY_REFRESH when such an event may have changed the screen */
+int pleditor_read_key(pleditor_state *state) {
+    /* Prompts opened by a replayed macro read the recorded keys */
+    if (state->macro.replaying) {
+        return pleditor_macro_next_key(state);
+    }
+
+    pleditor_event event;
+    if (!pleditor_platform_wait_event(&event, -1)) {
+        return PLEDITOR_KEY_ERR;
+    }
+
+    if (event.type == PLEDITOR_EVENT_KEY) {
+        pleditor_macro_record_key(state, event.key);
+        return event.key;
+    }
+
+    pleditor_handle_event(state, &event);
+    return PLEDITOR_KEY_REFRESH;
+}
+
+/* Find a registered timer or background job */
+static pleditor_handler *pleditor_find_handler(pleditor_state *state,
+                                               enum pleditor_event_type type, int id) {
+    for (int i = 0; i < state->num_handlers; i++) {
+        if (state->handlers[i].type == type && state->handlers[i].id == id) {
+            return &state->handlers[i];
+        }
+    }
+    return NULL;
+}
+
+/* Register a timer or background job */
+static bool pleditor_add_handler(pleditor_state *state, const pleditor_handler *handler) {
+    pleditor_handler *handlers = realloc(state->handlers,
+                                         sizeof(pleditor_handler) * (state->num_handlers + 1));
+    if (!handlers) return false;
+
+    state->handlers = handlers;
+    state->handlers[state->num_handlers++] = *handler;
+    return true;
+}
+
+/* Forget a timer or background job */
+static void pleditor_remove_handler(pleditor_state *state, pleditor_handler *handler) {
+    int at = handler - state->handlers;
+    memmove(&state->handlers[at], &state->handlers[at + 1],
+            sizeof(pleditor_handler) * (state->num_handlers - at - 1));
+    state->num_handlers--;
+}
+
+/* Run a callback on the main thread after interval_ms, once or repeatedly */
+int pleditor_add_timer(pleditor_state *state, int interval_ms, bool repeat,
+                       pleditor_callback callback, void *data) {
+    int id = pleditor_platform_add_timer(interval_ms, repeat);
+    if (id == -1) return -1;
+
+    pleditor_handler handler = {
+        .type = PLEDITOR_EVENT_TIMER,
+        .id = id,
+        .repeat = repeat,
+        .callback = callback,
+        .data = data
+    };
+    if (!pleditor_add_handler(state, &handler)) {
+        pleditor_platform_remove_timer(id);
+        return -1;
+    }
+    return id;
+}
+
+/* Stop a timer */
+void pleditor_remove_timer(pleditor_state *state, int id) {
+    pleditor_handler *handler = pleditor_find_handler(state, PLEDITOR_EVENT_TIMER, id);
+    if (handler) {
+        pleditor_platform_remove_timer(id);
+        pleditor_remove_handler(state, handler);
+    }
+}
+
+/* Run work on a background thread; done receives its result on the main thread */
+bool pleditor_run_worker(pleditor_state *state, void *(*work)(void *arg), void *arg,
+                         pleditor_callback done) {
+    pleditor_handler handler = {
+        .type = PLEDITOR_EVENT_WORKER,
+        .id = state->next_worker_id++,
+        .repeat = false,
+        .callback = done,
+        .data = NULL
+    };
+    if (!pleditor_add_handler(state, &handler)) return false;
+
+    if (!pleditor_platform_run_worker(handler.id, work, arg)) {
+        pleditor_remove_handler(state, &state->handlers[state->num_handlers - 1]);
+        return false;
+    }
+    return true;
+}
+
+/* Query the terminal size and leave room for the status and message bars */
+void pleditor_update_screen_size(pleditor_state *state) {
+    if (!pleditor_platform_get_size(&state->screen_rows, &state->screen_cols)) {
+        /* Fallback if window size detection fails */
+        state->screen_rows = 24;
+        state->screen_cols = 80;
+    }
+
+    /* Leave room for status line and message bar */
+    state->screen_rows -= 2;
+    if (state->screen_rows < 1) state->screen_rows = 1;
+}
+
+/* Process an event from the platform event loop */
+void pleditor_handle_event(pleditor_state *state, const pleditor_event *event) {
+    switch (event->type) {
+        case PLEDITOR_EVENT_KEY:
+            pleditor_macro_record_key(state, event->key);
+            pleditor_handle_keypress(state, event->key);
+            break;
+
+        case PLEDITOR_EVENT_RESIZE:
+            /* The terminal may have reflowed its contents, redraw everything */
+            pleditor_update_screen_size(state);
+            pleditor_output_invalidate(&state->output);
+            break;
+
+        case PLEDITOR_EVENT_TIMER:
+        case PLEDITOR_EVENT_WORKER: {
+            pleditor_handler *handler = pleditor_find_handler(state, event->type, event->id);
+            if (!handler) break;
+
+            /* Copy the handler out: the callback may register or remove others */
+            pleditor_handler fired = *handler;
+            if (event->type == PLEDITOR_EVENT_WORKER || !fired.repeat) {
+                pleditor_remove_handler(state, handler);
+            }
+            fired.callback(state, event->type == PLEDITOR_EVENT_WORKER ? event->data : fired.data);
+            break;
+        }
+
+        case PLEDITOR_EVENT_NONE:
+        case PLEDITOR_EVENT_REDRAW:
+            /* Nothing to do besides redrawing */
+            break;
+    }
+}
+
 /* Initialize the editor state */
 void pleditor_init(pleditor_state *state) {
     state->cx = 0;
@@ -835,27 +1310,44 @@ void pleditor_init(pleditor_state *state) {
     state->filename = NULL;
     state->status_msg[0] = '\0';
     state->syntax = NULL;  /* No syntax highlighting by default */
+    state->hl_frontier = 0;
+    state->hl_cache = NULL;
+    state->brackets = NULL;
     state->show_line_numbers = true; /* Line numbers enabled by default */
     state->undo_stack = NULL; /* Initialize the undo stack */
     state->redo_stack = NULL; /* Initialize the redo stack */
     state->is_unredoing = false; /* Initialize unredoing flag */
+    state->undo_group = 0; /* Operations are undone one at a time */
+    state->next_undo_group = 1;
     state->should_quit = false; /* Initialize quit flag */
 
     /* Initialize search fields */
     state->is_searching = false;
     state->search_query = NULL;
+    state->search_flags = 0;
+    memset(&state->search_pattern, 0, sizeof(state->search_pattern));
+    memset(&state->matches, 0, sizeof(state->matches));
+    state->trigrams = NULL;
+    state->use_trigrams = true;
     state->last_match_row = -1;
     state->last_match_col = -1;
     state->search_direction = SEARCH_FORWARD;
+    memset(&state->isearch, 0, sizeof(state->isearch));
+    memset(&state->search_task, 0, sizeof(state->search_task));
+    state->search_timer = -1;
 
-    if (!pleditor_platform_get_size(&state->screen_rows, &state->screen_cols)) {
-        /* Fallback if window size detection fails */
-        state->screen_rows = 24;
-        state->screen_cols = 80;
-    }
+    /* Frames are wrapped in synchronized updates when the terminal allows */
+    pleditor_output_init(&state->output, pleditor_platform_has_sync_update());
 
-    /* Leave room for status line and message bar */
-    state->screen_rows -= 2;
+    /* No timers or background work yet */
+    state->handlers = NULL;
+    state->num_handlers = 0;
+    state->next_worker_id = 1;
+
+    /* No keyboard macro yet */
+    pleditor_macro_init(&state->macro);
+
+    pleditor_update_screen_size(state);
 }
 
 /* Open a file in the editor */
@@ -907,11 +1399,12 @@ bool pleditor_open(pleditor_state *state, const char *filename) {
     free(buffer);
     state->dirty = false;
 
-    /* Select syntax highlighting based on filename */
+    /* Select syntax highlighting based on filename; rows are highlighted
+     * as they come into view */
     pleditor_syntax_by_fileext(state, filename);
 
-    /* Apply syntax highlighting to all rows */
-    pleditor_syntax_update_all(state);
+    /* Large files are indexed for searching between events */
+    pleditor_trigram_start(state);
 
     return true;
 }
@@ -925,19 +1418,41 @@ void pleditor_free(pleditor_state *state) {
     free(state->rows);
     free(state->filename);
     free(state->search_query);
+    pleditor_search_free_pattern(&state->search_pattern);
+    pleditor_match_free(&state->matches);
+    pleditor_trigram_free(state);
+    free(state->isearch.steps);
+    pleditor_search_free_pattern(&state->search_task.pattern);
+    pleditor_search_clones_free(&state->search_task.clones);
     pleditor_free_operation_stack(&state->undo_stack);
     pleditor_free_operation_stack(&state->redo_stack);
+    pleditor_output_free(&state->output);
+    pleditor_macro_free(&state->macro);
+    pleditor_syntax_free(state);
+    pleditor_bracket_free(state);
+    for (int i = 0; i < state->num_handlers; i++) {
+        if (state->handlers[i].type == PLEDITOR_EVENT_TIMER) {
+            pleditor_platform_remove_timer(state->handlers[i].id);
+        }
+    }
+    free(state->handlers);
 }
 
 void pleditor_record_operation(pleditor_state *state, const pleditor_operation_params *params) {
     /* Don't record undo operations when undoing or redoing */
-    if (state->is_unredoing) return;
+    if (state->is_unredoing) {
+        pleditor_replace_free_saved(params->saved, params->num_saved);
+        return;
+    }
 
     /* Clear redo stack when a new edit is made */
     pleditor_free_operation_stack(&state->redo_stack);
 
     pleditor_operation *op = malloc(sizeof(pleditor_operation));
-    if (!op) return;
+    if (!op) {
+        pleditor_replace_free_saved(params->saved, params->num_saved);
+        return;
+    }
 
     op->type = params->type;
     op->cx = params->cx;
@@ -945,6 +1460,9 @@ void pleditor_record_operation(pleditor_state *state, const pleditor_operation_p
     op->character = params->character;
     op->line = NULL;
     op->line_size = params->line_size;
+    op->saved = params->saved;
+    op->num_saved = params->num_saved;
+    op->group = state->undo_group;
 
     if (params->line) {
         op->line = malloc(params->line_size + 1);
@@ -960,23 +1478,30 @@ void pleditor_record_operation(pleditor_state *state, const pleditor_operation_p
     state->undo_stack = op;
 }
 
+/* Record the following operations as one undo step */
+void pleditor_begin_undo_group(pleditor_state *state) {
+    state->undo_group = state->next_undo_group++;
+}
+
+/* Go back to recording operations as separate undo steps */
+void pleditor_end_undo_group(pleditor_state *state) {
+    state->undo_group = 0;
+}
+
 void pleditor_free_operation_stack(pleditor_operation **stack) {
     pleditor_operation *op = *stack;
     while (op) {
         pleditor_operation *next = op->next;
         if (op->line) free(op->line);
+        pleditor_replace_free_saved(op->saved, op->num_saved);
         free(op);
         op = next;
     }
     *stack = NULL;
 }
 
-void pleditor_apply_undo(pleditor_state *state) {
-    if (!state->undo_stack) {
-        pleditor_set_status_message(state, "Nothing to undo");
-        return;
-    }
-
+/* Undo the most recent operation */
+static void pleditor_undo_operation(pleditor_state *state) {
     /* Set flag to prevent recording operations while undoing */
     state->is_unredoing = true;
 
@@ -993,6 +1518,9 @@ void pleditor_apply_undo(pleditor_state *state) {
         redo_op->character = op->character;
         redo_op->line = NULL;
         redo_op->line_size = op->line_size;
+        redo_op->saved = NULL;
+        redo_op->num_saved = 0;
+        redo_op->group = op->group;
 
         if (op->line && op->line_size > 0) {
             redo_op->line = malloc(op->line_size + 1);
@@ -1022,9 +1550,7 @@ void pleditor_apply_undo(pleditor_state *state) {
                     row->size--;
                     pleditor_update_row(state, row);
                     state->dirty = true;
-                    if (state->syntax) {
-                        pleditor_syntax_update_multiline(state, state->cy);
-                    }
+                    pleditor_syntax_invalidate(state, state->cy);
                 }
             }
             break;
@@ -1055,9 +1581,7 @@ void pleditor_apply_undo(pleditor_state *state) {
                 row->chars[state->cx] = op->character;
                 pleditor_update_row(state, row);
 
-                if (state->syntax) {
-                    pleditor_syntax_update_multiline(state, state->cy);
-                }
+                pleditor_syntax_invalidate(state, state->cy);
 
                 /* Only increment cursor for backspace, not for DEL */
                 if (!is_del_operation) {
@@ -1121,9 +1645,7 @@ void pleditor_apply_undo(pleditor_state *state) {
                     prev_row->size = op->cx;
                     pleditor_update_row(state, prev_row);
 
-                    if (state->syntax) {
-                        pleditor_syntax_update_multiline(state, op->cy - 1);
-                    }
+                    pleditor_syntax_invalidate(state, op->cy - 1);
                 } else {
                     /* Original backspace at line start case */
                     int match_start = prev_row->size - op->line_size;
@@ -1136,9 +1658,7 @@ void pleditor_apply_undo(pleditor_state *state) {
                             prev_row->size = match_start;
                             pleditor_update_row(state, prev_row);
 
-                            if (state->syntax) {
-                                pleditor_syntax_update_multiline(state, op->cy - 1);
-                            }
+                            pleditor_syntax_invalidate(state, op->cy - 1);
                         }
                 }
             }
@@ -1157,6 +1677,19 @@ void pleditor_apply_undo(pleditor_state *state) {
 
             state->dirty = true;
             break;
+
+        case OP_REPLACE_ROWS:
+            /* Put back the text the rows had, keeping what they have now for redo */
+            state->cx = op->cx;
+            state->cy = op->cy;
+            pleditor_replace_swap(state, op->saved, op->num_saved);
+            if (redo_op) {
+                redo_op->saved = op->saved;
+                redo_op->num_saved = op->num_saved;
+                op->saved = NULL;
+                op->num_saved = 0;
+            }
+            break;
         }
 
     /* Clear the unredoing flag */
@@ -1164,17 +1697,28 @@ void pleditor_apply_undo(pleditor_state *state) {
 
     /* Free the undo operation */
     if (op->line) free(op->line);
+    pleditor_replace_free_saved(op->saved, op->num_saved);
     free(op);
-
-    pleditor_set_status_message(state, "Undo successful");
 }
 
-void pleditor_apply_redo(pleditor_state *state) {
-    if (!state->redo_stack) {
-        pleditor_set_status_message(state, "Nothing to redo");
+void pleditor_apply_undo(pleditor_state *state) {
+    if (!state->undo_stack) {
+        pleditor_set_status_message(state, "Nothing to undo");
         return;
     }
 
+    /* Undo a whole group at once, unless a group is still being recorded
+     * (an undo key inside a macro only takes back the previous key) */
+    int group = state->undo_group ? 0 : state->undo_stack->group;
+    do {
+        pleditor_undo_operation(state);
+    } while (group && state->undo_stack && state->undo_stack->group == group);
+
+    pleditor_set_status_message(state, "Undo successful");
+}
+
+/* Redo the most recently undone operation */
+static void pleditor_redo_operation(pleditor_state *state) {
     /* Set flag to prevent recording operations while redoing */
     state->is_unredoing = true;
 
@@ -1191,6 +1735,9 @@ void pleditor_apply_redo(pleditor_state *state) {
         undo_op->character = op->character;
         undo_op->line = NULL;
         undo_op->line_size = op->line_size;
+        undo_op->saved = NULL;
+        undo_op->num_saved = 0;
+        undo_op->group = op->group;
 
         if (op->line) {
             undo_op->line = malloc(op->line_size + 1);
@@ -1225,9 +1772,7 @@ void pleditor_apply_redo(pleditor_state *state) {
                 row->chars[state->cx] = op->character;
                 pleditor_update_row(state, row);
 
-                if (state->syntax) {
-                    pleditor_syntax_update_multiline(state, state->cy);
-                }
+                pleditor_syntax_invalidate(state, state->cy);
 
                 state->cx++;
                 state->dirty = true;
@@ -1272,9 +1817,7 @@ void pleditor_apply_redo(pleditor_state *state) {
                     row->size--;
                     pleditor_update_row(state, row);
                     state->dirty = true;
-                    if (state->syntax) {
-                        pleditor_syntax_update_multiline(state, state->cy);
-                    }
+                    pleditor_syntax_invalidate(state, state->cy);
                 }
             }
             break;
@@ -1304,10 +1847,7 @@ void pleditor_apply_redo(pleditor_state *state) {
                     row->chars[op->cx] = '\0';
                     pleditor_update_row(state, row);
 
-                    if (state->syntax) {
-                        pleditor_syntax_update_row(state, state->cy);
-                        pleditor_syntax_update_row(state, state->cy + 1);
-                    }
+                    pleditor_syntax_invalidate(state, state->cy);
 
                     /* Move cursor to beginning of next line */
                     state->cy++;
@@ -1360,9 +1900,7 @@ void pleditor_apply_redo(pleditor_state *state) {
                     pleditor_update_row(state, prev_row);
 
                     /* Update syntax highlighting for the next row and all affected rows */
-                    if (state->syntax) {
-                        pleditor_syntax_update_multiline(state, state->cy - 1);
-                    }
+                    pleditor_syntax_invalidate(state, state->cy - 1);
 
                     /* Delete the line */
                     pleditor_delete_row(state, state->cy);
@@ -1383,6 +1921,22 @@ void pleditor_apply_redo(pleditor_state *state) {
                 state->dirty = true;
             }
             break;
+
+        case OP_REPLACE_ROWS:
+            /* Replace again by swapping back the text the replace made */
+            pleditor_replace_swap(state, op->saved, op->num_saved);
+            state->cx = op->cx;
+            state->cy = op->cy;
+            if (state->cy < state->num_rows && state->cx > state->rows[state->cy].size) {
+                state->cx = state->rows[state->cy].size;
+            }
+            if (undo_op) {
+                undo_op->saved = op->saved;
+                undo_op->num_saved = op->num_saved;
+                op->saved = NULL;
+                op->num_saved = 0;
+            }
+            break;
     }
 
     /* Clear the redoing flag */
@@ -1390,34 +1944,547 @@ void pleditor_apply_redo(pleditor_state *state) {
 
     /* Free the redo operation */
     if (op->line) free(op->line);
+    pleditor_replace_free_saved(op->saved, op->num_saved);
     free(op);
+}
+
+void pleditor_apply_redo(pleditor_state *state) {
+    if (!state->redo_stack) {
+        pleditor_set_status_message(state, "Nothing to redo");
+        return;
+    }
+
+    int group = state->undo_group ? 0 : state->redo_stack->group;
+    do {
+        pleditor_redo_operation(state);
+    } while (group && state->redo_stack && state->redo_stack->group == group);
 
     pleditor_set_status_message(state, "Redo successful");
 }
 
+/* Replace the search query, compiling the first len bytes of it. An invalid
+ * expression is kept, matching nothing, while it is being typed */
+static bool pleditor_search_set_query(pleditor_state *state, const char *query, int len) {
+    char *copy = malloc(strlen(query) + 1);
+    if (!copy) return false;
+    strcpy(copy, query);
+
+    if (!pleditor_search_compile(&state->search_pattern, query, len, state->search_flags)) {
+        free(copy);
+        return false;
+    }
+
+    free(state->search_query);
+    state->search_query = copy;
+    return true;
+}
+
+/* Put the cursor on a match and scroll it into view */
+static void pleditor_search_show(pleditor_state *state, int row, int col) {
+    state->cy = row;
+    state->cx = col;
+
+    /* Save the match position */
+    state->last_match_row = row;
+    state->last_match_col = col;
+
+    /* Ensure the match is visible on screen */
+    state->row_offset = state->cy - (state->screen_rows / 2);
+    if (state->row_offset < 0) state->row_offset = 0;
+}
+
+/* Rows searched on the calling thread before the rest is split up */
+#define SEARCH_PARALLEL_MIN_ROWS 4096
+
+/* Rows some number of steps away from a starting row, wrapping around the
+ * file, split into equal chunks searched one per thread. Each chunk stops
+ * at its first match, or once an earlier chunk has found one */
+typedef struct search_parallel_job {
+    const pleditor_search_pattern *pattern;
+    pleditor_search_pattern *patterns; /* A copy of pattern for each chunk */
+    const pleditor_row *rows;
+    int num_rows;
+    int start_row;
+    enum pleditor_search_direction direction;
+    int begin, end;             /* Steps to search */
+    int chunks;
+    _Atomic bool *found;        /* Chunks that have found a match */
+    pleditor_search_step *matches; /* The match found by each chunk */
+} search_parallel_job;
+
+/* Row searched at a step away from start_row */
+static int search_step_row(const search_parallel_job *job, int step) {
+    if (job->direction == SEARCH_FORWARD) return (job->start_row + step) % job->num_rows;
+    return (job->start_row - step % job->num_rows + job->num_rows) % job->num_rows;
+}
+
+/* First match in a whole row in the search direction, or -1 */
+static int search_whole_row(const search_parallel_job *job, const pleditor_search_pattern *pattern,
+                            const pleditor_row *row) {
+    if (job->direction == SEARCH_FORWARD) {
+        return pleditor_search_forward(pattern, row->chars, row->size, 0);
+    }
+    return pleditor_search_backward(pattern, row->chars, row->size, row->size);
+}
+
+/* Search the steps from begin to end in order */
+static bool search_steps(const search_parallel_job *job, int begin, int end, pleditor_search_step *match) {
+    for (int step = begin; step < end; step++) {
+        int row = search_step_row(job, step);
+        int col = search_whole_row(job, job->pattern, &job->rows[row]);
+        if (col >= 0) {
+            match->row = row;
+            match->col = col;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Search one chunk, giving up once an earlier chunk has a match */
+static void search_chunk(int index, void *arg) {
+    search_parallel_job *job = arg;
+    long long total = job->end - job->begin;
+    int from = job->begin + (int)(total * index / job->chunks);
+    int to = job->begin + (int)(total * (index + 1) / job->chunks);
+
+    for (int step = from; step < to; step++) {
+        for (int i = 0; i < index; i++) {
+            if (atomic_load_explicit(&job->found[i], memory_order_acquire)) return;
+        }
+
+        int row = search_step_row(job, step);
+        int col = search_whole_row(job, &job->patterns[index], &job->rows[row]);
+        if (col >= 0) {
+            job->matches[index].row = row;
+            job->matches[index].col = col;
+            atomic_store_explicit(&job->found[index], true, memory_order_release);
+            return;
+        }
+    }
+}
+
 /**
- * Initialize search mode with a prompt for the query
+ * Find the first match of the task's pattern in the whole rows begin to
+ * end steps away from its starting row in its direction. The nearest rows
+ * are searched first on this thread, as the match is usually close; the
+ * rest are split between threads and the match of the nearest chunk that
+ * has one wins
  */
-void pleditor_search_init(pleditor_state *state) {
-    char *query = pleditor_prompt(state, "Searching");
-    if (query == NULL) {
+static bool pleditor_search_rows(pleditor_state *state, int begin, int end, pleditor_search_step *match) {
+    pleditor_search_task *task = &state->search_task;
+    search_parallel_job job = {
+        .pattern = &task->pattern,
+        .rows = state->rows,
+        .num_rows = state->num_rows,
+        .start_row = task->start_row,
+        .direction = task->direction,
+        .begin = begin,
+        .end = end,
+    };
+
+    int near_end = job.end;
+    if (near_end > job.begin + SEARCH_PARALLEL_MIN_ROWS) near_end = job.begin + SEARCH_PARALLEL_MIN_ROWS;
+    if (search_steps(&job, job.begin, near_end, match)) return true;
+    job.begin = near_end;
+
+    int chunks = pleditor_platform_cpu_count();
+    if (chunks > (job.end - job.begin) / SEARCH_PARALLEL_MIN_ROWS) {
+        chunks = (job.end - job.begin) / SEARCH_PARALLEL_MIN_ROWS;
+    }
+
+    _Atomic bool *found = (chunks > 1) ? malloc(sizeof(_Atomic bool) * chunks) : NULL;
+    pleditor_search_step *matches = (chunks > 1) ? malloc(sizeof(pleditor_search_step) * chunks) : NULL;
+
+    /* A regular expression's automaton is built as it is used, so each
+     * chunk needs its own; the task keeps them for its later batches */
+    bool result = false;
+    if (found && matches && pleditor_search_clones_reserve(&task->clones, job.pattern, chunks)) {
+        for (int i = 0; i < chunks; i++) {
+            atomic_init(&found[i], false);
+        }
+        job.chunks = chunks;
+        job.found = found;
+        job.matches = matches;
+        job.patterns = task->clones.patterns;
+        pleditor_platform_parallel_for(chunks, search_chunk, &job);
+
+        for (int i = 0; i < chunks; i++) {
+            if (atomic_load_explicit(&found[i], memory_order_relaxed)) {
+                *match = matches[i];
+                result = true;
+                break;
+            }
+        }
+    } else {
+        result = search_steps(&job, job.begin, job.end, match);
+    }
+
+    free(found);
+    free(matches);
+    return result;
+}
+
+/**
+ * Pass over the rows from the task's next step on that the trigram index
+ * rules out. Returns the step after the run of rows from there that it
+ * doesn't, at most num_rows
+ */
+static int pleditor_search_task_skip(pleditor_state *state) {
+    pleditor_search_task *task = &state->search_task;
+    int n = state->num_rows;
+    int end;
+
+    if (task->direction == SEARCH_FORWARD) {
+        int row = (task->start_row + task->step) % n;
+        int next = pleditor_trigram_next(state, &task->pattern, row, &end);
+        task->step += next - row;
+        end = task->step + (end - next);
+    } else {
+        int row = (task->start_row - task->step + n) % n;
+        int prev = pleditor_trigram_prev(state, &task->pattern, row, &end);
+        task->step += row - prev;
+        end = task->step + (prev - end + 1);
+    }
+
+    /* Rows past the end of the file were skipped up to its last one */
+    if (task->step > n) task->step = n;
+    return (end < n) ? end : n;
+}
+
+/**
+ * Search the task's next part of the file for up to one slice of time.
+ * Step 0 is the starting row on from start_col (going forward) or before
+ * it (going back); steps 1 to num_rows - 1 are the other rows, wrapping
+ * around the file; step num_rows is the rest of the starting row. Returns
+ * true once the search is over, with match row -1 if nothing matched
+ */
+static bool pleditor_search_task_run(pleditor_state *state, pleditor_search_step *match) {
+    pleditor_search_task *task = &state->search_task;
+    bool forward = task->direction == SEARCH_FORWARD;
+    pleditor_row *row = &state->rows[task->start_row];
+    match->row = -1;
+    match->col = -1;
+
+    if (task->step == 0) {
+        task->step = 1;
+        if (forward && task->start_col <= row->size) {
+            match->col = pleditor_search_forward(&task->pattern, row->chars, row->size, task->start_col);
+        } else if (!forward && task->start_col > 0) {
+            match->col = pleditor_search_backward(&task->pattern, row->chars, row->size, task->start_col - 1);
+        }
+        if (match->col >= 0) {
+            match->row = task->start_row;
+            return true;
+        }
+    }
+
+    long long until = pleditor_platform_time_ms() + PLEDITOR_SEARCH_SLICE_MS;
+    int rows = SEARCH_PARALLEL_MIN_ROWS * pleditor_platform_cpu_count();
+    while (task->step < state->num_rows) {
+        int end = pleditor_search_task_skip(state);
+        if (task->step == state->num_rows) break;
+        if (end > task->step + rows) end = task->step + rows;
+        if (pleditor_search_rows(state, task->step, end, match)) return true;
+        task->step = end;
+        if (pleditor_platform_time_ms() >= until) return false;
+    }
+
+    /* Back around to the rest of the starting row */
+    int col = forward ? pleditor_search_forward(&task->pattern, row->chars, row->size, 0)
+                      : pleditor_search_backward(&task->pattern, row->chars, row->size, row->size);
+    if (col >= 0) {
+        match->row = task->start_row;
+        match->col = col;
+    }
+    return true;
+}
+
+/* Free the task's pattern and its copies */
+static void pleditor_search_task_free(pleditor_search_task *task) {
+    pleditor_search_free_pattern(&task->pattern);
+    pleditor_search_clones_free(&task->clones);
+}
+
+/* Stop a search going on between events, leaving a prefix it was for to
+ * be searched again */
+void pleditor_search_cancel(pleditor_state *state) {
+    pleditor_search_task *task = &state->search_task;
+    if (!task->running) return;
+
+    pleditor_isearch *isearch = &state->isearch;
+    if (task->isearch_step >= 0 && task->isearch_step < isearch->num_steps &&
+        isearch->steps[task->isearch_step].row == -3) {
+        isearch->steps[task->isearch_step].row = -2;
+    }
+    task->running = false;
+    pleditor_search_task_free(task);
+}
+
+/**
+ * Search the file from start_row, start_col in a direction and move to the
+ * match. A search that doesn't finish in its first slice of time goes on
+ * between events, and its match is row -3 for now; isearch_step is the
+ * prefix of the query being typed the match is for, or -1
+ */
+static pleditor_search_step pleditor_search_start(pleditor_state *state, int start_row, int start_col,
+                                                  enum pleditor_search_direction direction, int isearch_step) {
+    pleditor_search_task *task = &state->search_task;
+    pleditor_search_step match = {-1, -1};
+    pleditor_search_cancel(state);
+    if (state->num_rows == 0) return match;
+
+    /* Past the last row, the file starts over */
+    if (start_row >= state->num_rows) {
+        start_row = 0;
+        start_col = 0;
+    }
+    if (!pleditor_search_clone(&task->pattern, &state->search_pattern)) return match;
+    task->running = true;
+    task->direction = direction;
+    task->start_row = start_row;
+    task->start_col = start_col;
+    task->step = 0;
+    task->isearch_step = isearch_step;
+
+    /* The keys of a macro being replayed depend on where it finishes */
+    bool done = pleditor_search_task_run(state, &match);
+    while (!done && state->macro.replaying) done = pleditor_search_task_run(state, &match);
+    if (!done) {
+        pleditor_search_schedule(state);
+        match.row = -3;
+        return match;
+    }
+
+    task->running = false;
+    pleditor_search_task_free(task);
+    if (match.row != -1) pleditor_search_show(state, match.row, match.col);
+    return match;
+}
+
+/* Tell how a search for the next or previous match went */
+static void pleditor_search_report(pleditor_state *state, pleditor_search_step match) {
+    if (match.row == -3) {
+        pleditor_set_status_message(state, "Searching for '%s'... Esc to cancel", state->search_query);
+    } else if (match.row != -1) {
+        pleditor_set_status_message(state, "Match found ('%s'). Ctrl-N for next, Ctrl-P for previous.",
+                                 state->search_query);
+    } else {
+        pleditor_set_status_message(state, "No match found for '%s'", state->search_query);
+
+        /* Reset last match position */
+        state->last_match_row = -1;
+        state->last_match_col = -1;
+    }
+}
+
+/* Go back to where the search started */
+static void pleditor_isearch_restore(pleditor_state *state) {
+    pleditor_isearch *isearch = &state->isearch;
+    state->cy = isearch->origin_cy;
+    state->cx = isearch->origin_cx;
+    state->row_offset = isearch->origin_row_offset;
+    state->col_offset = isearch->origin_col_offset;
+    state->last_match_row = -1;
+    state->last_match_col = -1;
+}
+
+/* Show the match of the first len bytes of the query being typed, or where
+ * the search started if there is none. The cursor stays put while the
+ * query is still being searched for */
+static void pleditor_isearch_show(pleditor_state *state, int len) {
+    pleditor_isearch *isearch = &state->isearch;
+    int row = (len > 0) ? isearch->steps[len - 1].row : -1;
+
+    if (row >= 0) {
+        pleditor_search_show(state, row, isearch->steps[len - 1].col);
+    } else if (row != -3) {
+        pleditor_isearch_restore(state);
+    }
+}
+
+/* Run a slice of search work: the search for the next match if one is
+ * going on, otherwise indexing every match */
+static void pleditor_search_work(pleditor_state *state, void *data) {
+    (void)data;
+    pleditor_search_task *task = &state->search_task;
+    state->search_timer = -1;
+
+    if (task->running) {
+        pleditor_search_step match;
+        if (pleditor_search_task_run(state, &match)) {
+            int step = task->isearch_step;
+            task->running = false;
+            pleditor_search_task_free(task);
+
+            if (step >= 0) {
+                /* Still typing: the match is for the query's last prefix */
+                state->isearch.steps[step] = match;
+                pleditor_isearch_show(state, step + 1);
+            } else {
+                if (match.row != -1) pleditor_search_show(state, match.row, match.col);
+                pleditor_search_report(state, match);
+            }
+        }
+    } else if (state->is_searching) {
+        pleditor_match_continue(state);
+    }
+    pleditor_search_schedule(state);
+}
+
+/* Run the next slice of search work once pending events are handled, if
+ * there is any */
+static void pleditor_search_schedule(pleditor_state *state) {
+    bool work = state->search_task.running || (state->is_searching && state->matches.building);
+    if (work && state->search_timer == -1) {
+        /* A millisecond's wait lets the screen be drawn between slices */
+        state->search_timer = pleditor_add_timer(state, 1, false, pleditor_search_work, NULL);
+    }
+}
+
+/* Record where the next prefix of the query matched */
+static bool pleditor_isearch_push(pleditor_isearch *isearch, int row, int col) {
+    if (isearch->num_steps == isearch->steps_cap) {
+        int cap = isearch->steps_cap ? isearch->steps_cap * 2 : 16;
+        pleditor_search_step *steps = realloc(isearch->steps, sizeof(pleditor_search_step) * cap);
+        if (!steps) return false;
+        isearch->steps = steps;
+        isearch->steps_cap = cap;
+    }
+    isearch->steps[isearch->num_steps].row = row;
+    isearch->steps[isearch->num_steps].col = col;
+    isearch->num_steps++;
+    return true;
+}
+
+/**
+ * Search prompt callback: move to the query typed so far. A match of a
+ * longer query is also a match of each of its prefixes, so it can't come
+ * before where the prefix matched; each added character continues from
+ * there, and none is searched for once a prefix has no match. Deleting a
+ * character returns to where the shorter prefix matched without searching.
+ * None of that holds for regular expressions or whole words, which are
+ * searched for from the start each time; prefixes typed past are only
+ * searched once returned to. A search that goes on between events is
+ * dropped when the query changes. Alt-R, Alt-C and Alt-W toggle regular
+ * expressions, ignoring case and whole words.
+ */
+static void pleditor_isearch_update(pleditor_state *state, const char *input, int key) {
+    pleditor_isearch *isearch = &state->isearch;
+    int len = (int)strlen(input);
+
+    /* Only keys change the query */
+    if (key == PLEDITOR_KEY_REFRESH) return;
+
+    int toggle = 0;
+    if (key == PLEDITOR_KEY_SEARCH_REGEX) toggle = PLEDITOR_SEARCH_REGEX;
+    if (key == PLEDITOR_KEY_SEARCH_CASE) toggle = PLEDITOR_SEARCH_IGNORE_CASE;
+    if (key == PLEDITOR_KEY_SEARCH_WORD) toggle = PLEDITOR_SEARCH_WHOLE_WORD;
+    if (toggle) {
+        state->search_flags ^= toggle;
+        isearch->num_steps = 0;
+    }
+    /* Whether each query is searched for from the start */
+    bool restart = state->search_flags & (PLEDITOR_SEARCH_REGEX | PLEDITOR_SEARCH_WHOLE_WORD);
+
+    /* Ctrl-N and Ctrl-P move between matches while typing */
+    if (key == PLEDITOR_CTRL_KEY('n') || key == PLEDITOR_CTRL_KEY('p')) {
+        if (len == 0 || len > isearch->num_steps || isearch->steps[len - 1].row < 0) return;
+        if (key == PLEDITOR_CTRL_KEY('n')) {
+            pleditor_search_next(state);
+        } else {
+            pleditor_search_previous(state);
+        }
+
+        /* Typing more continues from the match moved to */
+        if (state->search_task.running) {
+            state->search_task.isearch_step = len - 1;
+            isearch->steps[len - 1].row = -3;
+        } else {
+            isearch->steps[len - 1].row = state->last_match_row;
+            isearch->steps[len - 1].col = state->last_match_col;
+        }
         return;
     }
 
-    /* Free any existing search query */
-    if (state->search_query) {
-        free(state->search_query);
+    pleditor_search_cancel(state);
+    if (isearch->num_steps > len) isearch->num_steps = len;
+    if (len > 0 && isearch->num_steps == len && isearch->steps[len - 1].row == -2) {
+        isearch->num_steps--;
+    }
+
+    while (isearch->num_steps < len) {
+        int prefix = isearch->num_steps + 1;
+        int row = -1, col = -1;
+
+        /* A prefix before this one may still be being searched */
+        pleditor_search_cancel(state);
+
+        if (restart && prefix < len) {
+            /* Not searched */
+            row = -2;
+        } else if (restart || prefix == 1 || isearch->steps[prefix - 2].row != -1) {
+            bool from_origin = restart || prefix == 1 || isearch->steps[prefix - 2].row == -2;
+            int start_row = from_origin ? isearch->origin_cy : isearch->steps[prefix - 2].row;
+            int start_col = from_origin ? isearch->origin_cx + 1 : isearch->steps[prefix - 2].col;
+            if (!pleditor_search_compile(&state->search_pattern, input, prefix, state->search_flags)) return;
+            pleditor_search_step match = pleditor_search_start(state, start_row, start_col,
+                                                               SEARCH_FORWARD, prefix - 1);
+            row = match.row;
+            col = match.col;
+        }
+        if (!pleditor_isearch_push(isearch, row, col)) return;
     }
 
-    /* Save the search query and initialize search state */
-    state->search_query = query;
+    if (!pleditor_search_set_query(state, input, len)) return;
+
+    /* Show the match of the whole query, or where the search started */
+    pleditor_isearch_show(state, len);
+}
+
+/**
+ * Initialize search mode with a prompt for the query. The cursor follows
+ * the first match as the query is typed; Escape returns it to where the
+ * search started
+ */
+void pleditor_search_init(pleditor_state *state) {
+    pleditor_isearch *isearch = &state->isearch;
+    isearch->origin_cy = state->cy;
+    isearch->origin_cx = state->cx;
+    isearch->origin_row_offset = state->row_offset;
+    isearch->origin_col_offset = state->col_offset;
+    isearch->num_steps = 0;
+
     state->is_searching = true;
     state->last_match_row = -1;
     state->last_match_col = -1;
     state->search_direction = SEARCH_FORWARD;
 
-    /* Perform initial search */
-    pleditor_search_next(state);
+    char *query = pleditor_prompt(state, "Searching", pleditor_isearch_update);
+    if (query == NULL) {
+        /* Cancelled: go back to where the search started */
+        pleditor_search_cancel(state);
+        pleditor_isearch_restore(state);
+        state->is_searching = false;
+        pleditor_match_free(&state->matches);
+        return;
+    }
+    free(query);
+
+    if (state->search_pattern.error) {
+        pleditor_set_status_message(state, "Invalid pattern '%s': %s", state->search_query,
+                                    state->search_pattern.error);
+    } else if (state->search_task.running) {
+        /* Moved to and reported once it finishes */
+        state->search_task.isearch_step = -1;
+        pleditor_isearch_restore(state);
+        pleditor_search_report(state, (pleditor_search_step){-3, -1});
+    } else if (state->last_match_row != -1) {
+        pleditor_set_status_message(state, "Match found ('%s'). Ctrl-N for next, Ctrl-P for previous.",
+                                 state->search_query);
+    } else {
+        pleditor_set_status_message(state, "No match found for '%s'", state->search_query);
+    }
 }
 
 /**
@@ -1434,49 +2501,22 @@ void pleditor_search_next(pleditor_state *state) {
     int start_row = (state->last_match_row == -1) ? state->cy : state->last_match_row;
     int start_col = (state->last_match_col == -1) ? state->cx + 1 : state->last_match_col + 1;
 
-    /* Loop through rows starting from the current position */
-    for (int i = 0; i < state->num_rows; i++) {
-        int current_row = (start_row + i) % state->num_rows;
-        pleditor_row *row = &state->rows[current_row];
-
-        /* If we've wrapped around to the first row, make sure we start from beginning */
-        int col_offset = (i == 0) ? start_col : 0;
-
-        if (col_offset > row->size) {
-            /* If we're beyond the end of this row, move to the next one */
-            continue;
-        }
-
-        /* Look for the search term in this row */
-        char *match = strstr(row->chars + col_offset, state->search_query);
-        if (match) {
-            /* Found a match! */
-            int match_col = match - row->chars;
-
-            /* Update cursor position to the match */
-            state->cy = current_row;
-            state->cx = match_col;
-
-            /* Save the match position */
-            state->last_match_row = current_row;
-            state->last_match_col = match_col;
-
-            /* Ensure the match is visible on screen */
-            state->row_offset = state->cy - (state->screen_rows / 2);
-            if (state->row_offset < 0) state->row_offset = 0;
-
-            pleditor_set_status_message(state, "Match found ('%s'). Ctrl-N for next, Ctrl-P for previous.",
-                                     state->search_query);
-            return;
+    pleditor_search_step match = {-1, -1};
+    if (pleditor_search_index(state) && state->matches.valid) {
+        /* The first match from the start on, or else the first of all */
+        pleditor_match_index *index = &state->matches;
+        if (index->num_matches > 0) {
+            int i = pleditor_match_find(index, start_row, start_col);
+            if (i == index->num_matches) i = 0;
+            match.row = index->matches[i].row;
+            match.col = index->matches[i].col;
+            pleditor_search_show(state, match.row, match.col);
         }
+    } else {
+        /* Until every match is indexed, scan the rows */
+        match = pleditor_search_start(state, start_row, start_col, SEARCH_FORWARD, -1);
     }
-
-    /* No match found */
-    pleditor_set_status_message(state, "No match found for '%s'", state->search_query);
-
-    /* Reset last match position */
-    state->last_match_row = -1;
-    state->last_match_col = -1;
+    pleditor_search_report(state, match);
 }
 
 /**
@@ -1489,74 +2529,40 @@ void pleditor_search_previous(pleditor_state *state) {
 
     state->search_direction = SEARCH_BACKWARD;
 
-    /* Store current state to restore if no match is found */
-    int original_cy = state->cy;
-    int original_cx = state->cx;
-
-    /* Start searching from one character before current position */
+    /* Matches must start before the current position or the last match */
     int start_row = (state->last_match_row == -1) ? state->cy : state->last_match_row;
-    int start_col = (state->last_match_col == -1 || state->last_match_col == 0) ?
-                    ((start_row > 0) ? state->rows[start_row-1].size : 0) :
-                    state->last_match_col - 1;
+    int start_col = (state->last_match_col == -1) ? state->cx : state->last_match_col;
 
-    /* If we're at the beginning of the file, wrap to the end */
-    if (start_row == 0 && start_col == 0) {
+    /* Past the last row, everything in the file comes before */
+    if (start_row >= state->num_rows && state->num_rows > 0) {
         start_row = state->num_rows - 1;
-        start_col = state->rows[start_row].size;
+        start_col = state->rows[start_row].size + 1;
     }
 
-    /* Loop through rows in reverse */
-    for (int i = 0; i < state->num_rows; i++) {
-        int current_row = (start_row - i + state->num_rows) % state->num_rows;
-        pleditor_row *row = &state->rows[current_row];
-
-        /* For the first row, start from the specified column */
-        int search_limit = (i == 0) ? start_col : row->size;
-
-        /* Search backward in this row */
-        int match_col = -1;
-        if ((size_t)search_limit >= strlen(state->search_query)) {
-            for (size_t j = 0; j <= (size_t)(search_limit - strlen(state->search_query)); j++) {
-                if (strncmp(row->chars + j, state->search_query, strlen(state->search_query)) == 0) {
-                    match_col = (int)j;
-                }
-            }
-        }
-
-        if (match_col != -1) {
-            /* Found a match! */
-            state->cy = current_row;
-            state->cx = match_col;
-
-            /* Save the match position */
-            state->last_match_row = current_row;
-            state->last_match_col = match_col;
-
-            /* Ensure the match is visible on screen */
-            state->row_offset = state->cy - (state->screen_rows / 2);
-            if (state->row_offset < 0) state->row_offset = 0;
-
-            pleditor_set_status_message(state, "Match found ('%s'). Ctrl-N for next, Ctrl-P for previous.",
-                                     state->search_query);
-            return;
+    pleditor_search_step match = {-1, -1};
+    if (pleditor_search_index(state) && state->matches.valid) {
+        /* The last match before the start, or else the last of all */
+        pleditor_match_index *index = &state->matches;
+        if (index->num_matches > 0) {
+            int i = pleditor_match_find(index, start_row, start_col) - 1;
+            if (i < 0) i = index->num_matches - 1;
+            match.row = index->matches[i].row;
+            match.col = index->matches[i].col;
+            pleditor_search_show(state, match.row, match.col);
         }
+    } else {
+        /* Until every match is indexed, scan the rows */
+        match = pleditor_search_start(state, start_row, start_col, SEARCH_BACKWARD, -1);
     }
-
-    /* No match found, restore original position */
-    state->cy = original_cy;
-    state->cx = original_cx;
-
-    pleditor_set_status_message(state, "No match found for '%s'", state->search_query);
-
-    /* Reset last match position */
-    state->last_match_row = -1;
-    state->last_match_col = -1;
+    pleditor_search_report(state, match);
 }
 
 /**
  * Exit search mode
  */
 void pleditor_search_exit(pleditor_state *state) {
+    pleditor_search_cancel(state);
     state->is_searching = false;
+    pleditor_match_free(&state->matches);
     pleditor_set_status_message(state, "Search exited");
 }
@@ -8,17 +8,48 @@
 #include <string.h>
 #include <stdbool.h>
 #include "syntax.h"
+#include "output.h"
+#include "macro.h"
+#include "bracket.h"
+#include "search.h"
+#include "match.h"
+#include "trigram.h"
+#include "replace.h"
 
 /* Editor config */
 #define PLEDITOR_VERSION "0.1.0"
 #define PLEDITOR_TAB_STOP 4
 #define PLEDITOR_QUIT_CONFIRM_TIMES 3
+#define PLEDITOR_ESCAPE_TIMEOUT_MS 25
+#define PLEDITOR_SEARCH_SLICE_MS 20 /* Longest a search runs between events */
 
 /* Key definitions */
 #define PLEDITOR_CTRL_KEY(k) ((k) & 0x1f)
 #define PLEDITOR_KEY_ESC '\x1b'
 #define PLEDITOR_KEY_BACKSPACE 127
 
+/* Modifier bits combined with key codes (e.g. Ctrl-Right, Alt-x) */
+#define PLEDITOR_MOD_SHIFT 0x10000
+#define PLEDITOR_MOD_ALT 0x20000
+#define PLEDITOR_MOD_CTRL 0x40000
+#define PLEDITOR_MOD_MASK (PLEDITOR_MOD_SHIFT | PLEDITOR_MOD_ALT | PLEDITOR_MOD_CTRL)
+#define PLEDITOR_KEY_BASE(k) ((k) & ~PLEDITOR_MOD_MASK)
+
+/* Keyboard macro commands */
+#define PLEDITOR_KEY_MACRO_RECORD PLEDITOR_F3  /* Start/stop recording */
+#define PLEDITOR_KEY_MACRO_RUN PLEDITOR_F4     /* Replay once */
+#define PLEDITOR_KEY_MACRO_REPEAT PLEDITOR_F5  /* Replay N times */
+#define PLEDITOR_KEY_MACRO_LINES PLEDITOR_F6   /* Replay on each line of a range */
+
+/* Search and replace commands */
+#define PLEDITOR_KEY_REPLACE_ALL PLEDITOR_F7   /* Replace everywhere */
+#define PLEDITOR_KEY_REPLACE_LINES PLEDITOR_F8 /* Replace in a range of lines */
+
+/* Search prompt commands */
+#define PLEDITOR_KEY_SEARCH_REGEX (PLEDITOR_MOD_ALT | 'r') /* Toggle regular expressions */
+#define PLEDITOR_KEY_SEARCH_CASE (PLEDITOR_MOD_ALT | 'c')  /* Toggle ignoring case */
+#define PLEDITOR_KEY_SEARCH_WORD (PLEDITOR_MOD_ALT | 'w')  /* Toggle whole words */
+
 /* Special key codes */
 enum pleditor_key {
     PLEDITOR_KEY_ERR = -1,
@@ -31,20 +62,92 @@ enum pleditor_key {
     PLEDITOR_HOME_KEY,
     PLEDITOR_END_KEY,
     PLEDITOR_DEL_KEY,
+    PLEDITOR_F1,
+    PLEDITOR_F2,
+    PLEDITOR_F3,
+    PLEDITOR_F4,
+    PLEDITOR_F5,
+    PLEDITOR_F6,
+    PLEDITOR_F7,
+    PLEDITOR_F8,
+    PLEDITOR_F9,
+    PLEDITOR_F10,
+    PLEDITOR_F11,
+    PLEDITOR_F12,
+    PLEDITOR_KEY_REFRESH,   /* No key: the screen should be redrawn */
 };
 
+/* Events delivered by the platform event loop */
+enum pleditor_event_type {
+    PLEDITOR_EVENT_NONE,    /* Timed out with nothing to report */
+    PLEDITOR_EVENT_KEY,     /* A key was pressed */
+    PLEDITOR_EVENT_RESIZE,  /* The terminal changed size */
+    PLEDITOR_EVENT_TIMER,   /* A timer expired */
+    PLEDITOR_EVENT_WORKER,  /* Background work finished */
+    PLEDITOR_EVENT_REDRAW   /* Output drained after a frame was skipped */
+};
+
+/* Event structure */
+typedef struct pleditor_event {
+    enum pleditor_event_type type;
+    int key;           /* Key code for key events */
+    int id;            /* Timer or worker id */
+    void *data;        /* Result of background work */
+} pleditor_event;
+
+/* Callback run on the main thread when a timer expires or work finishes */
+typedef void (*pleditor_callback)(pleditor_state *state, void *data);
+
+/* Registered timer or background work */
+typedef struct pleditor_handler {
+    enum pleditor_event_type type; /* PLEDITOR_EVENT_TIMER or PLEDITOR_EVENT_WORKER */
+    int id;            /* Timer or worker id */
+    bool repeat;       /* Timer fires more than once */
+    pleditor_callback callback;
+    void *data;        /* Passed to timer callbacks */
+} pleditor_handler;
+
 /* Direction for search */
 enum pleditor_search_direction {
     SEARCH_FORWARD,
     SEARCH_BACKWARD
 };
 
+/* Where an incremental search found one prefix of the query */
+typedef struct pleditor_search_step {
+    int row, col;      /* Match position; row -1 if the prefix doesn't occur,
+                          -2 if it wasn't searched, -3 while it is being */
+} pleditor_search_step;
+
+/* A search for the next match that goes on a slice of time at a time
+ * between events, so the editor keeps responding while it scans */
+typedef struct pleditor_search_task {
+    bool running;
+    pleditor_search_pattern pattern; /* Query searched for */
+    pleditor_search_clones clones;   /* Copies of pattern for parallel chunks */
+    enum pleditor_search_direction direction;
+    int start_row, start_col;   /* Where the search started */
+    int step;                   /* Next part of the file to search */
+    int isearch_step;           /* Prefix being typed the match is for, or -1 */
+} pleditor_search_task;
+
+/* Incremental search state while the query is being typed */
+typedef struct pleditor_isearch {
+    int origin_cy, origin_cx;   /* Cursor when the search started */
+    int origin_row_offset;      /* Scroll position when the search started */
+    int origin_col_offset;
+    pleditor_search_step *steps; /* Match of each prefix, by length - 1 */
+    int num_steps;              /* Prefixes searched so far */
+    int steps_cap;              /* Steps allocated */
+} pleditor_isearch;
+
 /* Undo/Redo operation types */
 enum pleditor_operation_type {
     OP_INSERT_CHAR,
     OP_DELETE_CHAR,
     OP_INSERT_LINE,
-    OP_DELETE_LINE
+    OP_DELETE_LINE,
+    OP_REPLACE_ROWS
 };
 
 /* Undo/Redo operation parameters */
@@ -54,6 +157,8 @@ typedef struct pleditor_operation_params {
     int character;     /* Character for insert/delete operations */
     char *line;        /* Line content */
     int line_size;     /* Size of the line */
+    pleditor_saved_row *saved; /* Rows a replace changed, taken over by the operation */
+    int num_saved;     /* Number of saved rows */
 } pleditor_operation_params;
 
 /* Undo/Redo operation structure */
@@ -63,6 +168,9 @@ typedef struct pleditor_operation {
     int character;     /* Character for insert/delete operations */
     char *line;        /* Line content for line operations */
     int line_size;     /* Size of the line */
+    pleditor_saved_row *saved; /* Text of the rows a replace changed */
+    int num_saved;     /* Number of saved rows */
+    int group;         /* Operations sharing a nonzero group are undone together */
     struct pleditor_operation *next;
 } pleditor_operation;
 
@@ -72,7 +180,7 @@ typedef struct pleditor_row {
     char *chars;       /* Raw text content */
     int render_size;   /* Size of the rendered text */
     char *render;      /* Rendered text (with tab expansion) */
-    pleditor_highlight_row *hl; /* Syntax highlighting for this row */
+    pleditor_highlight_row hl; /* Syntax highlighting for this row */
 } pleditor_row;
 
 /* Editor state */
@@ -89,16 +197,34 @@ typedef struct pleditor_state {
     char *filename;          /* Currently open filename */
     char status_msg[80];     /* Status message */
     pleditor_syntax *syntax; /* Current syntax highlighting */
+    int hl_frontier;         /* Rows before this one have current highlighting */
+    pleditor_hl_cache *hl_cache; /* Highlighting of recently lexed row text */
+    pleditor_bracket_index *brackets; /* Bracket counts per row, built on demand */
     bool show_line_numbers;  /* Whether to display line numbers */
     pleditor_operation *undo_stack; /* Stack of undo operations */
     pleditor_operation *redo_stack; /* Stack of redo operations */
     bool should_quit;        /* Flag to indicate editor should exit */
     bool is_unredoing;       /* Flag to prevent recursive undo/redo operations */
+    int undo_group;          /* Group for recorded operations, 0 if none */
+    int next_undo_group;     /* Id for the next undo group */
     bool is_searching;       /* Flag to indicate search mode */
     char *search_query;      /* Current search query */
+    int search_flags;        /* PLEDITOR_SEARCH_* the query is searched with */
+    pleditor_search_pattern search_pattern; /* search_query compiled for matching */
+    pleditor_match_index matches; /* Every match of search_query while searching */
+    pleditor_trigram_index *trigrams; /* Blocks of a large file by trigram, or NULL */
+    bool use_trigrams;       /* Index large files by trigram when opened */
     int last_match_row;      /* Row of the last match found */
     int last_match_col;      /* Column of the last match found */
     enum pleditor_search_direction search_direction; /* Direction for search */
+    pleditor_isearch isearch; /* Search as the query is typed */
+    pleditor_search_task search_task; /* Search going on between events */
+    int search_timer;        /* Timer running the next slice of search work, or -1 */
+    pleditor_output output;  /* Frame output optimizer */
+    pleditor_handler *handlers; /* Pending timers and background work */
+    int num_handlers;        /* Number of pending handlers */
+    int next_worker_id;      /* Id for the next background job */
+    pleditor_macro macro;    /* Keyboard macro */
 } pleditor_state;
 
 /* Function prototypes */
@@ -107,25 +233,47 @@ void pleditor_free(pleditor_state *state);
 bool pleditor_open(pleditor_state *state, const char *filename);
 void pleditor_save(pleditor_state *state);
 
+void pleditor_update_row(pleditor_state *state, pleditor_row *row);
 void pleditor_insert_char(pleditor_state *state, int c);
 void pleditor_delete_char(pleditor_state *state);
 void pleditor_insert_newline(pleditor_state *state);
 
+int pleditor_cx_to_rx(pleditor_row *row, int cx);
+int pleditor_rx_to_cx(pleditor_row *row, int rx);
+
 void pleditor_refresh_screen(pleditor_state *state);
 void pleditor_set_status_message(pleditor_state *state, const char *fmt, ...);
-char* pleditor_prompt(pleditor_state *state, const char *prompt);
+/* Called by a prompt after each key with the input so far */
+typedef void (*pleditor_prompt_callback)(pleditor_state *state, const char *input, int key);
+
+char* pleditor_prompt(pleditor_state *state, const char *prompt, pleditor_prompt_callback callback);
+char* pleditor_prompt_allow_empty(pleditor_state *state, const char *prompt);
+bool pleditor_prompt_range(pleditor_state *state, const char *prompt, int *first, int *last);
 int pleditor_get_line_number_width(pleditor_state *state);
 void pleditor_move_cursor(pleditor_state *state, int key);
+void pleditor_move_word(pleditor_state *state, int key);
 void pleditor_handle_keypress(pleditor_state *state, int c);
+void pleditor_handle_event(pleditor_state *state, const pleditor_event *event);
+int pleditor_read_key(pleditor_state *state);
+void pleditor_update_screen_size(pleditor_state *state);
+
+int pleditor_add_timer(pleditor_state *state, int interval_ms, bool repeat,
+                       pleditor_callback callback, void *data);
+void pleditor_remove_timer(pleditor_state *state, int id);
+bool pleditor_run_worker(pleditor_state *state, void *(*work)(void *arg), void *arg,
+                         pleditor_callback done);
 
 void pleditor_record_operation(pleditor_state *state, const pleditor_operation_params *params);
 void pleditor_apply_undo(pleditor_state *state);
 void pleditor_apply_redo(pleditor_state *state);
 void pleditor_free_operation_stack(pleditor_operation **stack);
+void pleditor_begin_undo_group(pleditor_state *state);
+void pleditor_end_undo_group(pleditor_state *state);
 
 void pleditor_search_init(pleditor_state *state);
 void pleditor_search_next(pleditor_state *state);
 void pleditor_search_previous(pleditor_state *state);
 void pleditor_search_exit(pleditor_state *state);
+void pleditor_search_cancel(pleditor_state *state);
 
 #endif /* PLEDITOR_H */
@@ -0,0 +1,1213 @@
+/**
+ * regex.c - Regular expression matching
+ *
+ * A pattern is parsed into a tree and compiled into two Thompson NFAs, one
+ * for the pattern and one for the pattern reversed. Both are run as DFAs
+ * whose states (sets of NFA states) are built lazily, the first time the
+ * text leads to them, and cached; when the cache grows too large it is
+ * flushed and rebuilt as the text needs it. Each byte of text costs a
+ * table lookup, or at worst one pass over the NFA, whatever the pattern:
+ * there is no backtracking.
+ *
+ * A row is searched from its end back to its start with the reversed
+ * pattern, unanchored, so the DFA accepts right after reading the first
+ * byte of a match: one pass finds every position a match starts at. How
+ * far a match extends is found by running the pattern forward from its
+ * start and keeping the last accepting position (the longest match), so
+ * lazy quantifiers such as *? are rejected rather than matched greedily.
+ *
+ * ^ and $ match two extra input symbols, read before the first and after
+ * the last byte of a row; NFA states that don't wait for them let them
+ * pass. Patterns that could match empty text are rejected, so every match
+ * covers at least one byte.
+ *
+ * Ignoring case, each byte set a pattern names also gets the other case of
+ * its letters, before a class is negated; the automata are unchanged.
+ *
+ * The runs of single bytes that every match must contain, such as "abc"
+ * and "de" in "abc(x|y)def+", are kept with letters lowercased so an index
+ * can rule out text that lacks them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regex.h"
+
+/* Limits on what a pattern may compile to */
+#define REGEX_MAX_INSTS 65536
+#define REGEX_MAX_DEPTH 256
+#define REGEX_MAX_REPEAT 1000
+
+/* DFA states and NFA state list entries cached before a flush */
+#define REGEX_DFA_MAX_STATES 4096
+#define REGEX_DFA_MAX_POOL (1 << 20)
+
+/* DFA state flags */
+#define DFA_ACCEPT 1    /* A match ends at the last symbol read */
+#define DFA_DEAD 2      /* No match can continue */
+
+/* Parse tree node types */
+enum regex_node_type {
+    NODE_EMPTY,         /* Empty text */
+    NODE_SET,           /* One byte of a set */
+    NODE_BOL,           /* Start of the row */
+    NODE_EOL,           /* End of the row */
+    NODE_CAT,           /* The children one after another */
+    NODE_ALT,           /* Any one of the children */
+    NODE_REPEAT         /* The child min to max times */
+};
+
+/* Parse tree node */
+typedef struct regex_node {
+    enum regex_node_type type;
+    int first, count;   /* NODE_CAT, NODE_ALT: children in kids; NODE_REPEAT: child in first */
+    int min, max;       /* NODE_REPEAT: bounds, max -1 for no limit */
+    int set;            /* NODE_SET: the byte set */
+} regex_node;
+
+/* Set of bytes, one bit each */
+typedef struct regex_set {
+    unsigned char bits[32];
+} regex_set;
+
+/* NFA instruction types */
+enum regex_op {
+    INST_SET,           /* Read a byte of set, go to out */
+    INST_BOL,           /* Read the start of row symbol, go to out */
+    INST_EOL,           /* Read the end of row symbol, go to out */
+    INST_SPLIT,         /* Go to both out and out1 */
+    INST_MATCH          /* The pattern has matched */
+};
+
+/* NFA instruction */
+typedef struct regex_inst {
+    unsigned char op;
+    int out, out1;
+    int set;
+} regex_inst;
+
+/* DFA built lazily over one NFA */
+typedef struct regex_dfa {
+    regex_inst *insts;
+    int num_insts;
+    int start;              /* Entry instruction */
+    bool unanchored;        /* The pattern may begin at any position */
+    int width;              /* Input symbols: byte classes, then ^ and $ */
+
+    int num_states;
+    int states_cap;
+    int *trans;             /* Next state by state and symbol, -1 if not built */
+    unsigned char *flags;   /* DFA_ACCEPT, DFA_DEAD */
+    int *list_start;        /* Each state's NFA states, as a range of pool */
+    int *list_len;
+    int *pool;
+    int pool_len;
+    int pool_cap;
+    int *table;             /* Hash table of states by their NFA states */
+    int start_state;        /* State before any input, -1 if not built */
+    int flushes;            /* Times the cache was emptied */
+
+    int *mark;              /* Per instruction: generation it was last added in */
+    int generation;
+    int *stack;             /* Scratch for closures */
+    int *list;
+    int list_len_scratch;
+} regex_dfa;
+
+struct pleditor_regex {
+    regex_set *sets;
+    int num_sets;
+    unsigned char byte_class[256];  /* Bytes no set tells apart share a class */
+    unsigned char class_byte[256];  /* A byte of each class */
+    int num_classes;
+    regex_dfa forward;      /* The pattern, anchored at a match start */
+    regex_dfa reverse;      /* The pattern reversed, unanchored */
+    int *starts;            /* Scratch for the starts found in a row */
+    int starts_cap;
+    char *required;         /* Runs every match contains, each ended by '\n' */
+    int required_len;
+};
+
+/* Hash table size; a power of two comfortably above the states cached */
+#define REGEX_DFA_TABLE_SIZE (REGEX_DFA_MAX_STATES * 4)
+
+/* Parser state */
+typedef struct regex_parser {
+    const char *p, *end;
+    regex_node *nodes;
+    int num_nodes, nodes_cap;
+    int *kids;
+    int num_kids, kids_cap;
+    regex_set *sets;
+    int num_sets, sets_cap;
+    int depth;
+    bool ignore_case;       /* Sets get both cases of their letters */
+    const char *error;
+} regex_parser;
+
+/* A list of node indexes being collected */
+typedef struct regex_list {
+    int *items;
+    int count, cap;
+} regex_list;
+
+static bool set_has(const regex_set *set, unsigned char c) {
+    return (set->bits[c >> 3] >> (c & 7)) & 1;
+}
+
+static void set_add(regex_set *set, unsigned char c) {
+    set->bits[c >> 3] |= (unsigned char)(1 << (c & 7));
+}
+
+static void set_add_range(regex_set *set, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) set_add(set, (unsigned char)c);
+}
+
+/* Add the other case of each letter in the set, when ignoring case */
+static void set_fold(const regex_parser *ps, regex_set *set) {
+    if (!ps->ignore_case) return;
+    for (int c = 'a'; c <= 'z'; c++) {
+        int upper = c - 'a' + 'A';
+        if (set_has(set, (unsigned char)c) || set_has(set, (unsigned char)upper)) {
+            set_add(set, (unsigned char)c);
+            set_add(set, (unsigned char)upper);
+        }
+    }
+}
+
+static int parse_fail(regex_parser *ps, const char *error) {
+    if (!ps->error) ps->error = error;
+    return -1;
+}
+
+static bool list_push(regex_list *list, int item) {
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : 8;
+        int *items = realloc(list->items, sizeof(int) * cap);
+        if (!items) return false;
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count++] = item;
+    return true;
+}
+
+static int new_node(regex_parser *ps, enum regex_node_type type) {
+    if (ps->num_nodes == ps->nodes_cap) {
+        int cap = ps->nodes_cap ? ps->nodes_cap * 2 : 32;
+        regex_node *nodes = realloc(ps->nodes, sizeof(regex_node) * cap);
+        if (!nodes) return parse_fail(ps, "Out of memory");
+        ps->nodes = nodes;
+        ps->nodes_cap = cap;
+    }
+    regex_node *node = &ps->nodes[ps->num_nodes];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    return ps->num_nodes++;
+}
+
+/* A NODE_SET node with a new, empty set */
+static int new_set_node(regex_parser *ps) {
+    if (ps->num_sets == ps->sets_cap) {
+        int cap = ps->sets_cap ? ps->sets_cap * 2 : 16;
+        regex_set *sets = realloc(ps->sets, sizeof(regex_set) * cap);
+        if (!sets) return parse_fail(ps, "Out of memory");
+        ps->sets = sets;
+        ps->sets_cap = cap;
+    }
+    int node = new_node(ps, NODE_SET);
+    if (node < 0) return -1;
+    memset(&ps->sets[ps->num_sets], 0, sizeof(regex_set));
+    ps->nodes[node].set = ps->num_sets++;
+    return node;
+}
+
+/* A NODE_CAT or NODE_ALT node over the collected children */
+static int new_group_node(regex_parser *ps, enum regex_node_type type, const regex_list *children) {
+    if (ps->num_kids + children->count > ps->kids_cap) {
+        int cap = ps->kids_cap ? ps->kids_cap : 32;
+        while (cap < ps->num_kids + children->count) cap *= 2;
+        int *kids = realloc(ps->kids, sizeof(int) * cap);
+        if (!kids) return parse_fail(ps, "Out of memory");
+        ps->kids = kids;
+        ps->kids_cap = cap;
+    }
+    int node = new_node(ps, type);
+    if (node < 0) return -1;
+    memcpy(&ps->kids[ps->num_kids], children->items, sizeof(int) * children->count);
+    ps->nodes[node].first = ps->num_kids;
+    ps->nodes[node].count = children->count;
+    ps->num_kids += children->count;
+    return node;
+}
+
+/* Add the bytes of a class escape such as \d to set. Returns false if c
+ * doesn't name a class */
+static bool class_escape(char c, regex_set *set) {
+    regex_set class;
+    memset(&class, 0, sizeof(class));
+
+    switch (c) {
+        case 'd': case 'D':
+            set_add_range(&class, '0', '9');
+            break;
+        case 'w': case 'W':
+            set_add_range(&class, '0', '9');
+            set_add_range(&class, 'A', 'Z');
+            set_add_range(&class, 'a', 'z');
+            set_add(&class, '_');
+            break;
+        case 's': case 'S':
+            set_add(&class, ' ');
+            set_add_range(&class, '\t', '\r');
+            break;
+        default:
+            return false;
+    }
+
+    bool negate = (c == 'D' || c == 'W' || c == 'S');
+    for (int i = 0; i < 32; i++) {
+        set->bits[i] |= negate ? (unsigned char)~class.bits[i] : class.bits[i];
+    }
+    return true;
+}
+
+/* Byte named by an escape that isn't a class, or -1 if there is none */
+static int escape_byte(char c) {
+    switch (c) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+    }
+    if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) return -1;
+    return (unsigned char)c;
+}
+
+/* Parse a bracket expression after its [ */
+static int parse_class(regex_parser *ps) {
+    int node = new_set_node(ps);
+    if (node < 0) return -1;
+    regex_set set;
+    memset(&set, 0, sizeof(set));
+
+    bool negate = ps->p < ps->end && *ps->p == '^';
+    if (negate) ps->p++;
+
+    bool first = true;
+    while (ps->p < ps->end && (*ps->p != ']' || first)) {
+        first = false;
+        int lo = (unsigned char)*ps->p++;
+
+        if (lo == '\\') {
+            if (ps->p == ps->end) return parse_fail(ps, "Trailing backslash");
+            char c = *ps->p++;
+            if (class_escape(c, &set)) continue;
+            lo = escape_byte(c);
+            if (lo < 0) return parse_fail(ps, "Unknown escape");
+        }
+
+        /* A range, unless the - ends the class */
+        int hi = lo;
+        if (ps->p + 1 < ps->end && ps->p[0] == '-' && ps->p[1] != ']') {
+            ps->p++;
+            hi = (unsigned char)*ps->p++;
+            if (hi == '\\') {
+                if (ps->p == ps->end) return parse_fail(ps, "Trailing backslash");
+                hi = escape_byte(*ps->p++);
+                if (hi < 0) return parse_fail(ps, "Invalid range");
+            }
+            if (hi < lo) return parse_fail(ps, "Invalid range");
+        }
+        set_add_range(&set, lo, hi);
+    }
+    if (ps->p == ps->end) return parse_fail(ps, "Missing ]");
+    ps->p++;
+    set_fold(ps, &set);
+
+    regex_set *dst = &ps->sets[ps->nodes[node].set];
+    for (int i = 0; i < 32; i++) {
+        dst->bits[i] = negate ? (unsigned char)~set.bits[i] : set.bits[i];
+    }
+    return node;
+}
+
+static int parse_alt(regex_parser *ps);
+
+/* Parse a single item: a byte, a class, an anchor or a group */
+static int parse_atom(regex_parser *ps) {
+    char c = *ps->p++;
+    int node;
+
+    switch (c) {
+        case '(':
+            if (ps->p + 1 < ps->end && ps->p[0] == '?' && ps->p[1] == ':') ps->p += 2;
+            node = parse_alt(ps);
+            if (node < 0) return -1;
+            if (ps->p == ps->end) return parse_fail(ps, "Missing )");
+            ps->p++;
+            return node;
+
+        case '[':
+            return parse_class(ps);
+
+        case '^':
+            return new_node(ps, NODE_BOL);
+
+        case '$':
+            return new_node(ps, NODE_EOL);
+
+        case '*':
+        case '+':
+        case '?':
+            return parse_fail(ps, "Nothing to repeat");
+
+        case '.':
+            node = new_set_node(ps);
+            if (node >= 0) memset(&ps->sets[ps->nodes[node].set], 0xff, sizeof(regex_set));
+            return node;
+
+        case '\\': {
+            if (ps->p == ps->end) return parse_fail(ps, "Trailing backslash");
+            char e = *ps->p++;
+            node = new_set_node(ps);
+            if (node < 0) return -1;
+            regex_set *set = &ps->sets[ps->nodes[node].set];
+            if (class_escape(e, set)) return node;
+            int byte = escape_byte(e);
+            if (byte < 0) return parse_fail(ps, "Unknown escape");
+            set_add(set, (unsigned char)byte);
+            set_fold(ps, set);
+            return node;
+        }
+
+        default:
+            node = new_set_node(ps);
+            if (node >= 0) {
+                set_add(&ps->sets[ps->nodes[node].set], (unsigned char)c);
+                set_fold(ps, &ps->sets[ps->nodes[node].set]);
+            }
+            return node;
+    }
+}
+
+/* Parse a decimal count at p. Returns -1 if there is none */
+static int parse_count(regex_parser *ps) {
+    if (ps->p == ps->end || *ps->p < '0' || *ps->p > '9') return -1;
+    int n = 0;
+    while (ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9') {
+        if (n <= REGEX_MAX_REPEAT) n = n * 10 + (*ps->p - '0');
+        ps->p++;
+    }
+    return n;
+}
+
+/* Parse {n}, {n,} or {n,m}. Returns 0 and consumes nothing if p isn't at
+ * one, so the { is read as a literal */
+static int parse_bounds(regex_parser *ps, int *min, int *max) {
+    const char *start = ps->p;
+    ps->p++;
+
+    *min = parse_count(ps);
+    *max = *min;
+    if (*min >= 0 && ps->p < ps->end && *ps->p == ',') {
+        ps->p++;
+        *max = parse_count(ps);
+    }
+    if (*min < 0 || ps->p == ps->end || *ps->p != '}') {
+        ps->p = start;
+        return 0;
+    }
+    ps->p++;
+
+    if (*min > REGEX_MAX_REPEAT || *max > REGEX_MAX_REPEAT) return parse_fail(ps, "Repeat count too large");
+    if (*max >= 0 && *max < *min) return parse_fail(ps, "Invalid repeat");
+    return 1;
+}
+
+/* Parse an item and the quantifiers after it */
+static int parse_repeat(regex_parser *ps) {
+    int node = parse_atom(ps);
+
+    while (node >= 0 && ps->p < ps->end) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+            ps->p++;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+            ps->p++;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+            ps->p++;
+        } else if (c == '{') {
+            int found = parse_bounds(ps, &min, &max);
+            if (found < 0) return -1;
+            if (found == 0) break;
+        } else {
+            break;
+        }
+
+        /* Matches always extend as far as they can */
+        if (ps->p < ps->end && *ps->p == '?') return parse_fail(ps, "Lazy quantifiers are not supported");
+
+        int repeat = new_node(ps, NODE_REPEAT);
+        if (repeat < 0) return -1;
+        ps->nodes[repeat].first = node;
+        ps->nodes[repeat].min = min;
+        ps->nodes[repeat].max = max;
+        node = repeat;
+    }
+    return node;
+}
+
+/* Parse items up to a | or ) */
+static int parse_cat(regex_parser *ps) {
+    regex_list items = {0};
+    int node = 0;
+
+    while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+        node = parse_repeat(ps);
+        if (node < 0) break;
+        if (!list_push(&items, node)) {
+            node = parse_fail(ps, "Out of memory");
+            break;
+        }
+    }
+
+    if (node >= 0) {
+        if (items.count == 0) {
+            node = new_node(ps, NODE_EMPTY);
+        } else if (items.count == 1) {
+            node = items.items[0];
+        } else {
+            node = new_group_node(ps, NODE_CAT, &items);
+        }
+    }
+    free(items.items);
+    return node;
+}
+
+/* Parse alternatives separated by | */
+static int parse_alt(regex_parser *ps) {
+    if (++ps->depth > REGEX_MAX_DEPTH) return parse_fail(ps, "Pattern is nested too deeply");
+
+    regex_list branches = {0};
+    int node;
+    for (;;) {
+        node = parse_cat(ps);
+        if (node < 0) break;
+        if (!list_push(&branches, node)) {
+            node = parse_fail(ps, "Out of memory");
+            break;
+        }
+        if (ps->p == ps->end || *ps->p != '|') break;
+        ps->p++;
+    }
+
+    if (node >= 0 && branches.count > 1) {
+        node = new_group_node(ps, NODE_ALT, &branches);
+    }
+    free(branches.items);
+    ps->depth--;
+    return node;
+}
+
+/* NFA under construction */
+typedef struct regex_emitter {
+    const regex_parser *ps;
+    regex_inst *insts;
+    int num_insts, cap;
+    bool reverse;       /* Emit the pattern reversed */
+    const char *error;
+} regex_emitter;
+
+static int new_inst(regex_emitter *em, enum regex_op op, int out, int out1, int set) {
+    if (em->num_insts == REGEX_MAX_INSTS) {
+        em->error = "Pattern is too large";
+        return -1;
+    }
+    if (em->num_insts == em->cap) {
+        int cap = em->cap ? em->cap * 2 : 64;
+        regex_inst *insts = realloc(em->insts, sizeof(regex_inst) * cap);
+        if (!insts) {
+            em->error = "Out of memory";
+            return -1;
+        }
+        em->insts = insts;
+        em->cap = cap;
+    }
+    regex_inst *inst = &em->insts[em->num_insts];
+    inst->op = (unsigned char)op;
+    inst->out = out;
+    inst->out1 = out1;
+    inst->set = set;
+    return em->num_insts++;
+}
+
+/* Emit the instructions for node, continuing at next when it matches.
+ * Returns the entry instruction, or -1 on error */
+static int emit(regex_emitter *em, int node_idx, int next, int depth) {
+    if (depth > REGEX_MAX_DEPTH) {
+        em->error = "Pattern is nested too deeply";
+        return -1;
+    }
+    const regex_node *node = &em->ps->nodes[node_idx];
+    const int *kids = em->ps->kids + node->first;
+
+    switch (node->type) {
+        case NODE_EMPTY:
+            return next;
+
+        case NODE_SET:
+            return new_inst(em, INST_SET, next, -1, node->set);
+
+        case NODE_BOL:
+            return new_inst(em, INST_BOL, next, -1, 0);
+
+        case NODE_EOL:
+            return new_inst(em, INST_EOL, next, -1, 0);
+
+        case NODE_CAT:
+            /* Built from the end, so the last child to match comes first */
+            for (int i = 0; i < node->count && next >= 0; i++) {
+                int kid = em->reverse ? kids[i] : kids[node->count - 1 - i];
+                next = emit(em, kid, next, depth + 1);
+            }
+            return next;
+
+        case NODE_ALT: {
+            int entry = emit(em, kids[node->count - 1], next, depth + 1);
+            for (int i = node->count - 2; i >= 0 && entry >= 0; i--) {
+                int branch = emit(em, kids[i], next, depth + 1);
+                if (branch < 0) return -1;
+                entry = new_inst(em, INST_SPLIT, branch, entry, 0);
+            }
+            return entry;
+        }
+
+        case NODE_REPEAT: {
+            int child = node->first;
+            int min = node->min, max = node->max;
+            int entry = next;
+
+            if (max < 0) {
+                /* Loop back through a split that can also leave */
+                int split = new_inst(em, INST_SPLIT, -1, next, 0);
+                if (split < 0) return -1;
+                int body = emit(em, child, split, depth + 1);
+                if (body < 0) return -1;
+                em->insts[split].out = body;
+                entry = split;
+            } else {
+                /* Each optional copy may skip to the end */
+                for (int i = 0; i < max - min && entry >= 0; i++) {
+                    int body = emit(em, child, entry, depth + 1);
+                    if (body < 0) return -1;
+                    entry = new_inst(em, INST_SPLIT, body, next, 0);
+                }
+            }
+            for (int i = 0; i < min && entry >= 0; i++) {
+                entry = emit(em, child, entry, depth + 1);
+            }
+            return entry;
+        }
+    }
+    return -1;
+}
+
+/* Whether the NFA can reach a match without reading a byte */
+static bool matches_empty(const regex_inst *insts, int num_insts, int start) {
+    bool *seen = calloc(num_insts, sizeof(bool));
+    int *stack = malloc(sizeof(int) * num_insts);
+    bool found = false;
+
+    /* Without memory to check, refuse the pattern */
+    if (!seen || !stack) {
+        free(seen);
+        free(stack);
+        return true;
+    }
+
+    int top = 0;
+    stack[top++] = start;
+    seen[start] = true;
+    while (top > 0 && !found) {
+        const regex_inst *inst = &insts[stack[--top]];
+        int outs[2] = {-1, -1};
+
+        switch (inst->op) {
+            case INST_MATCH:
+                found = true;
+                break;
+            case INST_SPLIT:
+                outs[1] = inst->out1;
+                /* fall through */
+            case INST_BOL:
+            case INST_EOL:
+                outs[0] = inst->out;
+                break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (outs[i] >= 0 && !seen[outs[i]]) {
+                seen[outs[i]] = true;
+                stack[top++] = outs[i];
+            }
+        }
+    }
+
+    free(seen);
+    free(stack);
+    return found;
+}
+
+/* Empty the state cache */
+static void dfa_flush(regex_dfa *dfa) {
+    dfa->num_states = 0;
+    dfa->pool_len = 0;
+    dfa->start_state = -1;
+    dfa->flushes++;
+    for (int i = 0; i < REGEX_DFA_TABLE_SIZE; i++) dfa->table[i] = -1;
+}
+
+/* Set up a DFA over an NFA it takes ownership of */
+static bool dfa_init(regex_dfa *dfa, regex_inst *insts, int num_insts, int start,
+                     bool unanchored, int width) {
+    memset(dfa, 0, sizeof(*dfa));
+    dfa->insts = insts;
+    dfa->num_insts = num_insts;
+    dfa->start = start;
+    dfa->unanchored = unanchored;
+    dfa->width = width;
+
+    dfa->table = malloc(sizeof(int) * REGEX_DFA_TABLE_SIZE);
+    dfa->mark = calloc(num_insts, sizeof(int));
+    dfa->stack = malloc(sizeof(int) * num_insts);
+    dfa->list = malloc(sizeof(int) * num_insts);
+    if (!dfa->table || !dfa->mark || !dfa->stack || !dfa->list) return false;
+
+    dfa_flush(dfa);
+    return true;
+}
+
+static void dfa_free(regex_dfa *dfa) {
+    free(dfa->insts);
+    free(dfa->trans);
+    free(dfa->flags);
+    free(dfa->list_start);
+    free(dfa->list_len);
+    free(dfa->pool);
+    free(dfa->table);
+    free(dfa->mark);
+    free(dfa->stack);
+    free(dfa->list);
+}
+
+/* Start collecting a closure into the scratch list */
+static void closure_begin(regex_dfa *dfa) {
+    if (++dfa->generation == 0x7fffffff) {
+        memset(dfa->mark, 0, sizeof(int) * dfa->num_insts);
+        dfa->generation = 1;
+    }
+    dfa->list_len_scratch = 0;
+}
+
+/* Add an instruction and everything it reaches by splits, and by anchors
+ * of type pass (INST_BOL or INST_EOL, or -1 for none) */
+static void closure_add(regex_dfa *dfa, int inst, int pass) {
+    if (dfa->mark[inst] == dfa->generation) return;
+    dfa->mark[inst] = dfa->generation;
+
+    int top = 0;
+    dfa->stack[top++] = inst;
+    while (top > 0) {
+        const regex_inst *in = &dfa->insts[dfa->stack[--top]];
+        if (in->op == INST_SPLIT || in->op == pass) {
+            if (in->op == INST_SPLIT && dfa->mark[in->out1] != dfa->generation) {
+                dfa->mark[in->out1] = dfa->generation;
+                dfa->stack[top++] = in->out1;
+            }
+            if (dfa->mark[in->out] != dfa->generation) {
+                dfa->mark[in->out] = dfa->generation;
+                dfa->stack[top++] = in->out;
+            }
+        } else {
+            dfa->list[dfa->list_len_scratch++] = (int)(in - dfa->insts);
+        }
+    }
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned int hash_list(const int *list, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned int)list[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Add a state for the scratch list, which isn't cached. Returns -2 if the
+ * cache is full and -1 if out of memory */
+static int dfa_add(regex_dfa *dfa, unsigned int hash) {
+    int len = dfa->list_len_scratch;
+    if (dfa->num_states == REGEX_DFA_MAX_STATES || dfa->pool_len + len > REGEX_DFA_MAX_POOL) return -2;
+
+    if (dfa->num_states == dfa->states_cap) {
+        int cap = dfa->states_cap ? dfa->states_cap * 2 : 16;
+        int *trans = realloc(dfa->trans, sizeof(int) * cap * dfa->width);
+        if (!trans) return -1;
+        dfa->trans = trans;
+        unsigned char *flags = realloc(dfa->flags, cap);
+        if (!flags) return -1;
+        dfa->flags = flags;
+        int *list_start = realloc(dfa->list_start, sizeof(int) * cap);
+        if (!list_start) return -1;
+        dfa->list_start = list_start;
+        int *list_len = realloc(dfa->list_len, sizeof(int) * cap);
+        if (!list_len) return -1;
+        dfa->list_len = list_len;
+        dfa->states_cap = cap;
+    }
+    if (dfa->pool_len + len > dfa->pool_cap) {
+        int cap = dfa->pool_cap ? dfa->pool_cap : 1024;
+        while (cap < dfa->pool_len + len) cap *= 2;
+        int *pool = realloc(dfa->pool, sizeof(int) * cap);
+        if (!pool) return -1;
+        dfa->pool = pool;
+        dfa->pool_cap = cap;
+    }
+
+    int s = dfa->num_states++;
+    memcpy(&dfa->pool[dfa->pool_len], dfa->list, sizeof(int) * len);
+    dfa->list_start[s] = dfa->pool_len;
+    dfa->list_len[s] = len;
+    dfa->pool_len += len;
+
+    for (int i = 0; i < dfa->width; i++) dfa->trans[s * dfa->width + i] = -1;
+    dfa->flags[s] = (len == 0) ? DFA_DEAD : 0;
+    for (int i = 0; i < len; i++) {
+        if (dfa->insts[dfa->list[i]].op == INST_MATCH) dfa->flags[s] |= DFA_ACCEPT;
+    }
+
+    unsigned int slot = hash & (REGEX_DFA_TABLE_SIZE - 1);
+    while (dfa->table[slot] >= 0) slot = (slot + 1) & (REGEX_DFA_TABLE_SIZE - 1);
+    dfa->table[slot] = s;
+    return s;
+}
+
+/* The state for the scratch list, added to the cache if it isn't there.
+ * Returns -1 if out of memory */
+static int dfa_state(regex_dfa *dfa) {
+    int len = dfa->list_len_scratch;
+    qsort(dfa->list, len, sizeof(int), compare_ints);
+    unsigned int hash = hash_list(dfa->list, len);
+
+    unsigned int slot = hash & (REGEX_DFA_TABLE_SIZE - 1);
+    while (dfa->table[slot] >= 0) {
+        int s = dfa->table[slot];
+        if (dfa->list_len[s] == len &&
+            memcmp(&dfa->pool[dfa->list_start[s]], dfa->list, sizeof(int) * len) == 0) {
+            return s;
+        }
+        slot = (slot + 1) & (REGEX_DFA_TABLE_SIZE - 1);
+    }
+
+    int s = dfa_add(dfa, hash);
+    if (s == -2) {
+        dfa_flush(dfa);
+        s = dfa_add(dfa, hash);
+    }
+    return s;
+}
+
+/* State before any input, or -1 if out of memory */
+static int dfa_start(regex_dfa *dfa) {
+    if (dfa->start_state < 0) {
+        closure_begin(dfa);
+        closure_add(dfa, dfa->start, -1);
+        dfa->start_state = dfa_state(dfa);
+    }
+    return dfa->start_state;
+}
+
+/* Build the state after reading symbol in state s. Returns -1 if out of
+ * memory */
+static int dfa_step(pleditor_regex *re, regex_dfa *dfa, int s, int symbol) {
+    const int *list = &dfa->pool[dfa->list_start[s]];
+    int len = dfa->list_len[s];
+
+    closure_begin(dfa);
+    if (symbol >= re->num_classes) {
+        /* ^ and $ take no room: whatever isn't waiting for them stays,
+         * and whatever is passes every one in a row */
+        int pass = (symbol == re->num_classes) ? INST_BOL : INST_EOL;
+        for (int i = 0; i < len; i++) closure_add(dfa, list[i], pass);
+    } else {
+        const regex_set *sets = re->sets;
+        unsigned char byte = re->class_byte[symbol];
+        for (int i = 0; i < len; i++) {
+            const regex_inst *inst = &dfa->insts[list[i]];
+            if (inst->op == INST_SET && set_has(&sets[inst->set], byte)) {
+                closure_add(dfa, inst->out, -1);
+            }
+        }
+    }
+    if (dfa->unanchored) closure_add(dfa, dfa->start, -1);
+
+    int flushes = dfa->flushes;
+    int t = dfa_state(dfa);
+    if (t >= 0 && dfa->flushes == flushes) dfa->trans[s * dfa->width + symbol] = t;
+    return t;
+}
+
+/* Read one symbol; -1 if out of memory */
+static inline int dfa_next(pleditor_regex *re, regex_dfa *dfa, int s, int symbol) {
+    int t = dfa->trans[s * dfa->width + symbol];
+    return (t >= 0) ? t : dfa_step(re, dfa, s, symbol);
+}
+
+/* Split the bytes into classes that every set treats alike */
+static void compute_classes(pleditor_regex *re) {
+    unsigned char class[256];
+    memset(class, 0, sizeof(class));
+    int num_classes = 1;
+
+    for (int s = 0; s < re->num_sets; s++) {
+        int map[512];
+        for (int i = 0; i < num_classes * 2; i++) map[i] = -1;
+
+        int count = 0;
+        for (int c = 0; c < 256; c++) {
+            int key = class[c] * 2 + set_has(&re->sets[s], (unsigned char)c);
+            if (map[key] < 0) map[key] = count++;
+            class[c] = (unsigned char)map[key];
+        }
+        num_classes = count;
+    }
+
+    memcpy(re->byte_class, class, sizeof(class));
+    for (int c = 255; c >= 0; c--) re->class_byte[class[c]] = (unsigned char)c;
+    re->num_classes = num_classes;
+}
+
+/* Bytes collected for the runs every match contains */
+typedef struct regex_text {
+    char *bytes;
+    int len, cap;
+    bool ok;            /* There was memory for every byte */
+} regex_text;
+
+static void text_push(regex_text *text, char c) {
+    if (!text->ok) return;
+    if (text->len == text->cap) {
+        int cap = text->cap ? text->cap * 2 : 32;
+        char *bytes = realloc(text->bytes, cap);
+        if (!bytes) {
+            text->ok = false;
+            return;
+        }
+        text->bytes = bytes;
+        text->cap = cap;
+    }
+    text->bytes[text->len++] = c;
+}
+
+/* End the run being collected, if there is one */
+static void text_end_run(regex_text *text) {
+    if (text->len > 0 && text->bytes[text->len - 1] != '\n') text_push(text, '\n');
+}
+
+/* The byte a set stands for, either case of a letter counting as its
+ * lowercase, or -1 if it has more than one */
+static int set_literal(const regex_set *set) {
+    int literal = -1;
+    for (int c = 0; c < 256; c++) {
+        if (!set_has(set, (unsigned char)c)) continue;
+        int lower = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        if (literal >= 0 && literal != lower) return -1;
+        literal = lower;
+    }
+    return literal;
+}
+
+/* Collect the runs of single bytes every match of a node contains, the
+ * run before it going on through it while it is one */
+static void required_runs(const regex_parser *ps, int node_idx, regex_text *text, int depth) {
+    const regex_node *node = &ps->nodes[node_idx];
+    if (depth > REGEX_MAX_DEPTH) {
+        text_end_run(text);
+        return;
+    }
+
+    switch (node->type) {
+        case NODE_SET: {
+            int literal = set_literal(&ps->sets[node->set]);
+            if (literal >= 0) {
+                text_push(text, (char)literal);
+            } else {
+                text_end_run(text);
+            }
+            break;
+        }
+
+        case NODE_CAT:
+            for (int i = 0; i < node->count; i++) {
+                required_runs(ps, ps->kids[node->first + i], text, depth + 1);
+            }
+            break;
+
+        case NODE_REPEAT:
+            /* Only what one required copy contains */
+            text_end_run(text);
+            if (node->min > 0) required_runs(ps, node->first, text, depth + 1);
+            text_end_run(text);
+            break;
+
+        case NODE_EMPTY:
+            break;
+
+        case NODE_ALT:
+        case NODE_BOL:
+        case NODE_EOL:
+            text_end_run(text);
+            break;
+    }
+}
+
+/* Compile one direction of the parsed pattern */
+static bool compile_nfa(regex_parser *ps, int root, bool reverse, regex_emitter *em, int *start) {
+    memset(em, 0, sizeof(*em));
+    em->ps = ps;
+    em->reverse = reverse;
+
+    int match = new_inst(em, INST_MATCH, -1, -1, 0);
+    *start = (match < 0) ? -1 : emit(em, root, match, 0);
+    if (*start < 0) {
+        free(em->insts);
+        em->insts = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Compile a pattern of len bytes, with ASCII letters matching in either
+ * case if ignore_case is set. Returns NULL and sets error to a short
+ * description if it isn't valid
+ */
+pleditor_regex *pleditor_regex_compile(const char *pattern, int len, bool ignore_case, const char **error) {
+    regex_parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.p = pattern;
+    ps.end = pattern + len;
+    ps.ignore_case = ignore_case;
+
+    int root = parse_alt(&ps);
+    if (root >= 0 && ps.p < ps.end) root = parse_fail(&ps, "Unmatched )");
+
+    pleditor_regex *re = NULL;
+    regex_emitter forward = {0}, reverse = {0};
+    int forward_start, reverse_start;
+
+    if (root < 0) {
+        *error = ps.error;
+    } else if (!compile_nfa(&ps, root, false, &forward, &forward_start) ||
+               !compile_nfa(&ps, root, true, &reverse, &reverse_start)) {
+        *error = forward.error ? forward.error : reverse.error;
+    } else if (matches_empty(forward.insts, forward.num_insts, forward_start)) {
+        *error = "Pattern matches empty text";
+    } else {
+        re = calloc(1, sizeof(pleditor_regex));
+        if (!re) *error = "Out of memory";
+    }
+
+    if (re) {
+        /* Without memory for them, no runs are required */
+        regex_text text = {.ok = true};
+        required_runs(&ps, root, &text, 0);
+        text_end_run(&text);
+        if (text.ok) {
+            re->required = text.bytes;
+            re->required_len = text.len;
+        } else {
+            free(text.bytes);
+        }
+
+        re->sets = ps.sets;
+        re->num_sets = ps.num_sets;
+        ps.sets = NULL;
+        compute_classes(re);
+
+        int width = re->num_classes + 2;
+        bool ok = dfa_init(&re->forward, forward.insts, forward.num_insts, forward_start, false, width);
+        forward.insts = NULL;
+        ok = dfa_init(&re->reverse, reverse.insts, reverse.num_insts, reverse_start, true, width) && ok;
+        reverse.insts = NULL;
+        if (!ok) {
+            pleditor_regex_free(re);
+            re = NULL;
+            *error = "Out of memory";
+        }
+    }
+
+    free(forward.insts);
+    free(reverse.insts);
+    free(ps.nodes);
+    free(ps.kids);
+    free(ps.sets);
+    return re;
+}
+
+/* Free a compiled pattern */
+void pleditor_regex_free(pleditor_regex *re) {
+    if (!re) return;
+    dfa_free(&re->forward);
+    dfa_free(&re->reverse);
+    free(re->sets);
+    free(re->starts);
+    free(re->required);
+    free(re);
+}
+
+/* The runs of bytes every match contains, letters lowercased, each ended
+ * by '\n' (a '\n' in the pattern ends a run too) */
+const char *pleditor_regex_required(const pleditor_regex *re, int *len) {
+    *len = re->required_len;
+    return re->required;
+}
+
+/* Where a backward scan reports the match starts it finds */
+typedef struct regex_scan {
+    int from;           /* Backward search: last position wanted */
+    int found;          /* Answer so far, -1 if none */
+    bool stop;          /* Stop at the first start reported */
+} regex_scan;
+
+/**
+ * Read text back from its end with the reversed pattern, down to position
+ * stop. A match starts wherever the DFA accepts; each start is passed to
+ * visit, last first, until it returns false. Returns false if out of
+ * memory
+ */
+static bool scan_back(pleditor_regex *re, const char *text, int len, int stop,
+                      bool (*visit)(pleditor_regex *re, int col, void *arg), void *arg) {
+    regex_dfa *dfa = &re->reverse;
+    int s = dfa_start(dfa);
+    if (s >= 0) s = dfa_next(re, dfa, s, re->num_classes + 1);
+    if (s < 0) return false;
+
+    bool at_start = false;
+    for (int i = len - 1; i >= stop; i--) {
+        s = dfa_next(re, dfa, s, re->byte_class[(unsigned char)text[i]]);
+        if (s < 0) return false;
+        at_start = (dfa->flags[s] & DFA_ACCEPT) != 0;
+        if (at_start && !visit(re, i, arg)) return true;
+    }
+
+    /* Patterns beginning with ^ only match once it is read */
+    if (stop == 0 && len > 0 && !at_start) {
+        s = dfa_next(re, dfa, s, re->num_classes);
+        if (s < 0) return false;
+        if (dfa->flags[s] & DFA_ACCEPT) visit(re, 0, arg);
+    }
+    return true;
+}
+
+/* Keep the latest start: the first, as they are visited last first */
+static bool visit_forward(pleditor_regex *re, int col, void *arg) {
+    (void)re;
+    ((regex_scan *)arg)->found = col;
+    return true;
+}
+
+/* Keep the first start visited at or before from */
+static bool visit_backward(pleditor_regex *re, int col, void *arg) {
+    (void)re;
+    regex_scan *scan = arg;
+    if (col > scan->from) return true;
+    scan->found = col;
+    return false;
+}
+
+/* Collect every start */
+static bool visit_all(pleditor_regex *re, int col, void *arg) {
+    regex_scan *scan = arg;
+    if (scan->found == re->starts_cap) {
+        int cap = re->starts_cap ? re->starts_cap * 2 : 64;
+        int *starts = realloc(re->starts, sizeof(int) * cap);
+        if (!starts) {
+            scan->stop = true;
+            return false;
+        }
+        re->starts = starts;
+        re->starts_cap = cap;
+    }
+    re->starts[scan->found++] = col;
+    return true;
+}
+
+/* Offset of the first match in text[from..len), or -1 */
+int pleditor_regex_forward(pleditor_regex *re, const char *text, int len, int from) {
+    if (from < 0) from = 0;
+    if (from >= len) return -1;
+
+    regex_scan scan = {.found = -1};
+    if (!scan_back(re, text, len, from, visit_forward, &scan)) return -1;
+    return scan.found;
+}
+
+/* Offset of the last match of text[0..len) that starts at or before
+ * from, or -1 */
+int pleditor_regex_backward(pleditor_regex *re, const char *text, int len, int from) {
+    if (from >= len) from = len - 1;
+    if (from < 0) return -1;
+
+    regex_scan scan = {.from = from, .found = -1};
+    if (!scan_back(re, text, len, 0, visit_backward, &scan)) return -1;
+    return scan.found;
+}
+
+/* End of the longest match starting at at, or -1 if none starts there */
+int pleditor_regex_match_end(pleditor_regex *re, const char *text, int len, int at) {
+    regex_dfa *dfa = &re->forward;
+    int s = dfa_start(dfa);
+    if (s >= 0 && at == 0) s = dfa_next(re, dfa, s, re->num_classes);
+    if (s < 0) return -1;
+
+    int end = -1;
+    int i;
+    for (i = at; i < len; i++) {
+        s = dfa_next(re, dfa, s, re->byte_class[(unsigned char)text[i]]);
+        if (s < 0 || (dfa->flags[s] & DFA_DEAD)) return end;
+        if (dfa->flags[s] & DFA_ACCEPT) end = i + 1;
+    }
+
+    s = dfa_next(re, dfa, s, re->num_classes + 1);
+    if (s >= 0 && (dfa->flags[s] & DFA_ACCEPT)) end = len;
+    return end;
+}
+
+/**
+ * Call found(col, arg) for the start of every match in text, in order.
+ * Returns false if out of memory
+ */
+bool pleditor_regex_each(pleditor_regex *re, const char *text, int len,
+                         void (*found)(int col, void *arg), void *arg) {
+    regex_scan scan = {.found = 0};
+    if (!scan_back(re, text, len, 0, visit_all, &scan) || scan.stop) return false;
+
+    for (int i = scan.found - 1; i >= 0; i--) {
+        found(re->starts[i], arg);
+    }
+    return true;
+}
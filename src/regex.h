@@ -0,0 +1,23 @@
+/**
+ * regex.h - Regular expression matching for pleditor
+ */
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <stdbool.h>
+
+/* A compiled regular expression with the automata it matches with */
+typedef struct pleditor_regex pleditor_regex;
+
+/* Function prototypes */
+pleditor_regex *pleditor_regex_compile(const char *pattern, int len, bool ignore_case, const char **error);
+void pleditor_regex_free(pleditor_regex *re);
+const char *pleditor_regex_required(const pleditor_regex *re, int *len);
+
+int pleditor_regex_forward(pleditor_regex *re, const char *text, int len, int from);
+int pleditor_regex_backward(pleditor_regex *re, const char *text, int len, int from);
+int pleditor_regex_match_end(pleditor_regex *re, const char *text, int len, int at);
+bool pleditor_regex_each(pleditor_regex *re, const char *text, int len,
+                         void (*found)(int col, void *arg), void *arg);
+
+#endif /* REGEX_H */
@@ -0,0 +1,261 @@
+/**
+ * replace.c - Search and replace
+ *
+ * A replace finds the matches of each row in one pass and builds the row's
+ * new text once. The old text of every changed row goes into a single undo
+ * operation as it is, without copying. Rows are rendered as they change,
+ * but highlighting is redone once, from the first changed row, as rows are
+ * next drawn rather than after each change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pleditor.h"
+#include "replace.h"
+
+/* Starts of the matches on a row, collected by pleditor_search_each */
+typedef struct replace_starts {
+    int *cols;
+    int count, cap;
+    bool ok;            /* There was memory for every start */
+} replace_starts;
+
+static void add_start(int col, void *arg) {
+    replace_starts *starts = arg;
+    if (!starts->ok) return;
+
+    if (starts->count == starts->cap) {
+        int cap = starts->cap ? starts->cap * 2 : 64;
+        int *cols = realloc(starts->cols, sizeof(int) * cap);
+        if (!cols) {
+            starts->ok = false;
+            return;
+        }
+        starts->cols = cols;
+        starts->cap = cap;
+    }
+    starts->cols[starts->count++] = col;
+}
+
+/**
+ * New text for a row, with each match that doesn't overlap one before it
+ * replaced. Sets size and the number of matches replaced. Returns NULL if
+ * out of memory
+ */
+static char *replace_row(const pleditor_search_pattern *pattern, const pleditor_row *row,
+                         const replace_starts *starts, const char *with, int with_len,
+                         int *size, int *count) {
+    /* Every match covers at least a byte */
+    char *chars = malloc((size_t)row->size + (size_t)starts->count * with_len + 1);
+    if (!chars) return NULL;
+
+    int len = 0, from = 0;
+    *count = 0;
+    for (int i = 0; i < starts->count; i++) {
+        int col = starts->cols[i];
+        if (col < from) continue;
+        int end = pleditor_search_match_end(pattern, row->chars, row->size, col);
+        if (end <= col) continue;
+
+        memcpy(chars + len, row->chars + from, col - from);
+        len += col - from;
+        memcpy(chars + len, with, with_len);
+        len += with_len;
+        from = end;
+        (*count)++;
+    }
+    memcpy(chars + len, row->chars + from, row->size - from);
+    len += row->size - from;
+    chars[len] = '\0';
+
+    *size = len;
+    return chars;
+}
+
+/**
+ * Replace the matches of pattern in rows first to last with with_len bytes
+ * of with, as one undo step. Matches are replaced from left to right,
+ * skipping any that overlap one already replaced, and replacements are not
+ * searched again. Sets replaced to the number of matches replaced. Returns
+ * false, with nothing changed, if out of memory
+ */
+bool pleditor_replace(pleditor_state *state, const pleditor_search_pattern *pattern,
+                      const char *with, int with_len, int first, int last, int *replaced) {
+    *replaced = 0;
+    if (first < 0) first = 0;
+    if (last >= state->num_rows) last = state->num_rows - 1;
+
+    pleditor_saved_row *saved = NULL;
+    int num_saved = 0, saved_cap = 0;
+    replace_starts starts = {0};
+    int total = 0;
+    bool ok = true;
+    int may_end = first;    /* Rows before this may match, by the trigram index */
+
+    for (int i = first; i <= last && ok; i++) {
+        if (i >= may_end) {
+            int next = pleditor_trigram_next(state, pattern, i, &may_end);
+            if (next > i) {
+                i = next - 1;
+                continue;
+            }
+        }
+
+        pleditor_row *row = &state->rows[i];
+        starts.count = 0;
+        starts.ok = true;
+        ok = pleditor_search_each(pattern, row->chars, row->size, add_start, &starts) && starts.ok;
+        if (!ok || starts.count == 0) continue;
+
+        if (num_saved == saved_cap) {
+            int cap = saved_cap ? saved_cap * 2 : 64;
+            pleditor_saved_row *grown = realloc(saved, sizeof(pleditor_saved_row) * cap);
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            saved = grown;
+            saved_cap = cap;
+        }
+
+        int size, count;
+        char *chars = replace_row(pattern, row, &starts, with, with_len, &size, &count);
+        if (!chars) {
+            ok = false;
+            break;
+        }
+        if (count == 0) {
+            free(chars);
+            continue;
+        }
+
+        /* The old text goes to the undo operation as it is */
+        saved[num_saved].row = i;
+        saved[num_saved].chars = row->chars;
+        saved[num_saved].size = row->size;
+        num_saved++;
+        row->chars = chars;
+        row->size = size;
+        total += count;
+    }
+    free(starts.cols);
+
+    if (!ok) {
+        /* Nothing else has seen the new text yet: put the old text back */
+        for (int i = 0; i < num_saved; i++) {
+            pleditor_row *row = &state->rows[saved[i].row];
+            free(row->chars);
+            row->chars = saved[i].chars;
+            row->size = saved[i].size;
+        }
+        free(saved);
+        return false;
+    }
+
+    if (num_saved == 0) {
+        free(saved);
+        return true;
+    }
+
+    for (int i = 0; i < num_saved; i++) {
+        pleditor_update_row(state, &state->rows[saved[i].row]);
+        pleditor_syntax_mark_changed(state, saved[i].row);
+    }
+    pleditor_syntax_rows_changed(state, saved[0].row);
+
+    pleditor_operation_params params = {
+        .type = OP_REPLACE_ROWS,
+        .cx = state->cx,
+        .cy = state->cy,
+        .saved = saved,
+        .num_saved = num_saved
+    };
+    pleditor_record_operation(state, &params);
+
+    /* The cursor's row may have become shorter */
+    if (state->cy < state->num_rows && state->cx > state->rows[state->cy].size) {
+        state->cx = state->rows[state->cy].size;
+    }
+    state->dirty = true;
+    *replaced = total;
+    return true;
+}
+
+/* Swap the text of the saved rows with what they have now, which undoes
+ * or redoes a replace */
+void pleditor_replace_swap(pleditor_state *state, pleditor_saved_row *saved, int count) {
+    int first = -1;
+    for (int i = 0; i < count; i++) {
+        if (saved[i].row >= state->num_rows) continue;
+        pleditor_row *row = &state->rows[saved[i].row];
+
+        char *chars = row->chars;
+        int size = row->size;
+        row->chars = saved[i].chars;
+        row->size = saved[i].size;
+        saved[i].chars = chars;
+        saved[i].size = size;
+
+        pleditor_update_row(state, row);
+        pleditor_syntax_mark_changed(state, saved[i].row);
+        if (first < 0) first = saved[i].row;
+    }
+
+    if (first >= 0) {
+        pleditor_syntax_rows_changed(state, first);
+        state->dirty = true;
+    }
+}
+
+/* Free the text of saved rows */
+void pleditor_replace_free_saved(pleditor_saved_row *saved, int count) {
+    for (int i = 0; i < count; i++) {
+        free(saved[i].chars);
+    }
+    free(saved);
+}
+
+/**
+ * Ask for the text to find, what to replace it with and, for lines, the
+ * rows to replace it in, then replace it everywhere in them. The text is
+ * searched for with the modes last chosen for search
+ */
+void pleditor_replace_prompt(pleditor_state *state, bool lines) {
+    bool regex = state->search_flags & PLEDITOR_SEARCH_REGEX;
+    char *query = pleditor_prompt(state, regex ? "Replace expression" : "Replace", NULL);
+    if (query == NULL) return;
+
+    char *with = pleditor_prompt_allow_empty(state, "Replace with");
+    if (with == NULL) {
+        free(query);
+        return;
+    }
+
+    int first = 0, last = state->num_rows - 1;
+    if (lines && !pleditor_prompt_range(state, "Replace in lines (from-to)", &first, &last)) {
+        free(query);
+        free(with);
+        return;
+    }
+
+    pleditor_search_pattern pattern;
+    memset(&pattern, 0, sizeof(pattern));
+    int replaced = 0;
+
+    if (!pleditor_search_compile(&pattern, query, (int)strlen(query), state->search_flags)) {
+        pleditor_set_status_message(state, "Out of memory");
+    } else if (pattern.error) {
+        pleditor_set_status_message(state, "Invalid pattern '%s': %s", query, pattern.error);
+    } else if (!pleditor_replace(state, &pattern, with, (int)strlen(with), first, last, &replaced)) {
+        pleditor_set_status_message(state, "Out of memory, nothing replaced");
+    } else {
+        pleditor_set_status_message(state, "Replaced %d %s of '%s'", replaced,
+                                    replaced == 1 ? "occurrence" : "occurrences", query);
+    }
+
+    pleditor_search_free_pattern(&pattern);
+    free(query);
+    free(with);
+}
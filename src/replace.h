@@ -0,0 +1,29 @@
+/**
+ * replace.h - Search and replace for pleditor
+ */
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include <stdbool.h>
+
+#include "search.h"
+
+/* Text a row had before a replace, kept for undo; undoing swaps it with
+ * the row's current text, which is then kept for redo */
+typedef struct pleditor_saved_row {
+    int row;
+    char *chars;
+    int size;
+} pleditor_saved_row;
+
+/* Forward declaration for the struct defined in pleditor.h */
+struct pleditor_state;
+
+/* Function prototypes */
+bool pleditor_replace(struct pleditor_state *state, const pleditor_search_pattern *pattern,
+                      const char *with, int with_len, int first, int last, int *replaced);
+void pleditor_replace_swap(struct pleditor_state *state, pleditor_saved_row *saved, int count);
+void pleditor_replace_free_saved(pleditor_saved_row *saved, int count);
+void pleditor_replace_prompt(struct pleditor_state *state, bool lines);
+
+#endif /* REPLACE_H */
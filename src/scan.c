@@ -0,0 +1,293 @@
+/**
+ * scan.c - Vectorized byte scanning
+ *
+ * The scans compare 32 bytes at a time with AVX2 or 16 with SSE2 when the
+ * compiler targets them, and finish with a byte loop.
+ *
+ * Case is ignored by folding the text as it is loaded: ORing 0x20 into a
+ * byte lowercases an uppercase letter, and only letters become a lowercase
+ * letter that way, so a byte ORed with 0x20 equals a lowercase letter
+ * exactly when it is that letter in either case. Other bytes are ORed with
+ * 0 and compared as they are; the text is never copied.
+ */
+
+#include "scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2
+#endif
+
+#if defined(SCAN_AVX2) || defined(SCAN_SSE2)
+#ifdef _MSC_VER
+#include <intrin.h>
+
+/* Position of the lowest set bit of a nonzero mask */
+static int lowest_bit(unsigned int mask) {
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+}
+
+/* Position of the highest set bit of a nonzero mask */
+static int highest_bit(unsigned int mask) {
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (int)index;
+}
+#else
+static int lowest_bit(unsigned int mask) {
+    return __builtin_ctz(mask);
+}
+
+static int highest_bit(unsigned int mask) {
+    return 31 - __builtin_clz(mask);
+}
+#endif
+#endif
+
+/* Find the first byte equal to a or b */
+int pleditor_scan_either(const char *s, int len, char a, char b) {
+    int i = 0;
+
+#ifdef SCAN_AVX2
+    __m256i wide_a = _mm256_set1_epi8(a);
+    __m256i wide_b = _mm256_set1_epi8(b);
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, wide_a),
+                                       _mm256_cmpeq_epi8(chunk, wide_b));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_a = _mm_set1_epi8(a);
+    __m128i vec_b = _mm_set1_epi8(b);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, vec_a),
+                                    _mm_cmpeq_epi8(chunk, vec_b));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (s[i] == a || s[i] == b) return i;
+    }
+    return len;
+}
+
+/* Find the first byte that differs from c */
+int pleditor_scan_past(const char *s, int len, char c) {
+    int i = 0;
+
+#ifdef SCAN_AVX2
+    __m256i wide_c = _mm256_set1_epi8(c);
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, wide_c));
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_c = _mm_set1_epi8(c);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, vec_c)) & 0xffff;
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+    for (; i < len && s[i] == c; i++);
+    return i;
+}
+
+/* Find the first position where a is followed gap bytes later by b */
+int pleditor_scan_pair(const char *s, int count, char a, char b, int gap) {
+    int i = 0;
+
+#ifdef SCAN_AVX2
+    __m256i wide_a = _mm256_set1_epi8(a);
+    __m256i wide_b = _mm256_set1_epi8(b);
+    for (; i + 32 <= count; i += 32) {
+        __m256i first = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i last = _mm256_loadu_si256((const __m256i *)(s + i + gap));
+        __m256i hits = _mm256_and_si256(_mm256_cmpeq_epi8(first, wide_a),
+                                        _mm256_cmpeq_epi8(last, wide_b));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_a = _mm_set1_epi8(a);
+    __m128i vec_b = _mm_set1_epi8(b);
+    for (; i + 16 <= count; i += 16) {
+        __m128i first = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i last = _mm_loadu_si128((const __m128i *)(s + i + gap));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(first, vec_a),
+                                     _mm_cmpeq_epi8(last, vec_b));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (s[i] == a && s[i + gap] == b) return i;
+    }
+    return count;
+}
+
+/* Find the last position where a is followed gap bytes later by b */
+int pleditor_scan_pair_reverse(const char *s, int count, char a, char b, int gap) {
+    int i = count;
+
+#ifdef SCAN_AVX2
+    __m256i wide_a = _mm256_set1_epi8(a);
+    __m256i wide_b = _mm256_set1_epi8(b);
+    for (; i >= 32; i -= 32) {
+        __m256i first = _mm256_loadu_si256((const __m256i *)(s + i - 32));
+        __m256i last = _mm256_loadu_si256((const __m256i *)(s + i - 32 + gap));
+        __m256i hits = _mm256_and_si256(_mm256_cmpeq_epi8(first, wide_a),
+                                        _mm256_cmpeq_epi8(last, wide_b));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i - 32 + highest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_a = _mm_set1_epi8(a);
+    __m128i vec_b = _mm_set1_epi8(b);
+    for (; i >= 16; i -= 16) {
+        __m128i first = _mm_loadu_si128((const __m128i *)(s + i - 16));
+        __m128i last = _mm_loadu_si128((const __m128i *)(s + i - 16 + gap));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(first, vec_a),
+                                     _mm_cmpeq_epi8(last, vec_b));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i - 16 + highest_bit(mask);
+    }
+#endif
+
+    while (i-- > 0) {
+        if (s[i] == a && s[i + gap] == b) return i;
+    }
+    return -1;
+}
+
+/* The bits ORed into a byte to compare it with c ignoring case */
+static char fold_bits(char c) {
+    return (c >= 'a' && c <= 'z') ? 0x20 : 0;
+}
+
+/* Find the first position where a is followed gap bytes later by b, in
+ * either case */
+int pleditor_scan_pair_nocase(const char *s, int count, char a, char b, int gap) {
+    char fold_a = fold_bits(a), fold_b = fold_bits(b);
+    int i = 0;
+
+#ifdef SCAN_AVX2
+    __m256i wide_a = _mm256_set1_epi8(a), wide_fold_a = _mm256_set1_epi8(fold_a);
+    __m256i wide_b = _mm256_set1_epi8(b), wide_fold_b = _mm256_set1_epi8(fold_b);
+    for (; i + 32 <= count; i += 32) {
+        __m256i first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i)), wide_fold_a);
+        __m256i last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i + gap)), wide_fold_b);
+        __m256i hits = _mm256_and_si256(_mm256_cmpeq_epi8(first, wide_a),
+                                        _mm256_cmpeq_epi8(last, wide_b));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_a = _mm_set1_epi8(a), vec_fold_a = _mm_set1_epi8(fold_a);
+    __m128i vec_b = _mm_set1_epi8(b), vec_fold_b = _mm_set1_epi8(fold_b);
+    for (; i + 16 <= count; i += 16) {
+        __m128i first = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i)), vec_fold_a);
+        __m128i last = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i + gap)), vec_fold_b);
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(first, vec_a),
+                                     _mm_cmpeq_epi8(last, vec_b));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i + lowest_bit(mask);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if ((s[i] | fold_a) == a && (s[i + gap] | fold_b) == b) return i;
+    }
+    return count;
+}
+
+/* Find the last position where a is followed gap bytes later by b, in
+ * either case */
+int pleditor_scan_pair_nocase_reverse(const char *s, int count, char a, char b, int gap) {
+    char fold_a = fold_bits(a), fold_b = fold_bits(b);
+    int i = count;
+
+#ifdef SCAN_AVX2
+    __m256i wide_a = _mm256_set1_epi8(a), wide_fold_a = _mm256_set1_epi8(fold_a);
+    __m256i wide_b = _mm256_set1_epi8(b), wide_fold_b = _mm256_set1_epi8(fold_b);
+    for (; i >= 32; i -= 32) {
+        __m256i first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i - 32)), wide_fold_a);
+        __m256i last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i - 32 + gap)), wide_fold_b);
+        __m256i hits = _mm256_and_si256(_mm256_cmpeq_epi8(first, wide_a),
+                                        _mm256_cmpeq_epi8(last, wide_b));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i - 32 + highest_bit(mask);
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    __m128i vec_a = _mm_set1_epi8(a), vec_fold_a = _mm_set1_epi8(fold_a);
+    __m128i vec_b = _mm_set1_epi8(b), vec_fold_b = _mm_set1_epi8(fold_b);
+    for (; i >= 16; i -= 16) {
+        __m128i first = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i - 16)), vec_fold_a);
+        __m128i last = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i - 16 + gap)), vec_fold_b);
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(first, vec_a),
+                                     _mm_cmpeq_epi8(last, vec_b));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i - 16 + highest_bit(mask);
+    }
+#endif
+
+    while (i-- > 0) {
+        if ((s[i] | fold_a) == a && (s[i + gap] | fold_b) == b) return i;
+    }
+    return -1;
+}
+
+/* Compare s, folded by fold, with p */
+bool pleditor_scan_equal_folded(const char *s, const char *p, const char *fold, int len) {
+    int i = 0;
+
+#ifdef SCAN_AVX2
+    for (; i + 32 <= len; i += 32) {
+        __m256i folded = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i)),
+                                         _mm256_loadu_si256((const __m256i *)(fold + i)));
+        __m256i same = _mm256_cmpeq_epi8(folded, _mm256_loadu_si256((const __m256i *)(p + i)));
+        if ((unsigned int)_mm256_movemask_epi8(same) != 0xffffffffu) return false;
+    }
+#endif
+
+#ifdef SCAN_SSE2
+    for (; i + 16 <= len; i += 16) {
+        __m128i folded = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i)),
+                                      _mm_loadu_si128((const __m128i *)(fold + i)));
+        __m128i same = _mm_cmpeq_epi8(folded, _mm_loadu_si128((const __m128i *)(p + i)));
+        if ((unsigned int)_mm_movemask_epi8(same) != 0xffff) return false;
+    }
+#endif
+
+    for (; i < len; i++) {
+        if ((s[i] | fold[i]) != p[i]) return false;
+    }
+    return true;
+}
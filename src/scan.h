@@ -0,0 +1,32 @@
+/**
+ * scan.h - Vectorized byte scanning
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+
+/* Index of the first byte of s[0..len) equal to a or b, or len if none */
+int pleditor_scan_either(const char *s, int len, char a, char b);
+
+/* Index of the first byte of s[0..len) that is not c, or len if none */
+int pleditor_scan_past(const char *s, int len, char c);
+
+/* Index of the first i in [0..count) with s[i] == a and s[i + gap] == b,
+ * or count if none. Reads s[0..count + gap) */
+int pleditor_scan_pair(const char *s, int count, char a, char b, int gap);
+
+/* Index of the last such i in [0..count), or -1 if none */
+int pleditor_scan_pair_reverse(const char *s, int count, char a, char b, int gap);
+
+/* pleditor_scan_pair and pleditor_scan_pair_reverse with letters matching
+ * in either case; a and b are lowercase */
+int pleditor_scan_pair_nocase(const char *s, int count, char a, char b, int gap);
+int pleditor_scan_pair_nocase_reverse(const char *s, int count, char a, char b, int gap);
+
+/* Whether each byte of s[0..len), ORed with the same byte of fold, equals
+ * that of p. With 0x20 in fold under the letters of a lowercase p and 0
+ * elsewhere, s equals p ignoring case */
+bool pleditor_scan_equal_folded(const char *s, const char *p, const char *fold, int len);
+
+#endif /* SCAN_H */
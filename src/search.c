@@ -0,0 +1,398 @@
+/**
+ * search.c - Search engine
+ *
+ * Candidates are found by a vectorized scan for positions where the query's
+ * first byte is followed, len - 1 bytes later, by its last byte, and only
+ * those are compared in full. When that filter keeps failing (a query whose
+ * first and last bytes are common together in the text), the search
+ * switches to Boyer-Moore-Horspool, which skips ahead by the shift of the
+ * byte under the end of the window. Backward searches mirror both: the
+ * scan runs from the end and Horspool shifts by the byte under the start.
+ * Regular expressions are handed to regex.c.
+ *
+ * Ignoring case, the query is lowercased once and the text is folded as it
+ * is scanned and compared (see scan.c), so the same filter applies at the
+ * cost of an OR per vector. Whole words are candidates found as usual and
+ * then checked against the identifier bytes of the syntax highlighter.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+#include "scan.h"
+#include "regex.h"
+#include "syntax.h"
+
+/* False candidates tolerated before judging the filter */
+#define SEARCH_FILTER_MIN_MISSES 16
+/* Fewest bytes scanned per false candidate for the filter to stay in use */
+#define SEARCH_FILTER_BYTES_PER_MISS 16
+
+/**
+ * Compile a query of len bytes with PLEDITOR_SEARCH_* flags. Returns false
+ * if out of memory; an invalid expression instead sets pattern->error and
+ * matches nothing
+ */
+bool pleditor_search_compile(pleditor_search_pattern *pattern, const char *query, int len, int flags) {
+    char *bytes = malloc(len + 1);
+    if (!bytes) return false;
+    memcpy(bytes, query, len);
+    bytes[len] = '\0';
+
+    bool ignore_case = flags & PLEDITOR_SEARCH_IGNORE_CASE;
+    char *folded = NULL, *fold = NULL;
+    if (ignore_case && !(flags & PLEDITOR_SEARCH_REGEX)) {
+        folded = malloc(len + 1);
+        fold = malloc(len + 1);
+        if (!folded || !fold) {
+            free(bytes);
+            free(folded);
+            free(fold);
+            return false;
+        }
+        for (int i = 0; i < len; i++) {
+            bool upper = bytes[i] >= 'A' && bytes[i] <= 'Z';
+            folded[i] = upper ? bytes[i] + ('a' - 'A') : bytes[i];
+            fold[i] = (folded[i] >= 'a' && folded[i] <= 'z') ? 0x20 : 0;
+        }
+        folded[len] = '\0';
+    }
+
+    free(pattern->bytes);
+    pattern->bytes = bytes;
+    pattern->len = len;
+    pattern->flags = flags;
+    free(pattern->folded);
+    pattern->folded = folded;
+    free(pattern->fold);
+    pattern->fold = fold;
+
+    if (flags & PLEDITOR_SEARCH_WHOLE_WORD) {
+        for (int c = 0; c < 256; c++) {
+            pattern->word[c] = pleditor_syntax_identifier_byte(c);
+        }
+    }
+
+    pleditor_regex_free(pattern->regex);
+    pattern->regex = NULL;
+    pattern->error = NULL;
+    if ((flags & PLEDITOR_SEARCH_REGEX) && len > 0) {
+        pattern->regex = pleditor_regex_compile(bytes, len, ignore_case, &pattern->error);
+        return true;
+    }
+
+    /* Bytes that don't occur in the query (before its last byte) let the
+     * window move past them entirely. Ignoring case, a letter shifts the
+     * same in either case */
+    const char *key = folded ? folded : bytes;
+    for (int c = 0; c < 256; c++) {
+        pattern->shift[c] = len;
+    }
+    for (int i = 0; i < len - 1; i++) {
+        pattern->shift[(unsigned char)key[i]] = len - 1 - i;
+        if (fold && fold[i]) pattern->shift[(unsigned char)(key[i] - 0x20)] = len - 1 - i;
+    }
+
+    /* The same for windows moving back, by the query after its first byte */
+    for (int c = 0; c < 256; c++) {
+        pattern->reverse_shift[c] = len;
+    }
+    for (int i = len - 1; i > 0; i--) {
+        pattern->reverse_shift[(unsigned char)key[i]] = i;
+        if (fold && fold[i]) pattern->reverse_shift[(unsigned char)(key[i] - 0x20)] = i;
+    }
+    return true;
+}
+
+/* Compile the query of another pattern, for a thread of its own to use.
+ * Returns false if out of memory */
+bool pleditor_search_clone(pleditor_search_pattern *pattern, const pleditor_search_pattern *from) {
+    if (!pleditor_search_compile(pattern, from->bytes, from->len, from->flags)) return false;
+    return pattern->regex || !from->regex;
+}
+
+/* Have at least count copies of from. Returns false if out of memory */
+bool pleditor_search_clones_reserve(pleditor_search_clones *clones, const pleditor_search_pattern *from,
+                                    int count) {
+    /* Copies of some other query are no use */
+    if (clones->count > 0) {
+        const pleditor_search_pattern *copy = &clones->patterns[0];
+        if (copy->flags != from->flags || copy->len != from->len ||
+            (from->len > 0 && memcmp(copy->bytes, from->bytes, from->len) != 0)) {
+            pleditor_search_clones_free(clones);
+        }
+    }
+    if (clones->count >= count) return true;
+
+    pleditor_search_pattern *patterns = realloc(clones->patterns, sizeof(pleditor_search_pattern) * count);
+    if (!patterns) return false;
+    clones->patterns = patterns;
+
+    while (clones->count < count) {
+        pleditor_search_pattern *pattern = &patterns[clones->count];
+        memset(pattern, 0, sizeof(pleditor_search_pattern));
+        if (!pleditor_search_clone(pattern, from)) {
+            pleditor_search_free_pattern(pattern);
+            return false;
+        }
+        clones->count++;
+    }
+    return true;
+}
+
+/* Free the copies, to be made again of a new pattern */
+void pleditor_search_clones_free(pleditor_search_clones *clones) {
+    for (int i = 0; i < clones->count; i++) {
+        pleditor_search_free_pattern(&clones->patterns[i]);
+    }
+    free(clones->patterns);
+    clones->patterns = NULL;
+    clones->count = 0;
+}
+
+/* Free a compiled query */
+void pleditor_search_free_pattern(pleditor_search_pattern *pattern) {
+    free(pattern->bytes);
+    pattern->bytes = NULL;
+    pattern->len = 0;
+    free(pattern->folded);
+    pattern->folded = NULL;
+    free(pattern->fold);
+    pattern->fold = NULL;
+    pleditor_regex_free(pattern->regex);
+    pattern->regex = NULL;
+    pattern->error = NULL;
+}
+
+/* Do n bytes of text equal the query's from its byte at */
+static bool same_bytes(const pleditor_search_pattern *pattern, const char *text, int at, int n) {
+    if (pattern->folded) {
+        return pleditor_scan_equal_folded(text, pattern->folded + at, pattern->fold + at, n);
+    }
+    return memcmp(text, pattern->bytes + at, n) == 0;
+}
+
+/* Does byte c equal the query's byte at */
+static bool same_byte(const pleditor_search_pattern *pattern, unsigned char c, int at) {
+    if (pattern->folded) return (c | pattern->fold[at]) == (unsigned char)pattern->folded[at];
+    return c == (unsigned char)pattern->bytes[at];
+}
+
+/* First i in [0..count) where text[i] could start a match, judging by the
+ * query's first byte and its byte gap bytes later, or count */
+static int scan_candidates(const pleditor_search_pattern *pattern, const char *text, int count, int gap) {
+    if (pattern->folded) {
+        return pleditor_scan_pair_nocase(text, count, pattern->folded[0], pattern->folded[gap], gap);
+    }
+    return pleditor_scan_pair(text, count, pattern->bytes[0], pattern->bytes[gap], gap);
+}
+
+/* Last such i in [0..count), or -1 */
+static int scan_candidates_reverse(const pleditor_search_pattern *pattern, const char *text, int count, int gap) {
+    if (pattern->folded) {
+        return pleditor_scan_pair_nocase_reverse(text, count, pattern->folded[0], pattern->folded[gap], gap);
+    }
+    return pleditor_scan_pair_reverse(text, count, pattern->bytes[0], pattern->bytes[gap], gap);
+}
+
+/* Horspool search of text[from..len) */
+static int horspool_forward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    int m = pattern->len;
+
+    for (int i = from; i + m <= len; ) {
+        unsigned char c = (unsigned char)text[i + m - 1];
+        if (same_byte(pattern, c, m - 1) && same_bytes(pattern, text + i, 0, m - 1)) return i;
+        i += pattern->shift[c];
+    }
+    return -1;
+}
+
+/* Horspool search back from a window starting at from */
+static int horspool_backward(const pleditor_search_pattern *pattern, const char *text, int from) {
+    int m = pattern->len;
+
+    for (int i = from; i >= 0; ) {
+        unsigned char c = (unsigned char)text[i];
+        if (same_byte(pattern, c, 0) && same_bytes(pattern, text + i + 1, 1, m - 1)) return i;
+        i -= pattern->reverse_shift[c];
+    }
+    return -1;
+}
+
+/* Offset of the first occurrence of a literal query in text[from..len), or -1 */
+static int literal_forward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    int m = pattern->len;
+
+    if (from < 0) from = 0;
+    if (m == 0) return (from <= len) ? from : -1;
+    if (from + m > len) return -1;
+
+    if (m == 1 && !pattern->folded) {
+        int i = from + pleditor_scan_either(text + from, len - from, pattern->bytes[0], pattern->bytes[0]);
+        return (i < len) ? i : -1;
+    }
+
+    /* Candidate windows start before limit */
+    int limit = len - m + 1;
+    int start = from;
+    int misses = 0;
+    while (from < limit) {
+        if (misses >= SEARCH_FILTER_MIN_MISSES &&
+            (from - start) / misses < SEARCH_FILTER_BYTES_PER_MISS) {
+            return horspool_forward(pattern, text, len, from);
+        }
+
+        int i = from + scan_candidates(pattern, text + from, limit - from, m - 1);
+        if (i >= limit) return -1;
+        if (m <= 2 || same_bytes(pattern, text + i + 1, 1, m - 2)) return i;
+
+        misses++;
+        from = i + 1;
+    }
+    return -1;
+}
+
+/* Offset of the last occurrence of a literal query in text[0..len) that
+ * starts at or before from, or -1 */
+static int literal_backward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    int m = pattern->len;
+
+    if (from > len - m) from = len - m;
+    if (from < 0) return -1;
+    if (m == 0) return from;
+
+    if (m == 1) {
+        return scan_candidates_reverse(pattern, text, from + 1, 0);
+    }
+
+    /* Candidate windows start before end */
+    int end = from + 1;
+    int misses = 0;
+    while (end > 0) {
+        if (misses >= SEARCH_FILTER_MIN_MISSES &&
+            (from + 1 - end) / misses < SEARCH_FILTER_BYTES_PER_MISS) {
+            return horspool_backward(pattern, text, end - 1);
+        }
+
+        int i = scan_candidates_reverse(pattern, text, end, m - 1);
+        if (i < 0) return -1;
+        if (m <= 2 || same_bytes(pattern, text + i + 1, 1, m - 2)) return i;
+
+        misses++;
+        end = i;
+    }
+    return -1;
+}
+
+/* Offset of the first match in text[from..len), whole words or not, or -1 */
+static int find_forward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    if (pattern->flags & PLEDITOR_SEARCH_REGEX) {
+        return pattern->regex ? pleditor_regex_forward(pattern->regex, text, len, from) : -1;
+    }
+    return literal_forward(pattern, text, len, from);
+}
+
+/* Offset of the last match starting at or before from, whole words or not,
+ * or -1 */
+static int find_backward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    if (pattern->flags & PLEDITOR_SEARCH_REGEX) {
+        return pattern->regex ? pleditor_regex_backward(pattern->regex, text, len, from) : -1;
+    }
+    return literal_backward(pattern, text, len, from);
+}
+
+/* Neither edge of the match text[start..end) is inside a word: a word byte
+ * at an edge isn't next to another one */
+static bool whole_word(const pleditor_search_pattern *pattern, const char *text, int len,
+                       int start, int end) {
+    const bool *word = pattern->word;
+    if (start > 0 && end > start && word[(unsigned char)text[start - 1]] && word[(unsigned char)text[start]]) {
+        return false;
+    }
+    if (end < len && end > start && word[(unsigned char)text[end]] && word[(unsigned char)text[end - 1]]) {
+        return false;
+    }
+    return true;
+}
+
+/* End of the match of text that starts at at */
+int pleditor_search_match_end(const pleditor_search_pattern *pattern, const char *text, int len, int at) {
+    if (pattern->flags & PLEDITOR_SEARCH_REGEX) {
+        int end = pattern->regex ? pleditor_regex_match_end(pattern->regex, text, len, at) : -1;
+        return (end >= 0) ? end : at;
+    }
+    return at + pattern->len;
+}
+
+/* Is a match found at at one for the pattern's flags */
+static bool accept(const pleditor_search_pattern *pattern, const char *text, int len, int at) {
+    if (!(pattern->flags & PLEDITOR_SEARCH_WHOLE_WORD)) return true;
+    return whole_word(pattern, text, len, at, pleditor_search_match_end(pattern, text, len, at));
+}
+
+/* Offset of the first match in text[from..len), or -1 */
+int pleditor_search_forward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    int col = find_forward(pattern, text, len, from);
+    while (col >= 0 && !accept(pattern, text, len, col)) {
+        col = find_forward(pattern, text, len, col + 1);
+    }
+    return col;
+}
+
+/* Offset of the last match of text[0..len) that starts at or before from,
+ * or -1 */
+int pleditor_search_backward(const pleditor_search_pattern *pattern, const char *text, int len, int from) {
+    int col = find_backward(pattern, text, len, from);
+    while (col >= 0 && !accept(pattern, text, len, col)) {
+        col = find_backward(pattern, text, len, col - 1);
+    }
+    return col;
+}
+
+/* Does a match of the query start at at */
+bool pleditor_search_matches_at(const pleditor_search_pattern *pattern, const char *text, int len, int at) {
+    if (pattern->flags & PLEDITOR_SEARCH_REGEX) {
+        if (!pattern->regex || pleditor_regex_match_end(pattern->regex, text, len, at) < 0) return false;
+    } else if (at < 0 || at + pattern->len > len || !same_bytes(pattern, text + at, 0, pattern->len)) {
+        return false;
+    }
+    return accept(pattern, text, len, at);
+}
+
+/* Matches of a regular expression, passed on if they are whole words */
+typedef struct search_each_filter {
+    const pleditor_search_pattern *pattern;
+    const char *text;
+    int len;
+    void (*found)(int col, void *arg);
+    void *arg;
+} search_each_filter;
+
+static void filter_found(int col, void *arg) {
+    search_each_filter *filter = arg;
+    if (accept(filter->pattern, filter->text, filter->len, col)) filter->found(col, filter->arg);
+}
+
+/**
+ * Call found(col, arg) for the start of every match in text, overlapping
+ * ones included, in order. Returns false if out of memory
+ */
+bool pleditor_search_each(const pleditor_search_pattern *pattern, const char *text, int len,
+                          void (*found)(int col, void *arg), void *arg) {
+    if (pattern->flags & PLEDITOR_SEARCH_REGEX) {
+        if (!pattern->regex) return true;
+        if (!(pattern->flags & PLEDITOR_SEARCH_WHOLE_WORD)) {
+            return pleditor_regex_each(pattern->regex, text, len, found, arg);
+        }
+        search_each_filter filter = {pattern, text, len, found, arg};
+        return pleditor_regex_each(pattern->regex, text, len, filter_found, &filter);
+    }
+
+    int col = pleditor_search_forward(pattern, text, len, 0);
+    while (col >= 0) {
+        found(col, arg);
+        col = pleditor_search_forward(pattern, text, len, col + 1);
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+/**
+ * search.h - Search engine for pleditor
+ */
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+
+/* Query flags */
+#define PLEDITOR_SEARCH_REGEX 1     /* Query is a regular expression */
+#define PLEDITOR_SEARCH_IGNORE_CASE 2 /* ASCII letters match in either case */
+#define PLEDITOR_SEARCH_WHOLE_WORD 4  /* Matches don't start or end inside a word */
+
+struct pleditor_regex;
+
+/* A query compiled for searching many buffers without further setup */
+typedef struct pleditor_search_pattern {
+    char *bytes;        /* Query text, may contain NUL bytes */
+    int len;            /* Query length */
+    int flags;          /* PLEDITOR_SEARCH_* */
+    char *folded;       /* Query with letters lowercased, if ignoring case */
+    char *fold;         /* 0x20 under each letter of folded, 0 elsewhere */
+    bool word[256];     /* Bytes words are made of, for whole words */
+    int shift[256];     /* Horspool shift for each byte under the window end */
+    int reverse_shift[256]; /* Shift back for each byte under the window start */
+    struct pleditor_regex *regex; /* Compiled expression, NULL if invalid */
+    const char *error;  /* Why the expression is invalid, or NULL */
+} pleditor_search_pattern;
+
+/* Copies of a pattern for the chunks of a parallel search, kept from one
+ * batch of rows to the next so that their automata stay built */
+typedef struct pleditor_search_clones {
+    pleditor_search_pattern *patterns;
+    int count;
+} pleditor_search_clones;
+
+/* Function prototypes */
+bool pleditor_search_compile(pleditor_search_pattern *pattern, const char *query, int len, int flags);
+bool pleditor_search_clone(pleditor_search_pattern *pattern, const pleditor_search_pattern *from);
+void pleditor_search_free_pattern(pleditor_search_pattern *pattern);
+bool pleditor_search_clones_reserve(pleditor_search_clones *clones, const pleditor_search_pattern *from,
+                                    int count);
+void pleditor_search_clones_free(pleditor_search_clones *clones);
+int pleditor_search_forward(const pleditor_search_pattern *pattern, const char *text, int len, int from);
+int pleditor_search_backward(const pleditor_search_pattern *pattern, const char *text, int len, int from);
+bool pleditor_search_matches_at(const pleditor_search_pattern *pattern, const char *text, int len, int at);
+int pleditor_search_match_end(const pleditor_search_pattern *pattern, const char *text, int len, int at);
+bool pleditor_search_each(const pleditor_search_pattern *pattern, const char *text, int len,
+                          void (*found)(int col, void *arg), void *arg);
+
+#endif /* SEARCH_H */
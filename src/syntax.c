@@ -5,183 +5,459 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "syntax.h"
 #include "pleditor.h"
+#include "platform.h"
+#include "scan.h"
+#include "bracket.h"
+#include "match.h"
 
-/* C-like language keywords */
-char *C_HL_keywords[] = {
-    /* C keywords */
-    "switch", "if", "while", "for", "break", "continue", "return", "else",
-    "struct", "union", "typedef", "static", "enum", "case",
-    "#include", "#define", "#ifdef", "#ifndef", "#endif", "#pragma",
-    "volatile", "register", "sizeof", "const", "auto", "do", "goto",
-    "default", "extern", "inline", "restrict",
-
-    /* C++ keywords */
-    "namespace", "public", "private", "protected", "virtual", "friend",
-    "new", "delete", "try", "catch", "throw", "this", "constexpr",
-    "final", "override", "explicit", "using",
-
-    /* Types - keyword2 */
-    "int|" , "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-    "void|", "bool|", "short|", "size_t|", "uint8_t|", "uint16_t|", "uint32_t|",
-    "uint64_t|", "int8_t|", "int16_t|", "int32_t|", "int64_t|", "FILE|", "time_t|",
-    "class|", "template|",
-
-    /* Built-in values */
-    "true|", "false|", "NULL|", "nullptr|",
-
-    NULL
+/**
+ * Syntax definitions are plain text with one setting per line:
+ *
+ *   syntax NAME                   start a new definition
+ *   extensions EXT...             file extensions that select it
+ *   comment START                 single line comment
+ *   multiline_comment START END   comment that may span rows
+ *   strings CHAR...               characters that open and close a string
+ *   keywords WORD...              highlighted as keywords
+ *   keywords2 WORD...             types and built-ins; only highlighted
+ *                                 after whitespace, '(' or ','
+ *   definitions WORD...           "WORD name" defines name
+ *   directives WORD...            "#WORD arg" also highlights arg
+ *   include_directive WORD        "#WORD <path>" highlights the path
+ *
+ * Every setting but syntax and extensions is optional, and word lists may
+ * span several lines. Blank lines and lines starting with '#' are ignored.
+ */
+static const char builtin_definitions[] =
+    "syntax c\n"
+    "extensions c h cpp hpp cc cxx c++\n"
+    "comment //\n"
+    "multiline_comment /* */\n"
+    "strings \" '\n"
+    "keywords switch if while for break continue return else\n"
+    "keywords struct union typedef static enum case\n"
+    "keywords #include #define #ifdef #ifndef #endif #pragma\n"
+    "keywords volatile register sizeof const auto do goto\n"
+    "keywords default extern inline restrict\n"
+    "keywords namespace public private protected virtual friend\n"
+    "keywords new delete try catch throw this constexpr\n"
+    "keywords final override explicit using\n"
+    "keywords2 int long double float char unsigned signed\n"
+    "keywords2 void bool short size_t uint8_t uint16_t uint32_t\n"
+    "keywords2 uint64_t int8_t int16_t int32_t int64_t FILE time_t\n"
+    "keywords2 class template\n"
+    "keywords2 true false NULL nullptr\n"
+    "definitions class struct\n"
+    "directives define ifndef ifdef include endif undef pragma\n"
+    "include_directive include\n"
+    "\n"
+    "syntax lua\n"
+    "extensions lua\n"
+    "comment --\n"
+    "multiline_comment --[[ ]]\n"
+    "strings \" '\n"
+    "keywords function local if then else elseif end while\n"
+    "keywords do for repeat until break return in and or not\n"
+    "keywords2 true false nil\n"
+    "keywords2 print pairs ipairs type tonumber tostring require\n"
+    "keywords2 table string math os io coroutine error assert\n"
+    "keywords2 pcall xpcall select rawget rawset rawequal rawlen\n"
+    "keywords2 collectgarbage dofile load loadfile next\n"
+    "definitions function\n"
+    "\n"
+    "syntax python\n"
+    "extensions py pyw\n"
+    "comment #\n"
+    "multiline_comment \"\"\" \"\"\"\n"
+    "strings \" '\n"
+    "keywords def class if elif else while for in try\n"
+    "keywords except finally with as import from pass return\n"
+    "keywords break continue lambda yield global nonlocal assert\n"
+    "keywords raise del not and or is async await match case\n"
+    "keywords2 True False None\n"
+    "keywords2 self super cls\n"
+    "keywords2 int str float list dict tuple set bool\n"
+    "keywords2 bytes bytearray complex frozenset object type\n"
+    "keywords2 print len range enumerate sorted sum min max\n"
+    "keywords2 abs open id input format zip map filter\n"
+    "keywords2 any all dir vars locals globals hasattr\n"
+    "keywords2 getattr setattr delattr isinstance issubclass\n"
+    "keywords2 callable property staticmethod classmethod iter\n"
+    "keywords2 next reversed exec eval repr round pow\n"
+    "definitions def class\n"
+    "\n"
+    "syntax riddle\n"
+    "extensions rid\n"
+    "comment //\n"
+    "multiline_comment /* */\n"
+    "strings \" '\n"
+    "keywords var val for while continue break if else fun\n"
+    "keywords return import package class try catch override\n"
+    "keywords static const public protected private virtual operator\n"
+    "keywords2 int long double float char void bool short\n"
+    "keywords2 true false null\n"
+    "\n"
+    "syntax stamon\n"
+    "extensions st stm\n"
+    "comment //\n"
+    "multiline_comment /* */\n"
+    "strings \" '\n"
+    "keywords class def extends func\n"
+    "keywords break continue\n"
+    "keywords if else while for in\n"
+    "keywords return sfn new null import\n"
+    "keywords true false\n";
+
+/* Every loaded syntax; a later definition wins for a shared extension */
+static pleditor_syntax **syntaxes = NULL;
+static int num_syntaxes = 0;
+
+/* Character classes, one bit each in a profile's class table */
+#define CHAR_SEPARATOR   0x01   /* Ends a word */
+#define CHAR_PUNCTUATION 0x02   /* Highlighted as punctuation */
+#define CHAR_IDENTIFIER  0x04   /* Letter, digit or '_' */
+#define CHAR_SPACE       0x08   /* Whitespace */
+#define CHAR_COMMENT     0x10   /* First byte of a comment start delimiter */
+#define CHAR_QUOTE       0x20   /* Opens a string */
+
+/* Keyword lookup table, see keyword_table_build() */
+typedef struct pleditor_keyword_table pleditor_keyword_table;
+
+/* A word of a syntax definition with its length */
+typedef struct syntax_word {
+    const char *word;
+    int len;
+} syntax_word;
+
+/**
+ * Everything the lexer needs from a syntax definition, compiled when the
+ * definition is loaded: character classes as a byte table, delimiter
+ * lengths, definition words and the keyword hash.
+ */
+struct pleditor_syntax_profile {
+    unsigned char char_class[256];
+    int scs_len;            /* Single line comment start length, 0 if none */
+    int mcs_len;            /* Multi-line comment start length, 0 if none */
+    int mce_len;            /* Multi-line comment end length, 0 if none */
+    syntax_word *definitions;   /* Words followed by a name being defined */
+    int num_definitions;
+    syntax_word *directives;    /* Directives whose argument is highlighted */
+    int num_directives;
+    bool preprocessor;      /* Rows starting with '#' are directives */
+    syntax_word include;    /* Directive taking a path, word NULL if none */
+    char *include_marker;   /* '#' and the include directive */
+    pleditor_keyword_table *keywords;
 };
 
-/* Lua language keywords */
-char *LUA_HL_keywords[] = {
-    /* Lua keywords */
-    "function", "local", "if", "then", "else", "elseif", "end", "while",
-    "do", "for", "repeat", "until", "break", "return", "in", "and", "or", "not",
+/* Can the byte be part of an identifier; the same in every language, and
+ * what whole-word search takes a word to be */
+bool pleditor_syntax_identifier_byte(int c) {
+    return c < 128 && (isalnum(c) || c == '_');
+}
 
-    /* Lua built-in values */
-    "true|", "false|", "nil|",
+/* Is the character a separator */
+static bool is_separator(const pleditor_syntax_profile *profile, char c) {
+    return profile->char_class[(unsigned char)c] & CHAR_SEPARATOR;
+}
 
-    /* Lua built-in functions */
-    "print|", "pairs|", "ipairs|", "type|", "tonumber|", "tostring|", "require|",
-    "table|", "string|", "math|", "os|", "io|", "coroutine|", "error|", "assert|",
-    "pcall|", "xpcall|", "select|", "rawget|", "rawset|", "rawequal|", "rawlen|",
-    "collectgarbage|", "dofile|", "load|", "loadfile|", "next|",
+/* Is the character a punctuation mark to highlight */
+static bool is_punctuation(const pleditor_syntax_profile *profile, char c) {
+    return profile->char_class[(unsigned char)c] & CHAR_PUNCTUATION;
+}
 
-    NULL
-};
+/* Is the character valid in an identifier */
+static bool is_identifier_char(const pleditor_syntax_profile *profile, char c) {
+    return profile->char_class[(unsigned char)c] & CHAR_IDENTIFIER;
+}
+
+/* Is the character whitespace */
+static bool is_space(const pleditor_syntax_profile *profile, char c) {
+    return profile->char_class[(unsigned char)c] & CHAR_SPACE;
+}
+
+/* Does the text at s (len bytes available) start with a delimiter */
+static bool starts_with(const char *s, int len, const char *delim, int delim_len) {
+    return delim_len > 0 && delim_len <= len && s[0] == delim[0] &&
+           memcmp(s, delim, delim_len) == 0;
+}
 
-/* Python language keywords */
-char *PYTHON_HL_keywords[] = {
-    /* Python keywords */
-    "def", "class", "if", "elif", "else", "while", "for", "in", "try",
-    "except", "finally", "with", "as", "import", "from", "pass", "return",
-    "break", "continue", "lambda", "yield", "global", "nonlocal", "assert",
-    "raise", "del", "not", "and", "or", "is", "async", "await", "match", "case",
-
-    /* Python built-in values */
-    "True|", "False|", "None|",
-
-    /* Python special identifiers */
-    "self|", "super|", "cls|",
-
-    /* Python built-in types */
-    "int|", "str|", "float|", "list|", "dict|", "tuple|", "set|", "bool|",
-    "bytes|", "bytearray|", "complex|", "frozenset|", "object|", "type|",
-
-    /* Python built-in functions */
-    "print|", "len|", "range|", "enumerate|", "sorted|", "sum|", "min|", "max|",
-    "abs|", "open|", "id|", "input|", "format|", "zip|", "map|", "filter|",
-    "any|", "all|", "dir|", "vars|", "locals|", "globals|", "hasattr|",
-    "getattr|", "setattr|", "delattr|", "isinstance|", "issubclass|",
-    "callable|", "property|", "staticmethod|", "classmethod|", "iter|",
-    "next|", "reversed|", "exec|", "eval|", "repr|", "round|", "pow|",
-
-    NULL
+/**
+ * Keywords are looked up through a perfect hash built with the "hash and
+ * displace" method: a first hash picks a bucket, and each bucket stores the
+ * seed of a second hash that sends all of its keywords to distinct slots.
+ * A lookup is two hashes of the identifier and one string compare.
+ */
+typedef struct keyword_entry {
+    const char *word;       /* Keyword text, NULL for an empty slot */
+    int len;                /* Keyword length, without the '|' marker */
+    unsigned char hl;       /* HL_KEYWORD1 or HL_KEYWORD2 */
+} keyword_entry;
+
+struct pleditor_keyword_table {
+    keyword_entry *slots;   /* Keywords by their final hash */
+    unsigned int mask;      /* Number of slots - 1 (a power of two) */
+    uint16_t *seeds;        /* Second hash seed for each bucket */
+    unsigned int num_buckets;
+    int max_len;            /* Longest keyword */
 };
 
-/* Riddle language keywords */
-char *RIDDLE_HL_keywords[] = {
-    /* Riddle keywords */
-    "var", "val", "for", "while", "continue", "break", "if", "else", "fun",
-    "return", "import", "package", "class", "try", "catch", "override",
-    "static", "const", "public", "protected", "private", "virtual", "operator",
+#define KEYWORD_MAX_SEED 0xffff
 
-    /* Types - keyword2 */
-    "int|", "long|", "double|", "float|", "char|", "void|", "bool|", "short|",
+/* Seeded FNV-1a hash of a keyword */
+static uint32_t keyword_hash(const char *s, int len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
 
-    /* Riddle built-in values */
-    "true|", "false|", "null|",
+/* Free a compiled keyword table */
+static void keyword_table_free(pleditor_keyword_table *table) {
+    if (!table) return;
+    free(table->slots);
+    free(table->seeds);
+    free(table);
+}
 
-    NULL
-};
+/* Try to place every keyword with the given table size */
+static bool keyword_table_place(pleditor_keyword_table *table, const keyword_entry *keys, int n,
+                                unsigned int size) {
+    table->mask = size - 1;
+    table->slots = calloc(size, sizeof(keyword_entry));
+    table->seeds = calloc(table->num_buckets, sizeof(uint16_t));
+    unsigned int *bucket_of = malloc(sizeof(unsigned int) * n);
+    unsigned int *bucket_size = calloc(table->num_buckets, sizeof(unsigned int));
+    unsigned int *order = malloc(sizeof(unsigned int) * table->num_buckets);
+    unsigned int *slot_of = malloc(sizeof(unsigned int) * n);
+    bool placed = table->slots && table->seeds && bucket_of && bucket_size && order && slot_of;
+
+    if (placed) {
+        for (int k = 0; k < n; k++) {
+            bucket_of[k] = keyword_hash(keys[k].word, keys[k].len, 0) % table->num_buckets;
+            bucket_size[bucket_of[k]]++;
+        }
 
-/* Stamon language keywords */
-char *STAMON_HL_keywords[] = {
-    /* Stamon keywords */"class", "def", "extends", "func",
-	"break", "continue",
-	"if", "else", "while", "for", "in",
-	"return", "sfn", "new", "null", "import",
-	"true", "false",
-    NULL
-};
+        /* Place the fullest buckets first, while most slots are still free */
+        for (unsigned int b = 0; b < table->num_buckets; b++) {
+            unsigned int at = b;
+            while (at > 0 && bucket_size[order[at - 1]] < bucket_size[b]) {
+                order[at] = order[at - 1];
+                at--;
+            }
+            order[at] = b;
+        }
+    }
+
+    for (unsigned int o = 0; placed && o < table->num_buckets; o++) {
+        unsigned int b = order[o];
+        if (bucket_size[b] == 0) break;
+
+        /* Find a seed that sends the bucket's keywords to distinct free slots */
+        uint32_t seed;
+        for (seed = 1; seed <= KEYWORD_MAX_SEED; seed++) {
+            bool fits = true;
+            int placed_here = 0;
+            for (int k = 0; k < n && fits; k++) {
+                if (bucket_of[k] != b) continue;
+                unsigned int slot = keyword_hash(keys[k].word, keys[k].len, seed) & table->mask;
+                if (table->slots[slot].word) {
+                    fits = false;
+                    break;
+                }
+                /* Claim the slot so later keywords of the bucket see it taken */
+                table->slots[slot] = keys[k];
+                slot_of[placed_here++] = slot;
+            }
+            if (fits) break;
+
+            /* Undo the partial placement and try the next seed */
+            for (int u = 0; u < placed_here; u++) {
+                table->slots[slot_of[u]].word = NULL;
+            }
+        }
 
-/* Syntax definitions */
-pleditor_syntax HLDB[] = {
-    /* C-like language */
-    {
-        "c",
-        (char*[]){"c", "h", "cpp", "hpp", "cc", "cxx", "c++", NULL},
-        C_HL_keywords,
-        "//",     /* Single line comment start */
-        "/*",     /* Multi-line comment start */
-        "*/",     /* Multi-line comment end */
-        0         /* Flags */
-    },
-    /* Lua language */
-    {
-        "lua",
-        (char*[]){"lua", NULL},
-        LUA_HL_keywords,
-        "--",     /* Single line comment start */
-        "--[[",   /* Multi-line comment start */
-        "]]",     /* Multi-line comment end */
-        0         /* Flags */
-    },
-    /* Python language */
-    {
-        "python",
-        (char*[]){"py", "pyw", NULL},
-        PYTHON_HL_keywords,
-        "#",      /* Single line comment start */
-        "\"\"\"", /* Multi-line comment/docstring start */
-        "\"\"\"", /* Multi-line comment/docstring end */
-        0         /* Flags */
-    },
-    /* Riddle language */
-    {
-        "riddle",
-        (char*[]){"rid", NULL},
-        RIDDLE_HL_keywords,
-        "//",     /* Single line comment start */
-        "/*",     /* Multi-line comment start */
-        "*/",     /* Multi-line comment end */
-        0
-    },
-	/* Stamon language */
-    {
-        "stamon",
-        (char*[]){"st", "stm", NULL},
-        STAMON_HL_keywords,
-        "//",     /* Single line comment start */
-        "/*",     /* Multi-line comment start */
-        "*/",     /* Multi-line comment end */
-        0
+        if (seed > KEYWORD_MAX_SEED) {
+            placed = false;
+        } else {
+            table->seeds[b] = (uint16_t)seed;
+        }
     }
-};
 
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+    free(bucket_of);
+    free(bucket_size);
+    free(order);
+    free(slot_of);
+    if (!placed) {
+        free(table->slots);
+        free(table->seeds);
+        table->slots = NULL;
+        table->seeds = NULL;
+    }
+    return placed;
+}
 
-/* Is the character a separator */
-static bool is_separator(int c) {
-    return c == '\0' || isspace(c) ||
-    strchr(",.()+-/*=~%<>[];\\{}:\"'", c) != NULL;
+/* Compile a NULL-terminated keyword list ("word" or "type|") into a table */
+static pleditor_keyword_table *keyword_table_build(char **keywords) {
+    int count = 0;
+    while (keywords[count]) count++;
+
+    keyword_entry *keys = malloc(sizeof(keyword_entry) * (count ? count : 1));
+    if (!keys) return NULL;
+
+    /* Parse the list; when a keyword is listed twice the first entry wins */
+    int n = 0;
+    int max_len = 0;
+    for (int j = 0; j < count; j++) {
+        int len = strlen(keywords[j]);
+        bool is_kw2 = len > 0 && keywords[j][len - 1] == '|';
+        if (is_kw2) len--;
+        if (len == 0) continue;
+
+        bool duplicate = false;
+        for (int k = 0; k < n && !duplicate; k++) {
+            duplicate = keys[k].len == len && strncmp(keys[k].word, keywords[j], len) == 0;
+        }
+        if (duplicate) continue;
+
+        keys[n].word = keywords[j];
+        keys[n].len = len;
+        keys[n].hl = is_kw2 ? HL_KEYWORD2 : HL_KEYWORD1;
+        if (len > max_len) max_len = len;
+        n++;
+    }
+
+    pleditor_keyword_table *table = calloc(1, sizeof(pleditor_keyword_table));
+    if (!table) {
+        free(keys);
+        return NULL;
+    }
+    table->max_len = max_len;
+    table->num_buckets = n / 4 + 1;
+
+    /* Start with a nearly full table and grow it if no seeds are found */
+    unsigned int size = 1;
+    while (size < (unsigned int)n) size <<= 1;
+    while (!keyword_table_place(table, keys, n, size)) {
+        size <<= 1;
+        if (size > (1u << 20)) {
+            keyword_table_free(table);
+            table = NULL;
+            break;
+        }
+    }
+
+    free(keys);
+    return table;
 }
 
-/* Is the character a punctuation mark to highlight */
-static bool is_punctuation(int c) {
-    return strchr(",.():;{}[]<>=%+-*/&|^~!", c) != NULL;
+/* Find the keyword exactly matching s[0..len), or NULL */
+static const keyword_entry *keyword_lookup(const pleditor_keyword_table *table,
+                                           const char *s, int len) {
+    if (len > table->max_len) return NULL;
+
+    unsigned int bucket = keyword_hash(s, len, 0) % table->num_buckets;
+    unsigned int slot = keyword_hash(s, len, table->seeds[bucket]) & table->mask;
+    const keyword_entry *entry = &table->slots[slot];
+
+    if (entry->word && entry->len == len && memcmp(entry->word, s, len) == 0) {
+        return entry;
+    }
+    return NULL;
 }
 
-/* Is the character valid in an identifier */
-static bool is_identifier_char(char c) {
-    return isalnum(c) || c == '_';
+/* Free a compiled profile */
+static void profile_free(pleditor_syntax_profile *profile) {
+    if (!profile) return;
+    keyword_table_free(profile->keywords);
+    free(profile->definitions);
+    free(profile->directives);
+    free(profile->include_marker);
+    free(profile);
+}
+
+/* Copy a NULL-terminated word list into an array of words with lengths */
+static syntax_word *words_compile(char **words, int *count) {
+    int n = 0;
+    while (words && words[n]) n++;
+
+    syntax_word *out = malloc(sizeof(syntax_word) * (n + 1));
+    if (!out) return NULL;
+    for (int i = 0; i < n; i++) {
+        out[i].word = words[i];
+        out[i].len = strlen(words[i]);
+    }
+    *count = n;
+    return out;
+}
+
+/* Compile a syntax definition into a lexer profile */
+static pleditor_syntax_profile *profile_build(const pleditor_syntax *syntax) {
+    static char *no_keywords[] = { NULL };
+
+    pleditor_syntax_profile *profile = calloc(1, sizeof(pleditor_syntax_profile));
+    if (!profile) return NULL;
+
+    profile->keywords = keyword_table_build(syntax->keywords ? syntax->keywords : no_keywords);
+    profile->definitions = words_compile(syntax->definitions, &profile->num_definitions);
+    profile->directives = words_compile(syntax->directives, &profile->num_directives);
+    if (!profile->keywords || !profile->definitions || !profile->directives) {
+        profile_free(profile);
+        return NULL;
+    }
+
+    if (syntax->include_directive) {
+        profile->include.word = syntax->include_directive;
+        profile->include.len = strlen(syntax->include_directive);
+        profile->include_marker = malloc(profile->include.len + 2);
+        if (!profile->include_marker) {
+            profile_free(profile);
+            return NULL;
+        }
+        profile->include_marker[0] = '#';
+        strcpy(profile->include_marker + 1, syntax->include_directive);
+    }
+    profile->preprocessor = profile->num_directives > 0 || profile->include.word;
+
+    /* The NUL byte counts as both a separator and punctuation */
+    const char *separators = ",.()+-/*=~%<>[];\\{}:\"'";
+    const char *punctuation = ",.():;{}[]<>=%+-*/&|^~!";
+    profile->char_class[0] = CHAR_SEPARATOR | CHAR_PUNCTUATION;
+    for (int c = 1; c < 256; c++) {
+        unsigned char cls = 0;
+        if (c < 128 && isspace(c)) cls |= CHAR_SPACE | CHAR_SEPARATOR;
+        if (strchr(separators, c)) cls |= CHAR_SEPARATOR;
+        if (strchr(punctuation, c)) cls |= CHAR_PUNCTUATION;
+        if (pleditor_syntax_identifier_byte(c)) cls |= CHAR_IDENTIFIER;
+        if (syntax->quotes && strchr(syntax->quotes, c)) cls |= CHAR_QUOTE;
+        profile->char_class[c] = cls;
+    }
+
+    profile->scs_len = syntax->singleline_comment_start ? strlen(syntax->singleline_comment_start) : 0;
+    profile->mcs_len = syntax->multiline_comment_start ? strlen(syntax->multiline_comment_start) : 0;
+    profile->mce_len = syntax->multiline_comment_end ? strlen(syntax->multiline_comment_end) : 0;
+
+    /* Comment delimiters are only compared where one could start */
+    if (profile->scs_len > 0) {
+        profile->char_class[(unsigned char)syntax->singleline_comment_start[0]] |= CHAR_COMMENT;
+    }
+    if (profile->mcs_len > 0) {
+        profile->char_class[(unsigned char)syntax->multiline_comment_start[0]] |= CHAR_COMMENT;
+    }
+
+    return profile;
 }
 
 /* Highlight function or class name in definitions or calls */
-static void highlight_function_class(pleditor_state *state, pleditor_row *row, int *i) {
+static void highlight_function_class(const pleditor_syntax_profile *profile, pleditor_row *row, int *i) {
     char *line = row->render;
     int line_len = row->render_size;
 
@@ -193,74 +469,14 @@ static void highlight_function_class(pleditor_state *state, pleditor_row *row, i
     int kw_len = 0;
     int j, idx;
 
-    /* Look ahead for patterns based on language */
-    if (state->syntax) {
-        if (strcmp(state->syntax->filetype, "python") == 0) {
-            /* Python: Check for 'def ' or 'class ' */
-            if (*i > 0 && is_separator(line[*i - 1])) {
-                if (*i + 3 < line_len && strncmp(&line[*i], "def ", 4) == 0) {
-                    is_def = true;
-                    kw_len = 4;
-                } else if (*i + 5 < line_len && strncmp(&line[*i], "class ", 6) == 0) {
-                    is_def = true;
-                    kw_len = 6;
-                }
-            }
-        } else if (strcmp(state->syntax->filetype, "lua") == 0) {
-            /* Lua: Check for 'function ' */
-            if (*i > 0 && is_separator(line[*i - 1])) {
-                if (*i + 8 < line_len && strncmp(&line[*i], "function ", 9) == 0) {
-                    is_def = true;
-                    kw_len = 9;
-                }
-            }
-        } else if (strcmp(state->syntax->filetype, "c") == 0) {
-            /* Class declaration: "class Name" */
-            if (*i > 0 && is_separator(line[*i - 1])) {
-                if (*i + 5 < line_len && strncmp(&line[*i], "class ", 6) == 0) {
-                    is_def = true;
-                    kw_len = 6;
-                } else if (*i + 3 < line_len && strncmp(&line[*i], "struct ", 7) == 0) {
-                    is_def = true;
-                    kw_len = 7;
-                }
-            }
-
-            /* C function definition check */
-            if (!is_def && *i > 0) {
-                /* Check for function pattern: Look for spaces, then identifier, then ( */
-                for (j = *i; j < line_len && is_identifier_char(line[j]); j++);
-
-                /* If it's followed by a ( after possible whitespace, it might be a function */
-                idx = j;
-                while (idx < line_len && isspace(line[idx])) idx++;
-
-                if (idx < line_len && line[idx] == '(') {
-                    /* Likely a function, check if declaration or call */
-                    bool has_body = false;
-
-                    /* Skip to the end of the parameter list */
-                    int paren_level = 1;
-                    idx++;
-                    while (idx < line_len && paren_level > 0) {
-                        if (line[idx] == '(') paren_level++;
-                        else if (line[idx] == ')') paren_level--;
-                        idx++;
-                    }
-
-                    /* Check for { after the closing ) - indicates a function definition */
-                    while (idx < line_len && isspace(line[idx])) idx++;
-                    if (idx < line_len && line[idx] == '{') has_body = true;
-
-                    /* If it's a definition or we're not sure, highlight it */
-                    if (has_body || (j > *i)) {
-                        for (idx = *i; idx < j; idx++) {
-                            row->hl->hl[idx] = HL_FUNC_CLASS_NAME;
-                        }
-                        *i = j - 1; /* position just before the end */
-                        return;
-                    }
-                }
+    /* A definition word of the language, e.g. "def name" */
+    if (*i > 0 && is_separator(profile, line[*i - 1])) {
+        for (int d = 0; d < profile->num_definitions && !is_def; d++) {
+            const syntax_word *def = &profile->definitions[d];
+            if (*i + def->len < line_len && line[*i + def->len] == ' ' &&
+                memcmp(&line[*i], def->word, def->len) == 0) {
+                is_def = true;
+                kw_len = def->len + 1;
             }
         }
     }
@@ -268,15 +484,15 @@ static void highlight_function_class(pleditor_state *state, pleditor_row *row, i
     if (is_def) {
         /* Skip the keyword and spaces */
         *i += kw_len;
-        while (*i < line_len && isspace(line[*i])) (*i)++;
+        while (*i < line_len && is_space(profile, line[*i])) (*i)++;
 
         /* Highlight the function/class name */
         int name_start = *i;
-        while (*i < line_len && is_identifier_char(line[*i])) (*i)++;
+        while (*i < line_len && is_identifier_char(profile, line[*i])) (*i)++;
 
         if (*i > name_start) {
             for (j = name_start; j < *i; j++) {
-                row->hl->hl[j] = HL_FUNC_CLASS_NAME;
+                row->hl.hl[j] = HL_FUNC_CLASS_NAME;
             }
             /* Don't increment i again since the loop will do it */
             (*i)--;
@@ -284,16 +500,16 @@ static void highlight_function_class(pleditor_state *state, pleditor_row *row, i
     } else {
         /* Check for function calls: name(... */
         int name_start = *i;
-        while (*i < line_len && is_identifier_char(line[*i])) (*i)++;
+        while (*i < line_len && is_identifier_char(profile, line[*i])) (*i)++;
 
         /* If we have an identifier followed by a parenthesis, it's likely a function call */
         if (*i > name_start) {
             idx = *i;
-            while (idx < line_len && isspace(line[idx])) idx++;
+            while (idx < line_len && is_space(profile, line[idx])) idx++;
 
             if (idx < line_len && line[idx] == '(') {
                 for (j = name_start; j < *i; j++) {
-                    row->hl->hl[j] = HL_FUNC_CLASS_NAME;
+                    row->hl.hl[j] = HL_FUNC_CLASS_NAME;
                 }
             }
         }
@@ -303,10 +519,10 @@ static void highlight_function_class(pleditor_state *state, pleditor_row *row, i
 }
 
 /* Handle punctuation highlighting */
-static void highlight_punctuation(pleditor_row *row, int i) {
+static void highlight_punctuation(const pleditor_syntax_profile *profile, pleditor_row *row, int i) {
     /* Check for single character punctuation */
-    if (i < row->render_size && is_punctuation(row->render[i])) {
-        row->hl->hl[i] = HL_PUNCTUATION;
+    if (i < row->render_size && is_punctuation(profile, row->render[i])) {
+        row->hl.hl[i] = HL_PUNCTUATION;
 
         /* Check for compound operators */
         if (i + 1 < row->render_size) {
@@ -315,27 +531,27 @@ static void highlight_punctuation(pleditor_row *row, int i) {
 
             /* Check for common compound operators where second char is '=' */
             if (c2 == '=' && strchr("+-*/=!&|^<>%", c1) != NULL) {
-                row->hl->hl[i + 1] = HL_PUNCTUATION;
+                row->hl.hl[i + 1] = HL_PUNCTUATION;
             }
 
             /* Check for increment/decrement operators */
             else if ((c1 == '+' && c2 == '+') || (c1 == '-' && c2 == '-')) {
-                row->hl->hl[i + 1] = HL_PUNCTUATION;
+                row->hl.hl[i + 1] = HL_PUNCTUATION;
             }
 
             /* Check for shift operators */
             else if ((c1 == '<' && c2 == '<') || (c1 == '>' && c2 == '>')) {
-                row->hl->hl[i + 1] = HL_PUNCTUATION;
+                row->hl.hl[i + 1] = HL_PUNCTUATION;
             }
 
             /* Check for logical operators */
             else if ((c1 == '&' && c2 == '&') || (c1 == '|' && c2 == '|')) {
-                row->hl->hl[i + 1] = HL_PUNCTUATION;
+                row->hl.hl[i + 1] = HL_PUNCTUATION;
             }
 
             /* Check for structure dereference operator -> */
             else if (c1 == '-' && c2 == '>') {
-                row->hl->hl[i + 1] = HL_PUNCTUATION;
+                row->hl.hl[i + 1] = HL_PUNCTUATION;
             }
         }
     }
@@ -351,7 +567,7 @@ static bool highlight_based_number(pleditor_row *row, int *i) {
         return false;
 
     /* Highlight the prefix (0x, 0o, 0b) */
-    row->hl->hl[*i] = row->hl->hl[*i + 1] = HL_NUMBER;
+    row->hl.hl[*i] = row->hl.hl[*i + 1] = HL_NUMBER;
     *i += 2;
 
     /* Continue highlighting based on the number format */
@@ -368,37 +584,445 @@ static bool highlight_based_number(pleditor_row *row, int *i) {
 
         if (!valid) break;
 
-        row->hl->hl[*i] = HL_NUMBER;
+        row->hl.hl[*i] = HL_NUMBER;
         (*i)++;
     }
 
     return true;
 }
 
+/* Copy len bytes of s into a new string */
+static char *word_copy(const char *s, int len) {
+    char *copy = malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* Append a copy of a word to a NULL-terminated list; suffix is appended
+ * to the copy ("|" marks a keyword2) */
+static bool word_list_add(char ***list, const char *word, int len, const char *suffix) {
+    int n = 0;
+    while (*list && (*list)[n]) n++;
+
+    char **grown = realloc(*list, sizeof(char *) * (n + 2));
+    if (!grown) return false;
+    *list = grown;
+
+    int suffix_len = strlen(suffix);
+    char *copy = malloc(len + suffix_len + 1);
+    if (!copy) {
+        (*list)[n] = NULL;
+        return false;
+    }
+    memcpy(copy, word, len);
+    memcpy(copy + len, suffix, suffix_len + 1);
+    grown[n] = copy;
+    grown[n + 1] = NULL;
+    return true;
+}
+
+/* Free a NULL-terminated word list */
+static void word_list_free(char **list) {
+    for (int i = 0; list && list[i]; i++) free(list[i]);
+    free(list);
+}
+
+/* Free a syntax that was being loaded */
+static void syntax_free(pleditor_syntax *syntax) {
+    if (!syntax) return;
+    free(syntax->filetype);
+    word_list_free(syntax->filematch);
+    word_list_free(syntax->keywords);
+    free(syntax->singleline_comment_start);
+    free(syntax->multiline_comment_start);
+    free(syntax->multiline_comment_end);
+    free(syntax->quotes);
+    word_list_free(syntax->definitions);
+    word_list_free(syntax->directives);
+    free(syntax->include_directive);
+    profile_free(syntax->profile);
+    free(syntax);
+}
+
+/* Compile a completely read definition and make it available */
+static bool syntax_register(pleditor_syntax *syntax) {
+    if (!syntax->filematch) return false;
+
+    syntax->profile = profile_build(syntax);
+    if (!syntax->profile) return false;
+
+    pleditor_syntax **grown = realloc(syntaxes, sizeof(pleditor_syntax *) * (num_syntaxes + 1));
+    if (!grown) return false;
+    syntaxes = grown;
+    syntaxes[num_syntaxes++] = syntax;
+    return true;
+}
+
+/* Next whitespace-separated word of a line, NULL at its end */
+static const char *next_word(const char **p, const char *end, int *len) {
+    while (*p < end && isspace((unsigned char)**p)) (*p)++;
+    if (*p == end) return NULL;
+
+    const char *word = *p;
+    while (*p < end && !isspace((unsigned char)**p)) (*p)++;
+    *len = *p - word;
+    return word;
+}
+
+/* Apply one "setting words..." line to the definition being read */
+static bool syntax_parse_setting(pleditor_syntax *syntax, const char *key, int key_len,
+                                 const char *p, const char *end) {
+    char ***list = NULL;
+    const char *suffix = "";
+    char **single = NULL;
+    int min_words = 1, max_words = -1;
+
+#define KEY_IS(name) (key_len == (int)sizeof(name) - 1 && memcmp(key, name, key_len) == 0)
+    if (KEY_IS("extensions")) {
+        list = &syntax->filematch;
+    } else if (KEY_IS("keywords")) {
+        list = &syntax->keywords;
+    } else if (KEY_IS("keywords2")) {
+        list = &syntax->keywords;
+        suffix = "|";
+    } else if (KEY_IS("definitions")) {
+        list = &syntax->definitions;
+    } else if (KEY_IS("directives")) {
+        list = &syntax->directives;
+    } else if (KEY_IS("comment")) {
+        single = &syntax->singleline_comment_start;
+        max_words = 1;
+    } else if (KEY_IS("multiline_comment")) {
+        single = &syntax->multiline_comment_start;
+        min_words = max_words = 2;
+    } else if (KEY_IS("include_directive")) {
+        single = &syntax->include_directive;
+        max_words = 1;
+    } else if (!KEY_IS("strings")) {
+        return false;
+    }
+#undef KEY_IS
+
+    int count = 0;
+    int len;
+    const char *word;
+    while ((word = next_word(&p, end, &len)) != NULL) {
+        if (max_words != -1 && count == max_words) return false;
+
+        if (list) {
+            if (!word_list_add(list, word, len, suffix)) return false;
+        } else if (single) {
+            /* The second word of a multiline comment is its end */
+            char **dst = (count == 0) ? single : &syntax->multiline_comment_end;
+            free(*dst);
+            *dst = word_copy(word, len);
+            if (!*dst) return false;
+        } else {
+            /* strings: single characters */
+            if (len != 1) return false;
+            int have = syntax->quotes ? strlen(syntax->quotes) : 0;
+            char *quotes = realloc(syntax->quotes, have + 2);
+            if (!quotes) return false;
+            quotes[have] = word[0];
+            quotes[have + 1] = '\0';
+            syntax->quotes = quotes;
+        }
+        count++;
+    }
+    return count >= min_words;
+}
+
+/**
+ * Load syntax definitions from text in the format described at the top of
+ * this file. Definitions read before an error stay loaded; error_line is
+ * set to the line that could not be used.
+ */
+bool pleditor_syntax_load(const char *text, size_t len, int *error_line) {
+    const char *p = text;
+    const char *text_end = text + len;
+    pleditor_syntax *current = NULL;
+    int line = 0;
+    int start_line = 0;
+
+    while (p < text_end) {
+        const char *end = memchr(p, '\n', text_end - p);
+        if (!end) end = text_end;
+        line++;
+
+        int key_len;
+        const char *key = next_word(&p, end, &key_len);
+        bool ok = true;
+
+        if (!key || key[0] == '#') {
+            /* Blank line or comment */
+        } else if (key_len == 6 && memcmp(key, "syntax", 6) == 0) {
+            /* A new definition completes the one before it */
+            if (current && !syntax_register(current)) {
+                line = start_line;
+                ok = false;
+            } else {
+                int name_len, extra_len;
+                const char *name = next_word(&p, end, &name_len);
+
+                current = NULL;
+                if (name && !next_word(&p, end, &extra_len)) {
+                    current = calloc(1, sizeof(pleditor_syntax));
+                    if (current) current->filetype = word_copy(name, name_len);
+                }
+                ok = current && current->filetype;
+                start_line = line;
+            }
+        } else {
+            ok = current && syntax_parse_setting(current, key, key_len, p, end);
+        }
+
+        if (!ok) {
+            syntax_free(current);
+            if (error_line) *error_line = line;
+            return false;
+        }
+        p = (end < text_end) ? end + 1 : end;
+    }
+
+    if (current && !syntax_register(current)) {
+        syntax_free(current);
+        if (error_line) *error_line = start_line;
+        return false;
+    }
+    return true;
+}
+
+/* Load syntax definitions from a file */
+bool pleditor_syntax_load_file(const char *filename, int *error_line) {
+    char *buffer;
+    size_t len;
+
+    if (error_line) *error_line = 0;
+    if (!pleditor_platform_read_file(filename, &buffer, &len)) return false;
+
+    bool loaded = pleditor_syntax_load(buffer, len, error_line);
+    free(buffer);
+    return loaded;
+}
+
 /* Initialize syntax highlighting system */
 bool pleditor_syntax_init(pleditor_state *state) {
     state->syntax = NULL;
 
-    /* Select syntax by filename if there is one */
+    state->hl_frontier = 0;
+
+    /* The built-in languages are loaded once, before any from files */
+    if (num_syntaxes == 0 &&
+        !pleditor_syntax_load(builtin_definitions, sizeof(builtin_definitions) - 1, NULL)) {
+        return false;
+    }
+
+    /* Select syntax by filename if there is one; rows are highlighted
+     * when they are first drawn */
     if (state->filename) {
         pleditor_syntax_by_fileext(state, state->filename);
-
-        /* Apply syntax highlighting to all rows */
-        pleditor_syntax_update_all(state);
     }
 
     return true;
 }
 
-/* Apply syntax highlighting to all rows in the file */
-void pleditor_syntax_update_all(pleditor_state *state) {
+static void lex_row(const pleditor_syntax *syntax, pleditor_row *row, unsigned char start);
+static void highlight_row(pleditor_state *state, int row_idx, bool remember);
+
+/* Fewest rows per thread worth splitting a long highlight for */
+#define HL_PARALLEL_MIN_ROWS 4096
+
+/* Rows from begin to end split into equal chunks, one per thread */
+typedef struct hl_parallel_job {
+    const pleditor_syntax *syntax;
+    pleditor_row *rows;
+    int begin, end;
+    int chunks;
+    unsigned char begin_state;  /* Known entry state of the first chunk */
+} hl_parallel_job;
+
+/* Lex one chunk. Its entry state is only known for the first chunk; the
+ * others guess that they start outside a multiline comment */
+static void lex_chunk(int index, void *arg) {
+    hl_parallel_job *job = arg;
+    long long total = job->end - job->begin;
+    int from = job->begin + (int)(total * index / job->chunks);
+    int to = job->begin + (int)(total * (index + 1) / job->chunks);
+    unsigned char start = (index == 0) ? job->begin_state : LEX_NORMAL;
+
+    for (int i = from; i < to; i++) {
+        pleditor_row *row = &job->rows[i];
+        if (!row->hl.valid || row->hl.start_state != start) {
+            lex_row(job->syntax, row, start);
+        }
+        start = row->hl.valid ? row->hl.end_state : LEX_NORMAL;
+    }
+}
+
+/* Lex rows from the highlight frontier up to end, split between threads.
+ * The rows are left for pleditor_syntax_ensure's serial pass to check */
+static void lex_parallel(pleditor_state *state, int end) {
+    int begin = state->hl_frontier;
+    int chunks = pleditor_platform_cpu_count();
+    if (chunks > (end - begin) / HL_PARALLEL_MIN_ROWS) {
+        chunks = (end - begin) / HL_PARALLEL_MIN_ROWS;
+    }
+    if (chunks < 2) return;
+
+    hl_parallel_job job = {
+        .syntax = state->syntax,
+        .rows = state->rows,
+        .begin = begin,
+        .end = end,
+        .chunks = chunks,
+        .begin_state = (begin > 0) ? state->rows[begin - 1].hl.end_state : LEX_NORMAL,
+    };
+    pleditor_platform_parallel_for(chunks, lex_chunk, &job);
+
+    /* The chunks don't touch the bracket index; rows the serial pass lexes
+     * again update it once more */
+    if (state->brackets) {
+        for (int i = begin; i < end; i++) {
+            pleditor_bracket_row_changed(state, i);
+        }
+    }
+}
+
+/**
+ * Bring highlighting up to date for every row up to last_row. Rows before
+ * state->hl_frontier are known to be current; a row past it is lexed again
+ * only if its text changed or it now starts in a different lexer state.
+ */
+void pleditor_syntax_ensure(pleditor_state *state, int last_row) {
     if (!state->syntax) return;
+    if (last_row >= state->num_rows) last_row = state->num_rows - 1;
+
+    /* A long stretch, as after a jump to the end of the file, is lexed in
+     * parallel first; the serial pass then re-lexes the rows of a chunk
+     * whose guessed entry state was wrong, up to the first row that ends in
+     * the same state either way */
+    if (last_row - state->hl_frontier >= 2 * HL_PARALLEL_MIN_ROWS) {
+        lex_parallel(state, last_row + 1);
+    }
 
-    for (int i = 0; i < state->num_rows; i++) {
-        pleditor_syntax_update_row(state, i);
+    while (state->hl_frontier <= last_row) {
+        int i = state->hl_frontier;
+        pleditor_row *row = &state->rows[i];
+        unsigned char start = (i > 0) ? state->rows[i - 1].hl.end_state : LEX_NORMAL;
+
+        if (!row->hl.valid || row->hl.start_state != start) {
+            pleditor_syntax_update_row(state, i);
+        }
+        state->hl_frontier++;
+    }
+}
+
+/* Most rows an edit re-lexes right away; rows past them wait until drawn */
+#define HL_CONVERGE_MAX_ROWS 256
+
+/**
+ * Re-lex rows from row_idx on after an edit. Rows before row_idx are
+ * current and rows from there up to known were current before the edit,
+ * given the entry states they were lexed with. The walk stops at the first
+ * row whose exit state matches the entry state the next row was lexed
+ * with: nothing past it changes. Returns the new highlight frontier.
+ */
+static int converge(pleditor_state *state, int row_idx, int known) {
+    if (known > state->num_rows) known = state->num_rows;
+
+    int relexed = 0;
+    for (int i = row_idx; i < known; i++) {
+        pleditor_row *row = &state->rows[i];
+        unsigned char start = (i > 0) ? state->rows[i - 1].hl.end_state : LEX_NORMAL;
+
+        if (!row->hl.valid || row->hl.start_state != start) {
+            if (relexed++ == HL_CONVERGE_MAX_ROWS) return i;
+
+            /* The edited row has new text at every keystroke; remembering
+             * it would allocate each time for text unlikely to come back */
+            highlight_row(state, i, i != row_idx);
+            pleditor_bracket_row_changed(state, i);
+            if (!row->hl.valid) return i;
+        }
+
+        if (i + 1 < known && state->rows[i + 1].hl.valid &&
+            state->rows[i + 1].hl.start_state == row->hl.end_state) {
+            return known;
+        }
+    }
+    return known;
+}
+
+/* The text of a row changed: re-lex it and any rows its new exit state
+ * affects */
+void pleditor_syntax_invalidate(pleditor_state *state, int row_idx) {
+    if (row_idx < 0 || row_idx >= state->num_rows) {
+        pleditor_syntax_invalidate_from(state, row_idx);
+        return;
+    }
+
+    pleditor_match_row_changed(state, row_idx);
+    pleditor_trigram_row_changed(state, row_idx);
+
+    state->rows[row_idx].hl.valid = false;
+    if (state->syntax && row_idx < state->hl_frontier) {
+        state->hl_frontier = converge(state, row_idx, state->hl_frontier);
+    } else if (!state->syntax) {
+        /* Without a lexer every bracket counts */
+        pleditor_bracket_row_changed(state, row_idx);
+    }
+}
+
+/* A row was inserted at row_idx; the rows after it moved down by one */
+void pleditor_syntax_row_inserted(pleditor_state *state, int row_idx) {
+    pleditor_bracket_row_inserted(state, row_idx);
+    pleditor_match_row_inserted(state, row_idx);
+    pleditor_trigram_row_inserted(state, row_idx);
+    if (state->syntax && row_idx < state->hl_frontier) {
+        state->hl_frontier = converge(state, row_idx, state->hl_frontier + 1);
+    } else {
+        pleditor_syntax_invalidate_from(state, row_idx);
     }
 }
 
+/* The row at row_idx was deleted; the rows after it moved up by one */
+void pleditor_syntax_row_deleted(pleditor_state *state, int row_idx) {
+    pleditor_bracket_row_deleted(state, row_idx);
+    pleditor_match_row_deleted(state, row_idx);
+    pleditor_trigram_row_deleted(state, row_idx);
+    if (state->syntax && row_idx < state->hl_frontier) {
+        state->hl_frontier = converge(state, row_idx, state->hl_frontier - 1);
+    } else {
+        pleditor_syntax_invalidate_from(state, row_idx);
+    }
+}
+
+/* Rows from row_idx on may start in a different lexer state */
+void pleditor_syntax_invalidate_from(pleditor_state *state, int row_idx) {
+    if (row_idx < 0) row_idx = 0;
+    if (state->hl_frontier > row_idx) state->hl_frontier = row_idx;
+}
+
+/* The text of a row changed as one of many: it is lexed again when rows
+ * are next brought up to date rather than now. pleditor_syntax_rows_changed
+ * follows the last of them */
+void pleditor_syntax_mark_changed(pleditor_state *state, int row_idx) {
+    state->rows[row_idx].hl.valid = false;
+    pleditor_trigram_row_changed(state, row_idx);
+    if (!state->syntax) {
+        /* Without a lexer every bracket counts */
+        pleditor_bracket_row_changed(state, row_idx);
+    }
+}
+
+/* Rows from row_idx on were marked changed */
+void pleditor_syntax_rows_changed(pleditor_state *state, int row_idx) {
+    pleditor_match_invalidate(state);
+    pleditor_syntax_invalidate_from(state, row_idx);
+}
+
 /* Map highlight values to ansi escape code */
 int pleditor_syntax_color_to_ansi(int hl) {
     switch(hl) {
@@ -426,6 +1050,16 @@ int pleditor_syntax_color_to_ansi(int hl) {
 void pleditor_syntax_by_fileext(pleditor_state *state, const char *filename) {
     state->syntax = NULL;
 
+    /* The bracket index counted brackets as the previous syntax lexed them */
+    pleditor_bracket_free(state);
+
+    /* Highlighting from a previous syntax no longer applies. The text is
+     * unchanged, so the match and trigram indexes are left alone */
+    for (int i = 0; i < state->num_rows; i++) {
+        state->rows[i].hl.valid = false;
+    }
+    state->hl_frontier = 0;
+
     /* No filename, so no highlighting */
     if (!filename) return;
 
@@ -434,110 +1068,120 @@ void pleditor_syntax_by_fileext(pleditor_state *state, const char *filename) {
     if (!ext) return;
     ext++; /* Skip the dot */
 
-    /* Try to match file extension with a syntax */
-    for (unsigned int i = 0; i < HLDB_ENTRIES; i++) {
-        pleditor_syntax *syntax = &HLDB[i];
-        char **pattern = syntax->filematch;
+    /* Try to match file extension with a syntax, latest definition first */
+    for (int i = num_syntaxes - 1; i >= 0; i--) {
+        pleditor_syntax *syntax = syntaxes[i];
 
-        while (*pattern) {
-            /* Check if extension matches */
+        for (char **pattern = syntax->filematch; *pattern; pattern++) {
             if (strcmp(*pattern, ext) == 0) {
                 state->syntax = syntax;
                 return;
             }
-            pattern++;
         }
     }
 }
 
-/* Update highlighting for a row */
-void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
-    pleditor_row *row = &state->rows[row_idx];
-
-    /* Free existing highlighting memory */
-    if (row->hl) {
-        free(row->hl->hl);
-        free(row->hl);
+/* Make the row's highlight buffer large enough for its text. The buffer
+ * is reused and grows geometrically, so re-lexing rarely allocates */
+static bool hl_reserve(pleditor_row *row) {
+    if (row->render_size > row->hl.capacity) {
+        int capacity = row->hl.capacity ? row->hl.capacity : 16;
+        while (capacity < row->render_size) capacity *= 2;
+
+        unsigned char *hl = realloc(row->hl.hl, capacity);
+        if (!hl) {
+            row->hl.valid = false;
+            return false;
+        }
+        row->hl.hl = hl;
+        row->hl.capacity = capacity;
     }
+    return true;
+}
+
+/* Lex one row that starts in the given state. Only the row itself is
+ * written, so different rows may be lexed on different threads */
+static void lex_row(const pleditor_syntax *syntax, pleditor_row *row, unsigned char start) {
+    if (!hl_reserve(row)) return;
 
-    /* Allocate new highlight struct */
-    row->hl = malloc(sizeof(pleditor_highlight_row));
-    row->hl->hl = malloc(row->render_size);
-    memset(row->hl->hl, HL_NORMAL, row->render_size);
-    row->hl->hl_multiline_comment = false;
+    memset(row->hl.hl, HL_NORMAL, row->render_size);
+    row->hl.start_state = start;
+    row->hl.end_state = LEX_NORMAL;
+    row->hl.valid = true;
 
     /* If no syntax, leave everything as normal */
-    if (!state->syntax) return;
+    if (!syntax) return;
 
-    char **keywords = state->syntax->keywords;
-    char *scs = state->syntax->singleline_comment_start;
-    char *mcs = state->syntax->multiline_comment_start;
-    char *mce = state->syntax->multiline_comment_end;
+    const pleditor_syntax_profile *profile = syntax->profile;
+    const pleditor_keyword_table *keyword_table = profile->keywords;
+    char *scs = syntax->singleline_comment_start;
+    char *mcs = syntax->multiline_comment_start;
+    char *mce = syntax->multiline_comment_end;
 
     bool prev_sep = true;
     int in_string = 0;
-    bool in_comment = (row_idx > 0 && state->rows[row_idx-1].hl) ?
-                    state->rows[row_idx-1].hl->hl_multiline_comment : false;
+    bool in_comment = row->hl.start_state == LEX_MULTILINE_COMMENT;
 
-    /* Check for preprocessor directives in C/C++ at the beginning of the line */
-    if (state->syntax && (strcmp(state->syntax->filetype, "c") == 0)) {
-        if (row->render_size > 0 && row->render[0] == '#') {
-            /* Highlight the # character */
-            row->hl->hl[0] = HL_KEYWORD1;
+    /* Whether the row contains "#include", looked up at the first '<' */
+    int include_row = -1;
 
-            /* Find the directive word (e.g., define, ifndef) */
-            int j = 1;
-            while (j < row->render_size && isspace(row->render[j])) j++;
+    /* Preprocessor directive at the beginning of the line */
+    if (profile->preprocessor && row->render_size > 0 && row->render[0] == '#') {
+        /* Highlight the # character */
+        row->hl.hl[0] = HL_KEYWORD1;
 
-            int directive_start = j;
-            while (j < row->render_size && isalpha(row->render[j])) j++;
+        /* Find the directive word (e.g., define, ifndef) */
+        int j = 1;
+        while (j < row->render_size && is_space(profile, row->render[j])) j++;
 
-            /* Highlight the directive */
-            for (int k = directive_start; k < j; k++) {
-                row->hl->hl[k] = HL_KEYWORD1;
-            }
+        int directive_start = j;
+        while (j < row->render_size && isalpha(row->render[j])) j++;
+
+        /* Highlight the directive */
+        for (int k = directive_start; k < j; k++) {
+            row->hl.hl[k] = HL_KEYWORD1;
+        }
+
+        /* Highlight what follows the directive for specific cases */
+        const char *directive = &row->render[directive_start];
+        int len = j - directive_start;
+        bool is_include = len > 0 && len == profile->include.len &&
+                          memcmp(directive, profile->include.word, len) == 0;
+        bool has_argument = is_include;
+        for (int d = 0; d < profile->num_directives && !has_argument; d++) {
+            has_argument = len > 0 && len == profile->directives[d].len &&
+                           memcmp(directive, profile->directives[d].word, len) == 0;
+        }
+
+        if (has_argument) {
+            /* Skip whitespace after directive */
+            while (j < row->render_size && is_space(profile, row->render[j])) j++;
+
+            /* Highlight the identifier */
+            int ident_start = j;
 
-            /* Highlight what follows the directive for specific cases */
-            if (directive_start < j) {
-                int len = j - directive_start;
-                if ((len == 6 && strncmp(&row->render[directive_start], "define", len) == 0) ||
-                    (len == 6 && strncmp(&row->render[directive_start], "ifndef", len) == 0) ||
-                    (len == 5 && strncmp(&row->render[directive_start], "ifdef", len) == 0) ||
-                    (len == 7 && strncmp(&row->render[directive_start], "include", len) == 0) ||
-                    (len == 5 && strncmp(&row->render[directive_start], "endif", len) == 0) ||
-                    (len == 5 && strncmp(&row->render[directive_start], "undef", len) == 0) ||
-                    (len == 6 && strncmp(&row->render[directive_start], "pragma", len) == 0)) {
-
-                    /* Skip whitespace after directive */
-                    while (j < row->render_size && isspace(row->render[j])) j++;
-
-                    /* Highlight the identifier */
-                    int ident_start = j;
-
-                    /* For #include, handle both <...> and "..." forms */
-                    if (len == 7 && j < row->render_size &&
-                        (row->render[j] == '<' || row->render[j] == '"')) {
-                        char end_char = (row->render[j] == '<') ? '>' : '"';
-                        row->hl->hl[j++] = HL_KEYWORD2; /* Highlight the opening < or " */
-
-                        /* Find the closing character */
-                        while (j < row->render_size && row->render[j] != end_char) {
-                            row->hl->hl[j++] = HL_KEYWORD2;
-                        }
-                        if (j < row->render_size) {
-                            row->hl->hl[j++] = HL_KEYWORD2; /* Highlight the closing > or " */
-                        }
-                    } else {
-                        /* For other directives, highlight the identifier */
-                        while (j < row->render_size &&
-                              (is_identifier_char(row->render[j]) || row->render[j] == '.')) {
-                            j++;
-                        }
-
-                        for (int k = ident_start; k < j; k++) {
-                            row->hl->hl[k] = HL_KEYWORD2;
-                        }
-                    }
+            /* For #include, handle both <...> and "..." forms */
+            if (is_include && j < row->render_size &&
+                (row->render[j] == '<' || row->render[j] == '"')) {
+                char end_char = (row->render[j] == '<') ? '>' : '"';
+                row->hl.hl[j++] = HL_KEYWORD2; /* Highlight the opening < or " */
+
+                /* Find the closing character */
+                while (j < row->render_size && row->render[j] != end_char) {
+                    row->hl.hl[j++] = HL_KEYWORD2;
+                }
+                if (j < row->render_size) {
+                    row->hl.hl[j++] = HL_KEYWORD2; /* Highlight the closing > or " */
+                }
+            } else {
+                /* For other directives, highlight the identifier */
+                while (j < row->render_size &&
+                      (is_identifier_char(profile, row->render[j]) || row->render[j] == '.')) {
+                    j++;
+                }
+
+                for (int k = ident_start; k < j; k++) {
+                    row->hl.hl[k] = HL_KEYWORD2;
                 }
             }
         }
@@ -546,13 +1190,22 @@ void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
     int i = 0;
     while (i < row->render_size) {
         char c = row->render[i];
-        unsigned char prev_hl = (i > 0) ? row->hl->hl[i-1] : HL_NORMAL;
+        unsigned char prev_hl = (i > 0) ? row->hl.hl[i-1] : HL_NORMAL;
 
         /* String handling */
         if (in_string) {
-            row->hl->hl[i] = HL_STRING;
+            /* Bytes before the closing quote or an escape are plain string */
+            int run = pleditor_scan_either(&row->render[i], row->render_size - i, in_string, '\\');
+            if (run > 0) {
+                memset(&row->hl.hl[i], HL_STRING, run);
+                i += run;
+                prev_sep = true;
+                continue;
+            }
+
+            row->hl.hl[i] = HL_STRING;
             if (c == '\\' && i + 1 < row->render_size) {
-                row->hl->hl[i+1] = HL_STRING;
+                row->hl.hl[i+1] = HL_STRING;
                 i += 2;
                 continue;
             }
@@ -564,11 +1217,20 @@ void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
 
         /* Comment handling */
         if (in_comment) {
-            row->hl->hl[i] = HL_MULTILINE_COMMENT;
-            if (mce && strncmp(&row->render[i], mce, strlen(mce)) == 0) {
-                for (unsigned int j = 0; j < strlen(mce); j++)
-                    row->hl->hl[i+j] = HL_MULTILINE_COMMENT;
-                i += strlen(mce);
+            /* Bytes before one that could start the end delimiter */
+            int run = (profile->mce_len > 0) ?
+                pleditor_scan_either(&row->render[i], row->render_size - i, mce[0], mce[0]) :
+                row->render_size - i;
+            if (run > 0) {
+                memset(&row->hl.hl[i], HL_MULTILINE_COMMENT, run);
+                i += run;
+                continue;
+            }
+
+            row->hl.hl[i] = HL_MULTILINE_COMMENT;
+            if (starts_with(&row->render[i], row->render_size - i, mce, profile->mce_len)) {
+                memset(&row->hl.hl[i], HL_MULTILINE_COMMENT, profile->mce_len);
+                i += profile->mce_len;
                 in_comment = false;
                 prev_sep = true;
                 continue;
@@ -578,29 +1240,39 @@ void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
             }
         }
 
+        /* A run of blanks only separates words */
+        if (c == ' ') {
+            i += pleditor_scan_past(&row->render[i], row->render_size - i, ' ');
+            prev_sep = true;
+            continue;
+        }
+
         /* Start of multi-line comment */
-        if (mcs && strncmp(&row->render[i], mcs, strlen(mcs)) == 0) {
-            for (unsigned int j = 0; j < strlen(mcs); j++)
-                row->hl->hl[i+j] = HL_MULTILINE_COMMENT;
-            i += strlen(mcs);
+        bool maybe_comment = profile->char_class[(unsigned char)c] & CHAR_COMMENT;
+        if (maybe_comment && starts_with(&row->render[i], row->render_size - i, mcs, profile->mcs_len)) {
+            memset(&row->hl.hl[i], HL_MULTILINE_COMMENT, profile->mcs_len);
+            i += profile->mcs_len;
             in_comment = true;
             continue;
         }
 
         /* Start of single-line comment */
-        if (scs && strncmp(&row->render[i], scs, strlen(scs)) == 0) {
+        if (maybe_comment && starts_with(&row->render[i], row->render_size - i, scs, profile->scs_len)) {
             for (int j = i; j < row->render_size; j++)
-                row->hl->hl[j] = HL_COMMENT;
+                row->hl.hl[j] = HL_COMMENT;
             break;
         }
 
         /* String start or include brackets <> */
-        if (c == '"' || c == '\'' ||
-            (c == '<' && prev_sep && strstr(row->render, "#include") != NULL)) {
+        if (c == '<' && prev_sep && include_row == -1) {
+            include_row = profile->include_marker && strstr(row->render, profile->include_marker);
+        }
+        if ((profile->char_class[(unsigned char)c] & CHAR_QUOTE) ||
+            (c == '<' && prev_sep && include_row == 1)) {
             /* Set appropriate closing character */
             char closing = (c == '<') ? '>' : c;
             in_string = closing;
-            row->hl->hl[i] = HL_STRING;
+            row->hl.hl[i] = HL_STRING;
             i++;
             continue;
         }
@@ -615,14 +1287,14 @@ void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
 
             /* Regular decimal number */
             if (prev_sep || prev_hl == HL_NUMBER) {
-                row->hl->hl[i] = HL_NUMBER;
+                row->hl.hl[i] = HL_NUMBER;
                 i++;
                 prev_sep = false;
                 continue;
             }
         } else if (c == '.' && prev_hl == HL_NUMBER) {
             /* Decimal point in a number */
-            row->hl->hl[i] = HL_NUMBER;
+            row->hl.hl[i] = HL_NUMBER;
             i++;
             prev_sep = false;
             continue;
@@ -630,102 +1302,220 @@ void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
 
         /* Handle special case for colon in array slices and Python statements */
         if (c == ':') {
-            row->hl->hl[i] = HL_PUNCTUATION;
+            row->hl.hl[i] = HL_PUNCTUATION;
             i++;
             prev_sep = true; /* Treat colon as separator */
             continue;
         }
 
-        /* Keyword handling */
-        if (prev_sep) {
-            bool found_keyword = false;
-            for (int j = 0; keywords[j]; j++) {
-                int klen = strlen(keywords[j]);
-                bool is_kw2 = keywords[j][klen-1] == '|';
-
-                if (is_kw2) klen--;
-
-                /* Special handling for Python identifiers that need context checks */
-                bool is_valid_match = strncmp(&row->render[i], keywords[j], klen) == 0 &&
-                                      is_separator(row->render[i + klen]);
-
-                if (is_kw2) {
-                    for (int back = i - 1; back >= 0 && back >= i - 20; back--) {
-                        if (row->render[back] == '(' || row->render[back] == ',') {
-                            /* Found valid context */
-                            break;
-                        }
-                        if (!isspace(row->render[back])) {
-                            /* Found non-whitespace that's not a separator we expect */
-                            if (back == i - 1) {
-                                is_valid_match = false; /* directly adjacent */
-                            }
-                            break;
-                        }
-                    }
-                }
+        /* Keyword handling: the run of non-separators starting here must be
+         * a keyword exactly */
+        if (prev_sep && keyword_table) {
+            int end = i;
+            while (end < row->render_size && !is_separator(profile, row->render[end])) end++;
 
-                if (is_valid_match) {
-                    /* Apply keyword highlighting */
-                    for (int k = 0; k < klen; k++)
-                        row->hl->hl[i+k] = is_kw2 ? HL_KEYWORD2 : HL_KEYWORD1;
-                    i += klen;
-                    found_keyword = true;
-                    break;
-                }
+            const keyword_entry *kw = (end > i) ?
+                keyword_lookup(keyword_table, &row->render[i], end - i) : NULL;
+
+            /* Type keywords only count after whitespace, '(' or ',' */
+            if (kw && kw->hl == HL_KEYWORD2 && i > 0) {
+                char before = row->render[i - 1];
+                if (!is_space(profile, before) && before != '(' && before != ',') kw = NULL;
             }
 
-            if (found_keyword) {
+            if (kw) {
+                memset(&row->hl.hl[i], kw->hl, kw->len);
+                i += kw->len;
                 prev_sep = false;
                 continue;
             }
         }
 
         /* Highlight punctuation */
-        highlight_punctuation(row, i);
+        highlight_punctuation(profile, row, i);
 
         /* Check for function or class names */
         if ((isalpha(c) || c == '_') && prev_sep) {
-            highlight_function_class(state, row, &i);
+            highlight_function_class(profile, row, &i);
         }
 
-        /* Empty - Moved preprocessor directive handling to earlier in the code */
+        prev_sep = is_separator(profile, c);
+        i++;
+    }
 
-        /* Special handling for Python indentation */
-        if (state->syntax && strcmp(state->syntax->filetype, "python") == 0) {
-            /* Mark beginning of line whitespace as special in Python */
-            if (i == 0 && isspace(c)) {
-                int indent_end = 0;
-                while (indent_end < row->render_size && isspace(row->render[indent_end])) {
-                    indent_end++;
-                }
-                if (indent_end > 0) {
-                    for (int k = 0; k < indent_end; k++) {
-                        row->hl->hl[k] = HL_NORMAL;
-                    }
-                }
-            }
-        }
+    /* Remember the state the next row starts in */
+    row->hl.end_state = in_comment ? LEX_MULTILINE_COMMENT : LEX_NORMAL;
+}
 
-        prev_sep = is_separator(c);
-        i++;
+/**
+ * Rows whose text was lexed recently, from the same entry state and with
+ * the same syntax, reuse the highlighting computed then. This covers undo
+ * and redo putting back earlier text and files with many identical lines.
+ * The cache is set associative; entries used since the clock hand last
+ * passed them survive eviction, and the text and highlighting held stay
+ * within a memory budget.
+ */
+#define HL_CACHE_SETS 4096
+#define HL_CACHE_WAYS 4
+#define HL_CACHE_BUDGET (4 * 1024 * 1024)
+
+/* Rows shorter than this are lexed about as fast as they are looked up */
+#define HL_CACHE_MIN_LEN 16
+
+typedef struct hl_cache_entry {
+    uint64_t hash;              /* Hash of the row text */
+    const pleditor_syntax *syntax;
+    unsigned char *bytes;       /* Row text followed by its highlighting, NULL if unused */
+    int len;                    /* Length of the row text */
+    unsigned char start_state;
+    unsigned char end_state;
+    bool referenced;            /* Used since the clock hand last passed */
+} hl_cache_entry;
+
+struct pleditor_hl_cache {
+    hl_cache_entry entries[HL_CACHE_SETS * HL_CACHE_WAYS];
+    size_t bytes;               /* Text and highlighting held by entries */
+    int hand;                   /* Next entry the clock considers evicting */
+};
+
+/* 64-bit FNV-1a hash of a row's text */
+static uint64_t hl_cache_hash(const char *s, int len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
     }
+    return h;
+}
 
-    /* Update multiline comment status for this row */
-    row->hl->hl_multiline_comment = in_comment;
+/* Drop an entry's text and highlighting */
+static void hl_cache_evict(pleditor_hl_cache *cache, hl_cache_entry *entry) {
+    if (!entry->bytes) return;
+    cache->bytes -= 2 * (size_t)entry->len;
+    free(entry->bytes);
+    entry->bytes = NULL;
 }
 
-/* Update syntax highlighting for rows affected by multi-line comments */
-void pleditor_syntax_update_multiline(pleditor_state *state, int start_row) {
-    if (!state->syntax) return;
+/* Entries of the set a hash belongs to */
+static hl_cache_entry *hl_cache_set(pleditor_hl_cache *cache, uint64_t hash) {
+    return &cache->entries[(hash % HL_CACHE_SETS) * HL_CACHE_WAYS];
+}
+
+/* Copy the cached highlighting of the row's text into the row */
+static bool hl_cache_lookup(pleditor_hl_cache *cache, uint64_t hash,
+                            const pleditor_syntax *syntax, pleditor_row *row,
+                            unsigned char start) {
+    hl_cache_entry *set = hl_cache_set(cache, hash);
+
+    for (int w = 0; w < HL_CACHE_WAYS; w++) {
+        hl_cache_entry *entry = &set[w];
+        if (!entry->bytes || entry->hash != hash || entry->syntax != syntax ||
+            entry->start_state != start || entry->len != row->render_size ||
+            memcmp(entry->bytes, row->render, entry->len) != 0) {
+            continue;
+        }
+        if (!hl_reserve(row)) return false;
+
+        memcpy(row->hl.hl, entry->bytes + entry->len, entry->len);
+        row->hl.start_state = start;
+        row->hl.end_state = entry->end_state;
+        row->hl.valid = true;
+        entry->referenced = true;
+        return true;
+    }
+    return false;
+}
 
-    /* Update the starting row and all subsequent rows that might be affected */
-    for (int i = start_row; i < state->num_rows; i++) {
-        pleditor_syntax_update_row(state, i);
+/* Remember the highlighting just computed for a row */
+static void hl_cache_insert(pleditor_hl_cache *cache, uint64_t hash,
+                            const pleditor_syntax *syntax, const pleditor_row *row) {
+    /* A huge row would push everything else out */
+    if (2 * (size_t)row->render_size > HL_CACHE_BUDGET / 16) return;
 
-        /* Stop updating when we reach a row not affected by multi-line comments */
-        if (i > start_row && !state->rows[i].hl->hl_multiline_comment) {
-            break;
+    hl_cache_entry *set = hl_cache_set(cache, hash);
+
+    /* An unused way, else the first one not used recently */
+    hl_cache_entry *entry = NULL;
+    for (int w = 0; w < HL_CACHE_WAYS && !entry; w++) {
+        if (!set[w].bytes) entry = &set[w];
+    }
+    for (int w = 0; w < HL_CACHE_WAYS && !entry; w++) {
+        if (!set[w].referenced) entry = &set[w];
+        set[w].referenced = false;
+    }
+    if (!entry) entry = &set[0];
+    hl_cache_evict(cache, entry);
+
+    int len = row->render_size;
+    entry->bytes = malloc(2 * (size_t)len);
+    if (!entry->bytes) return;
+    memcpy(entry->bytes, row->render, len);
+    memcpy(entry->bytes + len, row->hl.hl, len);
+    entry->hash = hash;
+    entry->syntax = syntax;
+    entry->len = len;
+    entry->start_state = row->hl.start_state;
+    entry->end_state = row->hl.end_state;
+    entry->referenced = false;
+    cache->bytes += 2 * (size_t)len;
+
+    /* Over budget: the clock hand gives used entries a second chance */
+    while (cache->bytes > HL_CACHE_BUDGET) {
+        hl_cache_entry *victim = &cache->entries[cache->hand];
+        cache->hand = (cache->hand + 1) % (HL_CACHE_SETS * HL_CACHE_WAYS);
+        if (victim == entry) continue;
+        if (victim->referenced) {
+            victim->referenced = false;
+        } else {
+            hl_cache_evict(cache, victim);
         }
     }
 }
+
+/* Free the highlight cache */
+void pleditor_syntax_free(pleditor_state *state) {
+    pleditor_hl_cache *cache = state->hl_cache;
+    if (!cache) return;
+
+    for (int i = 0; i < HL_CACHE_SETS * HL_CACHE_WAYS; i++) {
+        hl_cache_evict(cache, &cache->entries[i]);
+    }
+    free(cache);
+    state->hl_cache = NULL;
+}
+
+/* Highlight a row, reusing cached highlighting of the same text. Text
+ * that isn't remembered is still looked up */
+static void highlight_row(pleditor_state *state, int row_idx, bool remember) {
+    pleditor_row *row = &state->rows[row_idx];
+    unsigned char start = (row_idx > 0 && state->rows[row_idx-1].hl.valid) ?
+                          state->rows[row_idx-1].hl.end_state : LEX_NORMAL;
+
+    if (!state->syntax || row->render_size < HL_CACHE_MIN_LEN) {
+        lex_row(state->syntax, row, start);
+        return;
+    }
+
+    if (!state->hl_cache) {
+        state->hl_cache = calloc(1, sizeof(pleditor_hl_cache));
+    }
+    pleditor_hl_cache *cache = state->hl_cache;
+    if (!cache) {
+        lex_row(state->syntax, row, start);
+        return;
+    }
+
+    uint64_t hash = hl_cache_hash(row->render, row->render_size);
+    if (hl_cache_lookup(cache, hash, state->syntax, row, start)) return;
+
+    lex_row(state->syntax, row, start);
+    if (remember && row->hl.valid) {
+        hl_cache_insert(cache, hash, state->syntax, row);
+    }
+}
+
+/* Update highlighting for a row */
+void pleditor_syntax_update_row(pleditor_state *state, int row_idx) {
+    highlight_row(state, row_idx, true);
+    pleditor_bracket_row_changed(state, row_idx);
+}
@@ -5,6 +5,7 @@
 #define SYNTAX_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Highlight types */
 enum pleditor_highlight {
@@ -19,33 +20,62 @@ enum pleditor_highlight {
     HL_FUNC_CLASS_NAME
 };
 
-/* Data structure for highlighting in a row */
+/* Lexer state carried from the end of one row to the start of the next */
+enum pleditor_lex_state {
+    LEX_NORMAL = 0,
+    LEX_MULTILINE_COMMENT
+};
+
+/* Data structure for highlighting in a row. The buffer is kept when the
+ * row is highlighted again and only grows, so re-lexing does not allocate */
 typedef struct pleditor_highlight_row {
     unsigned char *hl;          /* Highlighting for each character */
-    bool hl_multiline_comment;  /* Is this row part of a multi-line comment */
+    int capacity;               /* Bytes allocated for hl */
+    unsigned char start_state;  /* Lexer state the row was highlighted from */
+    unsigned char end_state;    /* Lexer state at the end of the row */
+    bool valid;                 /* hl describes the row's current text */
 } pleditor_highlight_row;
 
-/* Syntax definition structure */
+/* Lexer tables compiled from a syntax definition */
+typedef struct pleditor_syntax_profile pleditor_syntax_profile;
+
+/* A language, read from a syntax definition (format described in syntax.c) */
 typedef struct pleditor_syntax {
     char *filetype;         /* Language/filetype name */
-    char **filematch;       /* File patterns that match this syntax */
-    char **keywords;        /* Keywords for the language */
+    char **filematch;       /* File extensions that select this syntax */
+    char **keywords;        /* Keywords; keyword2 entries end in '|' */
     char *singleline_comment_start;  /* Single line comment start */
     char *multiline_comment_start;   /* Multi-line comment start */
     char *multiline_comment_end;     /* Multi-line comment end */
-    bool flags;             /* Syntax flags */
+    char *quotes;           /* Characters that start a string */
+    char **definitions;     /* Words followed by the name they define */
+    char **directives;      /* Preprocessor directives with an argument */
+    char *include_directive;         /* Directive taking a file path */
+    pleditor_syntax_profile *profile; /* Lexer tables compiled at load */
 } pleditor_syntax;
 
+/* Recently computed row highlighting, see syntax.c */
+typedef struct pleditor_hl_cache pleditor_hl_cache;
+
 /* Forward declarations for structs defined in pleditor.h */
 struct pleditor_state;
 typedef struct pleditor_state pleditor_state;
 
 /* Function prototypes */
 bool pleditor_syntax_init(pleditor_state *state);
+void pleditor_syntax_free(pleditor_state *state);
+bool pleditor_syntax_load(const char *text, size_t len, int *error_line);
+bool pleditor_syntax_load_file(const char *filename, int *error_line);
 int pleditor_syntax_color_to_ansi(int hl);
+bool pleditor_syntax_identifier_byte(int c);
 void pleditor_syntax_by_fileext(pleditor_state *state, const char *filename);
 void pleditor_syntax_update_row(pleditor_state *state, int row_idx);
-void pleditor_syntax_update_all(pleditor_state *state);
-void pleditor_syntax_update_multiline(pleditor_state *state, int start_row);
+void pleditor_syntax_ensure(pleditor_state *state, int last_row);
+void pleditor_syntax_invalidate(pleditor_state *state, int row_idx);
+void pleditor_syntax_invalidate_from(pleditor_state *state, int row_idx);
+void pleditor_syntax_mark_changed(pleditor_state *state, int row_idx);
+void pleditor_syntax_rows_changed(pleditor_state *state, int row_idx);
+void pleditor_syntax_row_inserted(pleditor_state *state, int row_idx);
+void pleditor_syntax_row_deleted(pleditor_state *state, int row_idx);
 
 #endif /* SYNTAX_H */
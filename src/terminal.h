@@ -13,6 +13,15 @@
 #define VT100_CURSOR_HIDE "\x1b[?25l"
 #define VT100_CURSOR_SHOW "\x1b[?25h"
 
+/* Synchronized update (DEC private mode 2026): the terminal holds its
+ * display until the end marker, so a frame never shows half drawn */
+#define VT100_SYNC_BEGIN "\x1b[?2026h"
+#define VT100_SYNC_END "\x1b[?2026l"
+#define VT100_SYNC_QUERY "\x1b[?2026$p"
+
+/* Primary device attributes request, answered by every VT100 terminal */
+#define VT100_DEVICE_ATTRIBUTES "\x1b[c"
+
 /* Position cursor at row,col (1-based) */
 #define VT100_CURSOR_POSITION(row, col) "\x1b[" #row ";" #col "H"
 
@@ -28,6 +37,14 @@
 #define VT100_COLOR_WHITE "\x1b[37m"
 #define VT100_COLOR_DARK_GRAY "\x1b[0;90m"  /* Bright black = dark gray */
 
+/* SGR parameters for the colors above */
+#define VT100_SGR_WHITE 37
+#define VT100_SGR_DARK_GRAY 90
+#define VT100_SGR_INVERSE 7
+#define VT100_SGR_BG_RED 41
+#define VT100_SGR_BG_YELLOW 43
+#define VT100_SGR_BG_BLUE 44
+
 /* Background colors */
 #define VT100_BG_BLACK "\x1b[40m"
 #define VT100_BG_RED "\x1b[41m"
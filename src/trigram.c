@@ -0,0 +1,520 @@
+/**
+ * trigram.c - Trigram index of row blocks
+ *
+ * The rows of a large file are grouped into blocks of about
+ * TRIGRAM_BLOCK_BYTES of text. For every three bytes that occur in a row,
+ * letters lowercased, the index lists the blocks they occur in, as varint
+ * gaps between block numbers. A match of a literal contains each of its
+ * trigrams, so only the blocks listed under all of them can hold one; a
+ * regular expression is judged by the runs of bytes every match of it
+ * contains (see regex.c). Searches pass over the rows of the other blocks.
+ * The file is indexed from the top after it is opened, a slice of time at
+ * a time between events; rows not indexed yet are always searched.
+ *
+ * A block is a range of rows, whose bounds move as rows are inserted and
+ * deleted before them. Deleting a row can't add trigrams to its block, but
+ * inserting or changing one can, so the block is marked dirty and always
+ * searched. Once a quarter of the blocks are, the file is indexed again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pleditor.h"
+#include "platform.h"
+#include "regex.h"
+#include "trigram.h"
+
+/* Text in a block: big enough to keep the lists short, small enough that
+ * a rare query leaves most of the file out */
+#define TRIGRAM_BLOCK_BYTES (128 * 1024)
+
+/* Smallest file worth indexing */
+#define TRIGRAM_MIN_BYTES (4 * 1024 * 1024)
+
+/* Most lists intersected for a query; the shortest are used */
+#define TRIGRAM_MAX_LISTS 32
+
+/* Trigrams there can be, three bytes each */
+#define TRIGRAM_COUNT (1 << 24)
+
+/* The blocks one trigram occurs in */
+typedef struct trigram_list {
+    unsigned int key;       /* Trigram + 1, 0 for an empty slot */
+    int last;               /* Last block listed */
+    int count;              /* Blocks listed */
+    int len, cap;
+    unsigned char *data;    /* Gaps from each block listed to the next */
+} trigram_list;
+
+struct pleditor_trigram_index {
+    trigram_list *lists;    /* Hash table of lists by trigram */
+    int table_bits;         /* log2 of the slots */
+    int num_lists;
+
+    int *block_start;       /* First row of each block, then the first row not indexed */
+    unsigned char *dirty;   /* Blocks changed since they were indexed */
+    int num_blocks;
+    int blocks_cap;
+    int num_dirty;
+    int timer;              /* Timer indexing more rows, or -1 */
+
+    unsigned char *seen;    /* While indexing a block, a bit for each trigram in it */
+    unsigned int *found;    /* ... and those trigrams */
+    int num_found, found_cap;
+
+    /* Blocks that may hold a match of the last query filtered */
+    char *query;            /* Its bytes, or runs of them for an expression */
+    int query_len;          /* -1 if there is no query */
+    bool filtered;          /* It has trigrams to filter by */
+    unsigned char *candidates; /* Per block */
+};
+
+/* A byte with letters lowercased */
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* The slot of a trigram's list, empty if it has none */
+static trigram_list *find_list(const pleditor_trigram_index *index, unsigned int trigram) {
+    unsigned int key = trigram + 1;
+    unsigned int mask = (1u << index->table_bits) - 1;
+    unsigned int i = (key * 2654435761u) >> (32 - index->table_bits);
+    while (index->lists[i].key != key && index->lists[i].key != 0) {
+        i = (i + 1) & mask;
+    }
+    return &index->lists[i];
+}
+
+/* Double the hash table. Returns false if out of memory */
+static bool grow_table(pleditor_trigram_index *index) {
+    trigram_list *old = index->lists;
+    int old_size = 1 << index->table_bits;
+
+    trigram_list *lists = calloc((size_t)old_size * 2, sizeof(trigram_list));
+    if (!lists) return false;
+    index->lists = lists;
+    index->table_bits++;
+
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].key != 0) *find_list(index, old[i].key - 1) = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/* Add a block to a trigram's list. Returns false if out of memory */
+static bool add_block(pleditor_trigram_index *index, unsigned int trigram, int block) {
+    trigram_list *list = find_list(index, trigram);
+    if (list->key == 0) {
+        if ((index->num_lists + 1) * 2 > (1 << index->table_bits)) {
+            if (!grow_table(index)) return false;
+            list = find_list(index, trigram);
+        }
+        list->key = trigram + 1;
+        list->last = -1;
+        index->num_lists++;
+    }
+
+    if (list->len + 5 > list->cap) {
+        int cap = list->cap ? list->cap * 2 : 8;
+        unsigned char *data = realloc(list->data, cap);
+        if (!data) return false;
+        list->data = data;
+        list->cap = cap;
+    }
+
+    unsigned int gap = (unsigned int)(block - list->last);
+    while (gap >= 0x80) {
+        list->data[list->len++] = (unsigned char)(gap | 0x80);
+        gap >>= 7;
+    }
+    list->data[list->len++] = (unsigned char)gap;
+    list->last = block;
+    list->count++;
+    return true;
+}
+
+/* Make room for another block */
+static bool reserve_block(pleditor_trigram_index *index) {
+    if (index->num_blocks + 2 <= index->blocks_cap) return true;
+
+    int cap = index->blocks_cap ? index->blocks_cap * 2 : 256;
+    int *block_start = realloc(index->block_start, sizeof(int) * cap);
+    if (!block_start) return false;
+    index->block_start = block_start;
+
+    unsigned char *dirty = realloc(index->dirty, cap);
+    if (!dirty) return false;
+    index->dirty = dirty;
+
+    unsigned char *candidates = realloc(index->candidates, cap);
+    if (!candidates) return false;
+    index->candidates = candidates;
+
+    index->blocks_cap = cap;
+    return true;
+}
+
+/* Note a trigram of the block being indexed, the first time it is seen */
+static bool see(pleditor_trigram_index *index, unsigned int trigram) {
+    unsigned char bit = (unsigned char)(1 << (trigram & 7));
+    if (index->seen[trigram >> 3] & bit) return true;
+    index->seen[trigram >> 3] |= bit;
+
+    if (index->num_found == index->found_cap) {
+        int cap = index->found_cap ? index->found_cap * 2 : 4096;
+        unsigned int *found = realloc(index->found, sizeof(unsigned int) * cap);
+        if (!found) return false;
+        index->found = found;
+        index->found_cap = cap;
+    }
+    index->found[index->num_found++] = trigram;
+    return true;
+}
+
+/* Index the rows after the last block as a new one. Returns false if out
+ * of memory */
+static bool index_block(pleditor_state *state, pleditor_trigram_index *index) {
+    if (!index->seen) {
+        index->seen = calloc(TRIGRAM_COUNT / 8, 1);
+        if (!index->seen) return false;
+    }
+    if (!reserve_block(index)) return false;
+
+    int block = index->num_blocks;
+    int row_idx = index->block_start[block];
+    int bytes = 0;
+    bool ok = true;
+    index->num_found = 0;
+
+    for (; row_idx < state->num_rows && bytes < TRIGRAM_BLOCK_BYTES; row_idx++) {
+        const pleditor_row *row = &state->rows[row_idx];
+        const unsigned char *chars = (const unsigned char *)row->chars;
+        unsigned int trigram = 0;
+        for (int i = 0; i < row->size && ok; i++) {
+            trigram = ((trigram << 8) | fold(chars[i])) & (TRIGRAM_COUNT - 1);
+            if (i >= 2) ok = see(index, trigram);
+        }
+        bytes += row->size + 1;
+    }
+
+    for (int i = 0; i < index->num_found; i++) {
+        unsigned int trigram = index->found[i];
+        index->seen[trigram >> 3] = 0;
+        if (ok) ok = add_block(index, trigram, block);
+    }
+    if (!ok) return false;
+
+    index->block_start[block + 1] = row_idx;
+    index->dirty[block] = 0;
+    index->num_blocks++;
+    index->query_len = -1;
+    return true;
+}
+
+static void schedule(pleditor_state *state);
+
+/* Index rows for up to one slice of time */
+static void index_work(pleditor_state *state, void *data) {
+    (void)data;
+    pleditor_trigram_index *index = state->trigrams;
+    if (!index) return;
+    index->timer = -1;
+
+    long long until = pleditor_platform_time_ms() + PLEDITOR_SEARCH_SLICE_MS;
+    while (index->block_start[index->num_blocks] < state->num_rows) {
+        if (!index_block(state, index)) {
+            /* Without memory for it, searches scan every row */
+            pleditor_trigram_free(state);
+            return;
+        }
+        if (pleditor_platform_time_ms() >= until) break;
+    }
+
+    if (index->block_start[index->num_blocks] == state->num_rows) {
+        /* Done: the scratch space is only needed while indexing */
+        free(index->seen);
+        index->seen = NULL;
+        free(index->found);
+        index->found = NULL;
+        index->found_cap = 0;
+    }
+    schedule(state);
+}
+
+/* Index more rows once pending events are handled, if any are left */
+static void schedule(pleditor_state *state) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (index && index->timer == -1 && index->block_start[index->num_blocks] < state->num_rows) {
+        index->timer = pleditor_add_timer(state, 1, false, index_work, NULL);
+    }
+}
+
+/* Forget every block, to index the file again from the top */
+static void restart(pleditor_state *state) {
+    pleditor_trigram_index *index = state->trigrams;
+    int size = 1 << index->table_bits;
+    for (int i = 0; i < size; i++) {
+        free(index->lists[i].data);
+    }
+    memset(index->lists, 0, sizeof(trigram_list) * size);
+    index->num_lists = 0;
+    index->num_blocks = 0;
+    index->num_dirty = 0;
+    index->block_start[0] = 0;
+    index->query_len = -1;
+    schedule(state);
+}
+
+/* Free the index */
+void pleditor_trigram_free(pleditor_state *state) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (!index) return;
+
+    if (index->timer != -1) pleditor_remove_timer(state, index->timer);
+    if (index->lists) {
+        int size = 1 << index->table_bits;
+        for (int i = 0; i < size; i++) {
+            free(index->lists[i].data);
+        }
+    }
+    free(index->lists);
+    free(index->block_start);
+    free(index->dirty);
+    free(index->seen);
+    free(index->found);
+    free(index->query);
+    free(index->candidates);
+    free(index);
+    state->trigrams = NULL;
+}
+
+/* Index the file in the background if it is large enough to be worth it */
+void pleditor_trigram_start(pleditor_state *state) {
+    pleditor_trigram_free(state);
+    if (!state->use_trigrams) return;
+
+    long long bytes = 0;
+    for (int i = 0; i < state->num_rows; i++) {
+        bytes += state->rows[i].size + 1;
+    }
+    if (bytes < TRIGRAM_MIN_BYTES) return;
+
+    pleditor_trigram_index *index = calloc(1, sizeof(pleditor_trigram_index));
+    if (!index) return;
+    index->table_bits = 12;
+    index->lists = calloc((size_t)1 << index->table_bits, sizeof(trigram_list));
+    index->query_len = -1;
+    index->timer = -1;
+    state->trigrams = index;
+    if (!index->lists || !reserve_block(index)) {
+        pleditor_trigram_free(state);
+        return;
+    }
+    index->block_start[0] = 0;
+    schedule(state);
+}
+
+/* The blocks that may hold a match of the pattern, by their trigrams, or
+ * NULL if it has none (fewer than three bytes in a row) */
+static const unsigned char *filter(pleditor_trigram_index *index, const pleditor_search_pattern *pattern) {
+    if (pattern->len == 0 || pattern->error) return NULL;
+
+    const char *text = pattern->bytes;
+    int len = pattern->len;
+    if (pattern->regex) text = pleditor_regex_required(pattern->regex, &len);
+    if (!text) return NULL;
+
+    if (index->query_len == len && memcmp(index->query, text, len) == 0) {
+        return index->filtered ? index->candidates : NULL;
+    }
+
+    char *query = malloc(len > 0 ? len : 1);
+    trigram_list **lists = malloc(sizeof(trigram_list *) * (len > 0 ? len : 1));
+    if (!query || !lists) {
+        free(query);
+        free(lists);
+        return NULL;
+    }
+    memcpy(query, text, len);
+    free(index->query);
+    index->query = query;
+    index->query_len = len;
+
+    /* The list of each trigram in a run; a '\n' ends one */
+    int num_lists = 0;
+    bool absent = false;
+    unsigned int trigram = 0;
+    int run = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            run = 0;
+            continue;
+        }
+        trigram = ((trigram << 8) | fold((unsigned char)text[i])) & (TRIGRAM_COUNT - 1);
+        if (++run < 3) continue;
+
+        trigram_list *list = find_list(index, trigram);
+        if (list->key == 0) {
+            absent = true;
+            continue;
+        }
+        bool listed = false;
+        for (int j = 0; j < num_lists && !listed; j++) listed = lists[j] == list;
+        if (!listed) lists[num_lists++] = list;
+    }
+
+    index->filtered = absent || num_lists > 0;
+    memset(index->candidates, 0, index->num_blocks);
+    if (!absent && num_lists > 0) {
+        /* The shortest lists, in order, say the most */
+        for (int i = 1; i < num_lists; i++) {
+            trigram_list *list = lists[i];
+            int j = i;
+            for (; j > 0 && lists[j - 1]->count > list->count; j--) lists[j] = lists[j - 1];
+            lists[j] = list;
+        }
+        if (num_lists > TRIGRAM_MAX_LISTS) num_lists = TRIGRAM_MAX_LISTS;
+
+        /* Count the lists each block is in */
+        for (int i = 0; i < num_lists; i++) {
+            const trigram_list *list = lists[i];
+            int block = -1;
+            for (int at = 0; at < list->len;) {
+                unsigned int gap = 0;
+                int shift = 0;
+                unsigned char byte;
+                do {
+                    byte = list->data[at++];
+                    gap |= (unsigned int)(byte & 0x7f) << shift;
+                    shift += 7;
+                } while (byte & 0x80);
+                block += (int)gap;
+                if (index->candidates[block] == i) index->candidates[block]++;
+            }
+        }
+        for (int b = 0; b < index->num_blocks; b++) {
+            index->candidates[b] = index->candidates[b] == num_lists;
+        }
+    }
+
+    free(lists);
+    return index->filtered ? index->candidates : NULL;
+}
+
+/* The block holding an indexed row */
+static int block_of(const pleditor_trigram_index *index, int row) {
+    int lo = 0, hi = index->num_blocks - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (index->block_start[mid] <= row) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* Whether block b may hold a match: it has rows, and they are listed under
+ * the query's trigrams or changed since */
+static bool may_match(const pleditor_trigram_index *index, const unsigned char *candidates, int b) {
+    return (candidates[b] || index->dirty[b]) && index->block_start[b] < index->block_start[b + 1];
+}
+
+/**
+ * The first row at or after row that may hold a match of the pattern, or
+ * num_rows if there is none; end is set to the first row after it that
+ * can't (num_rows if every one after it may)
+ */
+int pleditor_trigram_next(pleditor_state *state, const pleditor_search_pattern *pattern, int row, int *end) {
+    pleditor_trigram_index *index = state->trigrams;
+    const unsigned char *candidates = index ? filter(index, pattern) : NULL;
+    *end = state->num_rows;
+    if (!candidates) return row;
+
+    int unindexed = index->block_start[index->num_blocks];
+    if (row >= unindexed) return row;
+
+    int b = block_of(index, row);
+    while (b < index->num_blocks && !may_match(index, candidates, b)) b++;
+    if (b == index->num_blocks) return unindexed;
+
+    int last = b + 1;
+    while (last < index->num_blocks && may_match(index, candidates, last)) last++;
+    if (last < index->num_blocks) *end = index->block_start[last];
+    return (row > index->block_start[b]) ? row : index->block_start[b];
+}
+
+/**
+ * The last row at or before row that may hold a match of the pattern, or
+ * -1 if there is none; begin is set to the row after the last one
+ * before it that can't (0 if every one before it may)
+ */
+int pleditor_trigram_prev(pleditor_state *state, const pleditor_search_pattern *pattern, int row, int *begin) {
+    pleditor_trigram_index *index = state->trigrams;
+    const unsigned char *candidates = index ? filter(index, pattern) : NULL;
+    *begin = 0;
+    if (!candidates) return row;
+
+    int b, last;
+    if (row >= index->block_start[index->num_blocks]) {
+        b = index->num_blocks;
+        last = row;
+    } else {
+        b = block_of(index, row);
+        while (b >= 0 && !may_match(index, candidates, b)) b--;
+        if (b < 0) return -1;
+        last = (row < index->block_start[b + 1]) ? row : index->block_start[b + 1] - 1;
+    }
+
+    while (b > 0 && may_match(index, candidates, b - 1)) b--;
+    *begin = index->block_start[b];
+    return last;
+}
+
+/* A row of the block may have trigrams it isn't listed under */
+static void mark_dirty(pleditor_state *state, int block) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (index->dirty[block]) return;
+    index->dirty[block] = 1;
+    index->num_dirty++;
+
+    /* Once much of the file has changed, the index has stopped paying */
+    if (index->num_dirty * 4 > index->num_blocks) restart(state);
+}
+
+/* A row was inserted at row_idx; the rows after it moved down by one */
+void pleditor_trigram_row_inserted(pleditor_state *state, int row_idx) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (!index || index->num_blocks == 0) return;
+
+    /* A row added after the last of an indexed file joins its block */
+    int unindexed = index->block_start[index->num_blocks];
+    if (row_idx > unindexed || (row_idx == unindexed && unindexed < state->num_rows - 1)) return;
+
+    int b = block_of(index, row_idx);
+    for (int i = b + 1; i <= index->num_blocks; i++) {
+        index->block_start[i]++;
+    }
+    mark_dirty(state, b);
+}
+
+/* The row at row_idx was deleted; the rows after it moved up by one */
+void pleditor_trigram_row_deleted(pleditor_state *state, int row_idx) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (!index || row_idx >= index->block_start[index->num_blocks]) return;
+
+    int b = block_of(index, row_idx);
+    for (int i = b + 1; i <= index->num_blocks; i++) {
+        index->block_start[i]--;
+    }
+}
+
+/* The text of the row at row_idx changed */
+void pleditor_trigram_row_changed(pleditor_state *state, int row_idx) {
+    pleditor_trigram_index *index = state->trigrams;
+    if (!index || row_idx < 0 || row_idx >= index->block_start[index->num_blocks]) return;
+    mark_dirty(state, block_of(index, row_idx));
+}
@@ -0,0 +1,29 @@
+/**
+ * trigram.h - Trigram index of row blocks for pleditor
+ */
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <stdbool.h>
+
+#include "search.h"
+
+/* Blocks of rows each trigram occurs in (see trigram.c) */
+typedef struct pleditor_trigram_index pleditor_trigram_index;
+
+/* Forward declaration for the struct defined in pleditor.h */
+struct pleditor_state;
+
+/* Function prototypes */
+void pleditor_trigram_start(struct pleditor_state *state);
+void pleditor_trigram_free(struct pleditor_state *state);
+int pleditor_trigram_next(struct pleditor_state *state, const pleditor_search_pattern *pattern,
+                          int row, int *end);
+int pleditor_trigram_prev(struct pleditor_state *state, const pleditor_search_pattern *pattern,
+                          int row, int *begin);
+
+void pleditor_trigram_row_inserted(struct pleditor_state *state, int row_idx);
+void pleditor_trigram_row_deleted(struct pleditor_state *state, int row_idx);
+void pleditor_trigram_row_changed(struct pleditor_state *state, int row_idx);
+
+#endif /* TRIGRAM_H */
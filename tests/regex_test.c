@@ -0,0 +1,60 @@
+/**
+ * regex_test.c - Checks of the regular expression engine
+ *
+ * Run with: xmake build regex_test && xmake run regex_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/regex.h"
+
+static int failures = 0;
+
+/* The pattern compiles, and its first match in text spans [start, end) */
+static void expect_match(const char *pattern, const char *text, int start, int end) {
+    const char *error = NULL;
+    pleditor_regex *re = pleditor_regex_compile(pattern, (int)strlen(pattern), false, &error);
+    if (!re) {
+        printf("FAIL %s: %s\n", pattern, error ? error : "not compiled");
+        failures++;
+        return;
+    }
+
+    int len = (int)strlen(text);
+    int at = pleditor_regex_forward(re, text, len, 0);
+    int to = (at >= 0) ? pleditor_regex_match_end(re, text, len, at) : -1;
+    if (at != start || to != end) {
+        printf("FAIL %s on \"%s\": %d..%d, expected %d..%d\n", pattern, text, at, to, start, end);
+        failures++;
+    }
+    pleditor_regex_free(re);
+}
+
+/* The pattern is rejected with the given error */
+static void expect_error(const char *pattern, const char *expected) {
+    const char *error = NULL;
+    pleditor_regex *re = pleditor_regex_compile(pattern, (int)strlen(pattern), false, &error);
+    if (re || !error || strcmp(error, expected) != 0) {
+        printf("FAIL %s: %s, expected \"%s\"\n", pattern, re ? "compiled" : error, expected);
+        failures++;
+    }
+    pleditor_regex_free(re);
+}
+
+int main(void) {
+    /* Matches are the longest from their start */
+    expect_match("<.*>", "<a> x <b>", 0, 9);
+    expect_match("<[^>]*>", "<a> x <b>", 0, 3);
+    expect_match("a{2,3}", "xaaaa", 1, 4);
+    expect_match("a?b", "cab", 1, 3);
+
+    /* Lazy quantifiers would need the shortest match: rejected */
+    expect_error("<.*?>", "Lazy quantifiers are not supported");
+    expect_error("a+?", "Lazy quantifiers are not supported");
+    expect_error("ab??", "Lazy quantifiers are not supported");
+    expect_error("a{1,3}?", "Lazy quantifiers are not supported");
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
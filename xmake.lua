@@ -1,6 +1,6 @@
 add_rules("mode.debug", "mode.release")
 set_optimize("fastest")
-set_languages("c99")
+set_languages("c11")
 set_warnings("all", "extra")
 set_policy("run.autobuild", true)
 
@@ -13,10 +13,17 @@ target("pleditor")
         add_files("src/platform/windows.c")
     else
         add_files("src/platform/linux.c")
+        add_syslinks("pthread")
     end
 
     on_run(function(target)
         import("core.base.option")
         local args = option.get("arguments")
         os.execv(target:targetfile(), args)
-    end)
\ No newline at end of file
+    end)
+
+-- 正则表达式引擎的检查: xmake build regex_test && xmake run regex_test
+target("regex_test")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/regex_test.c", "src/regex.c")